@@ -480,7 +480,7 @@ private:
 		glGetIntegerv( GL_PROGRAM_ERROR_POSITION_ARB, &position );
 		if( position != -1 ) {
 			const char * error = (const char *) glGetString( GL_PROGRAM_ERROR_STRING_ARB );
-			emit buildMessage(QString(error), inputNumber, m_outputParser);
+			emitBuildMessages(QString(error), inputNumber, m_outputParser);
 			qDebug("%s", error);
 			return true;
 		}
@@ -0,0 +1,344 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Include GLEW before anything else.
+#include <GL/glew.h>
+
+#include "batchcompiler.h"
+#include "effect.h"
+#include "texmanager.h"
+
+#include <QApplication>
+#include <QDir>
+#include <QDirIterator>
+#include <QFileInfo>
+#include <QGLWidget>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QThread>
+
+#include <stdio.h>
+
+namespace {
+
+	static void usage()
+	{
+		fprintf(stderr,
+			"usage: qshaderedit-batch [options] <file|directory>...\n"
+			"\n"
+			"Compiles every effect found in the given paths and reports the diagnostics.\n"
+			"\n"
+			"  -j N           Number of compiler threads (default: number of cores).\n"
+			"  --json         Write the results as JSON instead of plain text.\n"
+			"  --render       Render every effect that builds with the built-in scenes.\n"
+			"  --golden DIR   Compare the renders against the images in DIR.\n"
+			"  --update-golden  Write the renders to the golden directory instead.\n"
+			"  --size N       Size of the renders in pixels (default: 256).\n"
+			"  --time MS      Fixed effect time of the renders (default: 1000).\n"
+			"  --min-psnr DB  Minimum PSNR against the golden images (default: 40).\n"
+			"  --stress N     Build every effect N times in the background, deleting\n"
+			"                 effects while they build, instead of compiling them.\n"
+			"  --help         Show this message.\n"
+			"\n"
+			"Run with QT_QPA_PLATFORM=offscreen to compile without a display.\n");
+	}
+
+	static const char * typeName(MessagePanel::Type type)
+	{
+		switch (type) {
+			case MessagePanel::Error:
+				return "error";
+			case MessagePanel::Warning:
+				return "warning";
+			default:
+				return "info";
+		}
+	}
+
+	// Find the effect files under the given paths. The names are the paths of the
+	// files relative to the directory they were found in, so they don't depend
+	// on the working directory.
+	static QStringList collectFiles(const QStringList & paths, const QStringList & extensions, QStringList * names)
+	{
+		QStringList filters;
+		foreach (QString extension, extensions) {
+			filters.append("*." + extension);
+		}
+
+		QStringList fileNames;
+		foreach (QString path, paths) {
+			QFileInfo info(path);
+			if (info.isDir()) {
+				QDir dir(path);
+				QDirIterator it(path, filters, QDir::Files, QDirIterator::Subdirectories);
+				QStringList found;
+				while (it.hasNext()) {
+					found.append(it.next());
+				}
+				found.sort();
+				fileNames += found;
+				foreach (QString fileName, found) {
+					names->append(dir.relativeFilePath(fileName));
+				}
+			}
+			else if (extensions.contains(info.suffix())) {
+				fileNames.append(path);
+				names->append(info.fileName());
+			}
+			else {
+				fprintf(stderr, "%s: not a supported effect file\n", qPrintable(path));
+			}
+		}
+		return fileNames;
+	}
+
+	static void printText(const BatchQueue & queue)
+	{
+		for (int i = 0; i < queue.count(); i++) {
+			const BatchResult & result = queue.result(i);
+
+			foreach (const BatchDiagnostic & d, result.diagnostics) {
+				if (d.type == MessagePanel::Info) {
+					continue;
+				}
+				// Use the same layout as gcc so that the output can be parsed by other tools.
+				printf("%s:", qPrintable(result.fileName));
+				if (!d.input.isEmpty()) printf("%s:", qPrintable(d.input));
+				if (d.line >= 0) printf("%d:", d.line);
+				if (d.column >= 0) printf("%d:", d.column);
+				printf(" %s: %s\n", typeName(d.type), qPrintable(d.message));
+			}
+
+			const char * status = !result.loaded ? "SKIPPED" : result.succeeded ? "OK" : "FAILED";
+			printf("%s: %s (%d ms)\n", qPrintable(result.fileName), status, result.milliseconds);
+
+			foreach (const BatchRender & r, result.renders) {
+				printf("%s: %s: %s %s", qPrintable(result.fileName), qPrintable(r.scene),
+					r.goldenMissing ? "MISSING" : r.passed ? "OK" : "MISMATCH", qPrintable(r.hash));
+				if (r.psnr >= 0.0) printf(" (%.2f dB)", r.psnr);
+				printf(" (%.3f ms)\n", r.milliseconds);
+			}
+		}
+	}
+
+	static void printJson(const BatchQueue & queue)
+	{
+		QJsonArray files;
+		for (int i = 0; i < queue.count(); i++) {
+			const BatchResult & result = queue.result(i);
+
+			QJsonArray diagnostics;
+			foreach (const BatchDiagnostic & d, result.diagnostics) {
+				QJsonObject diagnostic;
+				diagnostic["type"] = QString(typeName(d.type));
+				diagnostic["input"] = d.input;
+				diagnostic["line"] = d.line;
+				diagnostic["column"] = d.column;
+				diagnostic["message"] = d.message;
+				diagnostics.append(diagnostic);
+			}
+
+			QJsonArray renders;
+			foreach (const BatchRender & r, result.renders) {
+				QJsonObject render;
+				render["scene"] = r.scene;
+				render["hash"] = r.hash;
+				render["psnr"] = r.psnr;
+				render["milliseconds"] = r.milliseconds;
+				render["passed"] = r.passed;
+				render["goldenMissing"] = r.goldenMissing;
+				renders.append(render);
+			}
+
+			QJsonObject file;
+			file["file"] = result.fileName;
+			file["loaded"] = result.loaded;
+			file["succeeded"] = result.succeeded;
+			file["milliseconds"] = result.milliseconds;
+			file["diagnostics"] = diagnostics;
+			if (!renders.isEmpty()) {
+				file["renders"] = renders;
+			}
+			files.append(file);
+		}
+
+		printf("%s", QJsonDocument(files).toJson().constData());
+	}
+
+} // namespace
+
+
+int main(int argc, char **argv)
+{
+	QApplication app(argc, argv);
+
+	int threadCount = QThread::idealThreadCount();
+	bool json = false;
+	int stressIterations = 0;
+	BatchRenderOptions renderOptions;
+	QStringList paths;
+
+	QStringList args = app.arguments();
+	for (int i = 1; i < args.count(); i++) {
+		const QString & arg = args.at(i);
+		if (arg == "-j" && i + 1 < args.count()) {
+			threadCount = args.at(++i).toInt();
+		}
+		else if (arg == "--json") {
+			json = true;
+		}
+		else if (arg == "--render") {
+			renderOptions.enabled = true;
+		}
+		else if (arg == "--golden" && i + 1 < args.count()) {
+			renderOptions.goldenDir = args.at(++i);
+		}
+		else if (arg == "--update-golden") {
+			renderOptions.updateGolden = true;
+		}
+		else if (arg == "--size" && i + 1 < args.count()) {
+			renderOptions.size = qMax(1, args.at(++i).toInt());
+		}
+		else if (arg == "--time" && i + 1 < args.count()) {
+			renderOptions.time = qMax(0, args.at(++i).toInt());
+		}
+		else if (arg == "--min-psnr" && i + 1 < args.count()) {
+			renderOptions.minPsnr = args.at(++i).toDouble();
+		}
+		else if (arg == "--stress" && i + 1 < args.count()) {
+			stressIterations = qMax(1, args.at(++i).toInt());
+		}
+		else if (arg == "--help" || arg == "-h") {
+			usage();
+			return 0;
+		}
+		else {
+			paths.append(arg);
+		}
+	}
+
+	if (paths.isEmpty()) {
+		usage();
+		return 2;
+	}
+	if (threadCount < 1) {
+		threadCount = 1;
+	}
+	if (!renderOptions.goldenDir.isEmpty()) {
+		renderOptions.enabled = true;
+		if (renderOptions.updateGolden) {
+			QDir().mkpath(renderOptions.goldenDir);
+		}
+	}
+
+	if (!QGLFormat::hasOpenGL()) {
+		fprintf(stderr, "Error: OpenGL is not available\n");
+		return 2;
+	}
+
+	// The first context is used to initialize GLEW, the others share its objects.
+	QList<QGLWidget *> widgets;
+	for (int i = 0; i < threadCount; i++) {
+		QGLWidget * widget = new QGLWidget(NULL, widgets.isEmpty() ? NULL : widgets.first());
+		widget->setAttribute(Qt::WA_DontShowOnScreen);
+		widget->winId();	// Create the native surface without showing it.
+		widgets.append(widget);
+	}
+
+	widgets.first()->makeCurrent();
+	GLenum err = glewInit();
+	if (GLEW_OK != err) {
+		fprintf(stderr, "Error: %s\n", glewGetErrorString(err));
+		return 2;
+	}
+
+	QStringList extensions;
+	foreach (const EffectFactory * factory, EffectFactory::factoryList()) {
+		if (factory->isSupported()) {
+			extensions.append(factory->extension());
+		}
+	}
+	widgets.first()->doneCurrent();
+
+	// Create the texture loader here, so that it's owned by the thread that
+	// deletes it instead of by the first compiler thread that opens a texture.
+	TextureLoader::instance();
+
+	QStringList names;
+	QStringList fileNames = collectFiles(paths, extensions, &names);
+
+	if (stressIterations > 0) {
+		// The builds run on the GL thread pool and finish in this thread's event loop.
+		widgets.first()->makeCurrent();
+
+		int failed = 0;
+		BatchStressTest test(widgets.first(), stressIterations);
+		foreach (QString fileName, fileNames) {
+			const bool passed = test.run(fileName);
+			printf("%s: %s (%d iterations)\n", qPrintable(fileName), passed ? "OK" : "INCONSISTENT", stressIterations);
+			if (!passed) {
+				failed++;
+			}
+		}
+
+		widgets.first()->doneCurrent();
+		qDeleteAll(widgets);
+		return failed == 0 ? 0 : 1;
+	}
+
+	BatchQueue queue(fileNames, names);
+	threadCount = qMin(threadCount, qMax(queue.count(), 1));
+
+	QList<BatchCompiler *> compilers;
+	for (int i = 0; i < threadCount; i++) {
+		compilers.append(new BatchCompiler(&queue, widgets.at(i), renderOptions));
+	}
+	foreach (BatchCompiler * compiler, compilers) {
+		compiler->start();
+	}
+	foreach (BatchCompiler * compiler, compilers) {
+		compiler->wait();
+	}
+	qDeleteAll(compilers);
+
+	if (json) {
+		printJson(queue);
+	}
+	else {
+		printText(queue);
+	}
+
+	int failed = 0;
+	for (int i = 0; i < queue.count(); i++) {
+		const BatchResult & result = queue.result(i);
+		bool passed = result.succeeded;
+		foreach (const BatchRender & r, result.renders) {
+			passed &= r.passed;
+		}
+		if (!passed) {
+			failed++;
+		}
+	}
+
+	// Contexts have to be destroyed in the GUI thread.
+	qDeleteAll(widgets);
+
+	return failed == 0 ? 0 : 1;
+}
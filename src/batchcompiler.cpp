@@ -0,0 +1,402 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+// Include GLEW before anything else.
+#include <GL/glew.h>
+
+#include "batchcompiler.h"
+#include "effect.h"
+#include "scene.h"
+#include "glutils.h"
+#include "texmanager.h"
+
+#include <QCoreApplication>
+#include <QCryptographicHash>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QImage>
+#include <QMutexLocker>
+#include <QRegExp>
+#include <QGLWidget>
+
+#include <math.h>
+
+namespace {
+
+	// Peak signal to noise ratio in dB, 100 for identical images.
+	static double computePsnr(const QImage & a, const QImage & b)
+	{
+		if (a.size() != b.size()) {
+			return 0.0;
+		}
+
+		double error = 0.0;
+		for (int y = 0; y < a.height(); y++) {
+			const uchar * pa = a.constScanLine(y);
+			const uchar * pb = b.constScanLine(y);
+			for (int x = 0; x < a.width() * 4; x++) {
+				double d = double(pa[x]) - double(pb[x]);
+				error += d * d;
+			}
+		}
+
+		double mse = error / (a.width() * a.height() * 4);
+		if (mse == 0.0) {
+			return 100.0;
+		}
+		return qMin(100.0, 10.0 * log10(255.0 * 255.0 / mse));
+	}
+
+	static QString goldenName(const QString & fileName, const QString & sceneName)
+	{
+		QString name = QDir::fromNativeSeparators(fileName) + "-" + sceneName;
+		name.replace(QRegExp("[^A-Za-z0-9_.-]"), "_");
+		return name + ".png";
+	}
+
+} // namespace
+
+
+BatchQueue::BatchQueue(const QStringList & fileNames, const QStringList & names) : m_next(0)
+{
+	Q_ASSERT(fileNames.count() == names.count());
+
+	m_results.resize(fileNames.count());
+	for (int i = 0; i < fileNames.count(); i++) {
+		m_results[i].fileName = fileNames.at(i);
+		m_results[i].name = names.at(i);
+	}
+}
+
+int BatchQueue::next()
+{
+	QMutexLocker locker(&m_mutex);
+
+	if (m_next < m_results.count()) {
+		return m_next++;
+	}
+	return -1;
+}
+
+
+BatchCompiler::BatchCompiler(BatchQueue * queue, QGLWidget * widget, const BatchRenderOptions & options) :
+	m_queue(queue),
+	m_widget(widget),
+	m_options(options),
+	m_current(NULL)
+{
+	Q_ASSERT(queue != NULL);
+	Q_ASSERT(widget != NULL);
+
+	// The context has to live in the thread that uses it.
+	m_widget->context()->moveToThread(this);
+}
+
+void BatchCompiler::run()
+{
+	m_widget->makeCurrent();
+
+	int i;
+	while ((i = m_queue->next()) != -1) {
+		compile(m_queue->result(i));
+	}
+
+	m_widget->doneCurrent();
+
+	// Hand the context back so that it can be destroyed by the GUI thread.
+	m_widget->context()->moveToThread(QCoreApplication::instance()->thread());
+}
+
+void BatchCompiler::compile(BatchResult & result)
+{
+	QFileInfo info(result.fileName);
+
+	const EffectFactory * factory = EffectFactory::factoryForExtension(info.suffix());
+	if (factory == NULL || !factory->isSupported()) {
+		return;
+	}
+
+	QFile file(result.fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return;
+	}
+
+	QElapsedTimer timer;
+	timer.start();
+
+	Effect * effect = factory->createEffect(m_widget);
+	Q_ASSERT(effect != NULL);
+
+	// The effect lives in this thread, so deliver the messages right away.
+	connect(effect, SIGNAL(buildMessage(QString,MessagePanel::Type,int,int,int)), this, SLOT(onBuildMessage(QString,MessagePanel::Type,int,int,int)), Qt::DirectConnection);
+	connect(effect, SIGNAL(errorMessage(QString)), this, SLOT(onErrorMessage(QString)), Qt::DirectConnection);
+
+	effect->load(&file);
+	file.close();
+	result.loaded = true;
+
+	m_inputNames.clear();
+	for (int i = 0; i < effect->getInputNum(); i++) {
+		m_inputNames.append(effect->getInputName(i));
+	}
+
+	m_current = &result;
+	effect->build(false);
+	m_current = NULL;
+
+	result.succeeded = effect->isValid();
+	result.milliseconds = timer.elapsed();
+
+	if (result.succeeded && m_options.enabled) {
+		render(effect, result);
+	}
+
+	delete effect;
+}
+
+void BatchCompiler::onBuildMessage(QString msg, MessagePanel::Type type, int input, int line, int column)
+{
+	Q_ASSERT(m_current != NULL);
+
+	BatchDiagnostic diagnostic;
+	if (input >= 0 && input < m_inputNames.count()) {
+		diagnostic.input = m_inputNames.at(input);
+	}
+	diagnostic.type = type;
+	diagnostic.line = line;
+	diagnostic.column = column;
+	diagnostic.message = msg.trimmed();
+	m_current->diagnostics.append(diagnostic);
+}
+
+void BatchCompiler::onErrorMessage(QString msg)
+{
+	if (m_current == NULL) {
+		return;
+	}
+
+	BatchDiagnostic diagnostic;
+	diagnostic.type = MessagePanel::Error;
+	diagnostic.line = -1;
+	diagnostic.column = -1;
+	diagnostic.message = msg;
+	m_current->diagnostics.append(diagnostic);
+}
+
+void BatchCompiler::render(Effect * effect, BatchResult & result)
+{
+	if (!GLEW_ARB_framebuffer_object) {
+		onErrorMessage(tr("Framebuffer objects not supported, can't render '%1'").arg(result.fileName));
+		return;
+	}
+
+	const int size = m_options.size;
+
+	GLuint fbo, color, depth;
+	glGenFramebuffers(1, &fbo);
+	glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+
+	glGenRenderbuffers(1, &color);
+	glBindRenderbuffer(GL_RENDERBUFFER, color);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, color);
+
+	glGenRenderbuffers(1, &depth);
+	glBindRenderbuffer(GL_RENDERBUFFER, depth);
+	glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH24_STENCIL8, size, size);
+	glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_STENCIL_ATTACHMENT, GL_RENDERBUFFER, depth);
+
+	// Animated effects have to produce the same image every time.
+	effect->setFixedTime(m_options.time);
+
+	// Render with the real textures, not the loading placeholder.
+	TextureLoader::instance()->finish();
+
+	foreach (const SceneFactory * factory, SceneFactory::factoryList()) {
+		if (factory->isInteractive()) {
+			continue;
+		}
+
+		Scene * scene = factory->createScene();
+
+		BatchRender render;
+		render.scene = factory->name();
+
+		// Time a single frame, the first one warms up the driver.
+		drawScene(effect, scene);
+		glFinish();
+
+		QElapsedTimer timer;
+		timer.start();
+		drawScene(effect, scene);
+		glFinish();
+		render.milliseconds = timer.nsecsElapsed() * 1e-6;
+
+		QImage image(size, size, QImage::Format_RGBA8888);
+		glPixelStorei(GL_PACK_ALIGNMENT, 4);
+		glReadPixels(0, 0, size, size, GL_RGBA, GL_UNSIGNED_BYTE, image.bits());
+		image = image.mirrored();
+
+		QByteArray pixels = QByteArray::fromRawData((const char *)image.constBits(), image.byteCount());
+		render.hash = QCryptographicHash::hash(pixels, QCryptographicHash::Sha1).toHex();
+
+		render.psnr = -1.0;
+		render.passed = true;
+		render.goldenMissing = false;
+
+		if (!m_options.goldenDir.isEmpty()) {
+			QString goldenPath = QDir(m_options.goldenDir).filePath(goldenName(result.name, render.scene));
+
+			if (m_options.updateGolden) {
+				image.save(goldenPath);
+			}
+			else {
+				QImage golden(goldenPath);
+				if (!golden.isNull()) {
+					render.psnr = computePsnr(image, golden.convertToFormat(QImage::Format_RGBA8888));
+					render.passed = render.psnr >= m_options.minPsnr;
+				}
+				else {
+					// A new effect, or the wrong directory. Either way nothing was checked.
+					render.goldenMissing = true;
+					render.passed = false;
+				}
+			}
+		}
+
+		result.renders.append(render);
+
+		delete scene;
+	}
+
+	effect->setFixedTime(-1);
+
+	glBindFramebuffer(GL_FRAMEBUFFER, 0);
+	glDeleteRenderbuffers(1, &depth);
+	glDeleteRenderbuffers(1, &color);
+	glDeleteFramebuffers(1, &fbo);
+}
+
+/// Draw the scene the way SceneView does, with the default camera.
+void BatchCompiler::drawScene(Effect * effect, const Scene * scene)
+{
+	const int size = m_options.size;
+
+	glViewport(0, 0, size, size);
+	glClearColor(0.0, 0.0, 0.0, 0.0);
+	glEnable(GL_DEPTH_TEST);
+	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
+
+	glMatrixMode(GL_PROJECTION);
+	glLoadIdentity();
+	perspective(30, 1.0f, 0.3, 50);
+
+	glMatrixMode(GL_MODELVIEW);
+	glLoadIdentity();
+	gluLookAt(0, 0, 5, 0, 0, 4, 0, 1, 0);
+	scene->transform();
+
+	float light_vector[4] = {1.2f/sqrt(3.08f), 1.0f/sqrt(3.08f), 0.8f/sqrt(3.08f), 0.0f};
+	glLightfv(GL_LIGHT0, GL_POSITION, light_vector);
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+
+	effect->begin();
+	for (int i = 0; i < effect->getPassNum(); i++) {
+		effect->beginPass(i);
+		scene->draw(effect);
+		effect->endPass();
+	}
+	effect->end();
+}
+
+
+BatchStressTest::BatchStressTest(QGLWidget * widget, int iterations) :
+	m_widget(widget),
+	m_iterations(iterations),
+	m_builtCount(0),
+	m_succeededCount(0),
+	m_failedCount(0)
+{
+	Q_ASSERT(widget != NULL);
+}
+
+bool BatchStressTest::run(const QString & fileName)
+{
+	const EffectFactory * factory = EffectFactory::factoryForExtension(QFileInfo(fileName).suffix());
+	if (factory == NULL || !factory->isSupported()) {
+		return true;
+	}
+
+	m_succeededCount = 0;
+	m_failedCount = 0;
+
+	for (int i = 0; i < m_iterations; i++) {
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+
+		Effect * effect = factory->createEffect(m_widget);
+		Q_ASSERT(effect != NULL);
+		connect(effect, SIGNAL(built(bool)), this, SLOT(onBuilt(bool)));
+
+		effect->load(&file);
+		file.close();
+
+		m_builtCount = 0;
+
+		// Start the next build from the finished one, while its task may still be returning.
+		const int rebuilds = i % 4;
+		effect->build(true);
+		for (int r = 0; r < rebuilds; r++) {
+			waitForBuilds(r + 1);
+			effect->build(true);
+		}
+
+		// Every other time, delete the effect with its last build still running.
+		if (i % 2 == 0) {
+			waitForBuilds(rebuilds + 1);
+		}
+		delete effect;
+	}
+
+	return m_succeededCount == 0 || m_failedCount == 0;
+}
+
+void BatchStressTest::onBuilt(bool succeed)
+{
+	m_builtCount++;
+	if (succeed) {
+		m_succeededCount++;
+	}
+	else {
+		m_failedCount++;
+	}
+}
+
+void BatchStressTest::waitForBuilds(int count)
+{
+	// Effects that don't build in the background are done already.
+	while (m_builtCount < count) {
+		QCoreApplication::processEvents(QEventLoop::WaitForMoreEvents);
+	}
+}
@@ -0,0 +1,162 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef BATCHCOMPILER_H
+#define BATCHCOMPILER_H
+
+#include <QThread>
+#include <QMutex>
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+#include "messagepanel.h"
+
+class QGLWidget;
+class Effect;
+class Scene;
+
+
+/// A single compiler diagnostic.
+struct BatchDiagnostic
+{
+	MessagePanel::Type type;
+	QString input;		// Name of the effect input, empty for link messages.
+	int line;
+	int column;
+	QString message;
+};
+
+/// Result of rendering an effect with one of the scenes.
+struct BatchRender
+{
+	QString scene;
+	QString hash;		// SHA-1 of the pixels.
+	double psnr;		// Against the golden image, negative if there is none.
+	double milliseconds;
+	bool passed;
+	bool goldenMissing;	// Counts as a failure when comparing against a golden directory.
+};
+
+/// Result of compiling one effect file.
+struct BatchResult
+{
+	BatchResult() : loaded(false), succeeded(false), milliseconds(0) {}
+
+	QString fileName;
+	QString name;		// Relative to the directory the file was found in, names the golden images.
+	bool loaded;
+	bool succeeded;
+	int milliseconds;
+	QList<BatchDiagnostic> diagnostics;
+	QList<BatchRender> renders;
+};
+
+/// Options of the render check. Every effect that builds is rendered with 
+/// all the non interactive scenes and compared against the golden images.
+struct BatchRenderOptions
+{
+	BatchRenderOptions() : enabled(false), updateGolden(false), size(256), time(1000), minPsnr(40.0) {}
+
+	bool enabled;
+	QString goldenDir;
+	bool updateGolden;	// Write the images instead of comparing them.
+	int size;
+	int time;			// Fixed time of animated effects, in milliseconds.
+	double minPsnr;
+};
+
+
+/// Work queue shared by all the compiler threads.
+class BatchQueue
+{
+public:
+	BatchQueue(const QStringList & fileNames, const QStringList & names);
+
+	int count() const { return m_results.count(); }
+
+	// Get the index of the next file to compile, or -1 when done.
+	int next();
+
+	BatchResult & result(int i) { return m_results[i]; }
+	const BatchResult & result(int i) const { return m_results.at(i); }
+
+private:
+	QMutex m_mutex;
+	int m_next;
+	QVector<BatchResult> m_results;
+};
+
+
+/// Thread that compiles effects from the queue using its own GL context.
+class BatchCompiler : public QThread
+{
+	Q_OBJECT
+public:
+	BatchCompiler(BatchQueue * queue, QGLWidget * widget, const BatchRenderOptions & options);
+
+	virtual void run();
+
+private slots:
+	void onBuildMessage(QString msg, MessagePanel::Type type, int input, int line, int column);
+	void onErrorMessage(QString msg);
+
+private:
+	void compile(BatchResult & result);
+	void render(Effect * effect, BatchResult & result);
+	void drawScene(Effect * effect, const Scene * scene);
+
+	BatchQueue * m_queue;
+	QGLWidget * m_widget;
+	BatchRenderOptions m_options;
+
+	// Result being compiled, only valid inside compile().
+	BatchResult * m_current;
+	QStringList m_inputNames;
+};
+
+
+/// Builds effects on the GL thread pool over and over, rebuilding them as soon
+/// as a build finishes and deleting them while builds are still running, to
+/// catch races in the build lifecycle. Runs on the GUI thread.
+class BatchStressTest : public QObject
+{
+	Q_OBJECT
+public:
+	BatchStressTest(QGLWidget * widget, int iterations);
+
+	// Returns false if the builds of the file didn't all give the same result.
+	bool run(const QString & fileName);
+
+private slots:
+	void onBuilt(bool succeed);
+
+private:
+	void waitForBuilds(int count);
+
+	QGLWidget * m_widget;
+	int m_iterations;
+
+	int m_builtCount;		// Builds finished by the current effect.
+	int m_succeededCount;	// Builds of the current file that succeeded.
+	int m_failedCount;
+};
+
+
+#endif // BATCHCOMPILER_H
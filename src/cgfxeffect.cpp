@@ -443,24 +443,10 @@ private:
 
 	QString m_effectPath;
 	
-	// Builder thread.
-	class BuilderThread : public GLThread
-	{
-		CgFxEffect * m_effect;
-	public:
-		BuilderThread(QGLWidget * widget, CgFxEffect * effect) : GLThread(widget), m_effect(effect)
-		{
-		}
-		void run() 
-		{
-			this->makeCurrent();
-			bool succeed = m_effect->threadedBuild();
-			this->doneCurrent();
-			emit m_effect->built(succeed);
-		}
-	};
-	friend class BuilderThread;
-	BuilderThread m_thread;	
+	// Source being built and the effect created by the builder, swapped in by finishBuild().
+	QByteArray m_buildEffectText;
+	CGeffect m_newEffect;
+	QList<CGtechnique> m_newTechniqueList;
 
 public:
 
@@ -471,7 +457,7 @@ public:
 		m_pass(NULL),
 		m_effectText(s_effectText),
 		m_animated(false),
-		m_thread(widget, this)
+		m_newEffect(NULL)
 	{
 		this->makeCurrent();
 
@@ -524,6 +510,8 @@ public:
 
 	virtual ~CgFxEffect()
 	{
+		waitForBuild();
+		
 		this->makeCurrent();
 		
 		qcgDestroyContext(m_context);
@@ -576,17 +564,17 @@ public:
 	}
 
 	
-	bool threadedBuild()
+	virtual bool threadedBuild()
 	{
 		emit infoMessage(tr("Compiling cg effect..."));
 		
 		QString includeOption = "-I" + m_effectPath;
 		const char * options[] = { includeOption.toLatin1(), NULL };
 		
-		CGeffect effect = qcgCreateEffect(m_context, m_effectText.data(), options);
+		CGeffect effect = qcgCreateEffect(m_context, m_buildEffectText.constData(), options);
 		
 		// Output compilation errors.
-		emit buildMessage(qcgGetLastListing(m_context), 0, m_outputParser);
+		emitBuildMessages(qcgGetLastListing(m_context), 0, m_outputParser);
 
 		if (effect == NULL)
 		{
@@ -607,7 +595,7 @@ public:
 			}
 			
 			// Output validation errors.
-			emit buildMessage(qcgGetLastListing(m_context), 0, m_outputParser);
+			emitBuildMessages(qcgGetLastListing(m_context), 0, m_outputParser);
 			
 			technique = qcgGetNextTechnique(technique);
 		}
@@ -618,37 +606,43 @@ public:
 			return false;
 		}
 		
+		Q_ASSERT(m_newEffect == NULL);
+		m_newEffect = effect;
+		m_newTechniqueList = techniqueList;
+		
+		return true;
+	}
+	
+	virtual void finishBuild(bool succeed)
+	{
+		if (!succeed) {
+			return;
+		}
+		
 		freeEffect();
-		m_effect = effect;
-		m_techniqueList = techniqueList;
+		m_effect = m_newEffect;
+		m_techniqueList = m_newTechniqueList;
+		
+		m_newEffect = NULL;
+		m_newTechniqueList.clear();
 		
 		selectTechnique(0);
 		
 		initParameters();
-		
-		return true;
 	}
 	
 	// Compilation.
 	virtual void build(bool threaded)
 	{
-#if defined(Q_OS_LINUX)
-		threaded = false;
-#endif
+		// The editor may change the source while the builder is running.
+		m_buildEffectText = m_effectText;
 		
-		if (threaded) {
-			m_thread.start();
-		}
-		else {
-			this->makeCurrent();
-			bool succeed = threadedBuild();
-			emit built(succeed);
-		}
+		startBuild(threaded);
 	}
 	
 	virtual bool isBuilding() const
 	{
-		return m_thread.isRunning();
+		return isBuildPending();
 	}
 
 	// Parameter info.
@@ -735,7 +729,7 @@ public:
 						// @@ ???
 					}
 					else if( std.m_type == CgSemantic::Type_Time ) {
-						qcgSetParameter1f(parameter, 0.001f * m_time.elapsed());
+						qcgSetParameter1f(parameter, 0.001f * elapsedTime(m_time));
 					}
 					else if( std.m_type == CgSemantic::Type_ViewportSize ) {
 						GLfloat v[4];
@@ -10,10 +10,17 @@
 //
 #include "completer.h"
 #include "highlighter.h"
+#include "effect.h"
 //
 #include <QPlainTextEdit>
+#include <QTextDocument>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <QSet>
+#include <QRegExp>
 #include <QVBoxLayout>
 #include <QTextCursor>
+#include <QTextBlock>
 #include <QToolTip>
 #include <QPoint>
 #include <QApplication>
@@ -21,10 +28,235 @@
 #include <QFontMetrics>
 //
 //
-Completer::Completer( const QString& extation, QWidget* parent, Qt::WFlags f )
+// Completion popups show at most this many items, whatever the vocabulary size.
+static const int s_maxItems = 256;
+//
+//
+CompletionTrie::CompletionTrie()
+{
+	clear();
+}
+
+void CompletionTrie::clear()
+{
+	m_nodes.clear();
+	m_nodes.append(Node());
+	m_entries.clear();
+}
+
+void CompletionTrie::insert(const QString& word, Kind kind, const QString& toolTip)
+{
+	int node = 0;
+	for (int i = 0; i < word.length(); i++)
+	{
+		int child = m_nodes.at(node).children.value(word.at(i), -1);
+		if (child == -1)
+		{
+			child = m_nodes.count();
+			m_nodes[node].children.insert(word.at(i), child);
+			m_nodes.append(Node());
+		}
+		node = child;
+	}
+
+	// The first declaration of a word wins.
+	if (m_nodes.at(node).entry == -1)
+	{
+		Entry entry;
+		entry.word = word;
+		entry.toolTip = toolTip;
+		entry.kind = kind;
+		m_nodes[node].entry = m_entries.count();
+		m_entries.append(entry);
+	}
+}
+
+QList<CompletionTrie::Entry> CompletionTrie::complete(const QString& prefix, int maxCount) const
+{
+	QList<Entry> result;
+
+	int node = 0;
+	for (int i = 0; i < prefix.length() && node != -1; i++)
+		node = m_nodes.at(node).children.value(prefix.at(i), -1);
+	if (node == -1)
+		return result;
+
+	// Depth first, the children in reverse so that the smallest is visited first.
+	QVector<int> stack;
+	stack.append(node);
+	while (!stack.isEmpty() && result.count() < maxCount)
+	{
+		const Node& n = m_nodes.at(stack.last());
+		stack.removeLast();
+
+		if (n.entry != -1)
+			result.append(m_entries.at(n.entry));
+
+		QMapIterator<QChar, int> it(n.children);
+		it.toBack();
+		while (it.hasPrevious())
+			stack.append(it.previous().value());
+	}
+	return result;
+}
+
+
+/// Parses a snapshot of the effect inputs.
+class SymbolIndex::ParseTask : public QRunnable
+{
+public:
+	ParseTask(SymbolIndex* index, const QString& text, int generation) : m_index(index), m_text(text), m_generation(generation) {}
+
+	virtual void run()
+	{
+		CompletionTrie trie;
+		QMultiHash<QString, QString> members;
+		QHash<QString, QStringList> structs;
+
+		QRegExp structRegExp("\\bstruct\\s+(\\w+)\\s*\\{([^}]*)\\}");
+		QRegExp memberRegExp("(\\w+)\\s*(\\[[^\\]]*\\])?\\s*(:\\s*\\w+\\s*)?$");
+		for (int i = structRegExp.indexIn(m_text); i != -1; i = structRegExp.indexIn(m_text, i + structRegExp.matchedLength()))
+		{
+			const QString name = structRegExp.cap(1);
+			QStringList fields;
+			foreach (const QString& declaration, structRegExp.cap(2).split(';'))
+			{
+				// "float a, b[2] : TEXCOORD0" declares a and b.
+				foreach (const QString& declarator, declaration.split(','))
+				{
+					if (memberRegExp.indexIn(declarator.trimmed()) != -1)
+						fields.append(memberRegExp.cap(1));
+				}
+			}
+			structs.insert(name, fields);
+			trie.insert(name, CompletionTrie::Struct, "struct " + name);
+		}
+
+		QRegExp functionRegExp("\\b(\\w+)\\s+(\\w+)\\s*\\(([^)]*)\\)\\s*(:\\s*\\w+\\s*)?\\{");
+		static const char* const s_statements[] = { "if", "for", "while", "switch", "return", "else" };
+		QSet<QString> statements;
+		for (unsigned int i = 0; i < sizeof(s_statements) / sizeof(s_statements[0]); i++)
+			statements.insert(s_statements[i]);
+
+		for (int i = functionRegExp.indexIn(m_text); i != -1; i = functionRegExp.indexIn(m_text, i + functionRegExp.matchedLength()))
+		{
+			const QString name = functionRegExp.cap(2);
+			if (statements.contains(name) || statements.contains(functionRegExp.cap(1)))
+				continue;
+			trie.insert(name, CompletionTrie::Function,
+				functionRegExp.cap(1) + " " + name + "(" + functionRegExp.cap(3).simplified() + ")");
+		}
+
+		QRegExp uniformRegExp("\\buniform\\s+(\\w+)\\s+(\\w+)");
+		for (int i = uniformRegExp.indexIn(m_text); i != -1; i = uniformRegExp.indexIn(m_text, i + uniformRegExp.matchedLength()))
+		{
+			trie.insert(uniformRegExp.cap(2), CompletionTrie::Uniform, "uniform " + uniformRegExp.cap(1) + " " + uniformRegExp.cap(2));
+		}
+
+		// Variables and parameters of the user structs complete with their members.
+		if (!structs.isEmpty())
+		{
+			QRegExp variableRegExp("\\b(\\w+)\\s+(\\w+)\\s*(\\[[^\\]]*\\])?\\s*[;=,):]");
+			for (int i = variableRegExp.indexIn(m_text); i != -1; i = variableRegExp.indexIn(m_text, i + variableRegExp.matchedLength() - 1))
+			{
+				QHash<QString, QStringList>::const_iterator it = structs.constFind(variableRegExp.cap(1));
+				if (it == structs.constEnd())
+					continue;
+				const QString variable = variableRegExp.cap(2);
+				if (members.contains(variable))
+					continue;
+				foreach (const QString& field, it.value())
+					members.insert(variable, field);
+			}
+		}
+
+		{
+			QMutexLocker locker(&m_index->m_mutex);
+			if (m_generation != m_index->m_generation)
+				return;
+			m_index->m_trie = trie;
+			m_index->m_members = members;
+		}
+
+		emit m_index->indexChanged();
+	}
+
+private:
+	SymbolIndex* m_index;
+	QString m_text;
+	int m_generation;
+};
+
+
+SymbolIndex::SymbolIndex(QObject* parent) : QObject(parent), m_generation(0)
+{
+	// One parse at a time, the newest one is the only one that counts.
+	m_pool.setMaxThreadCount(1);
+
+	// Wait for the typing to pause.
+	m_updateTimer.setSingleShot(true);
+	m_updateTimer.setInterval(500);
+	connect(&m_updateTimer, SIGNAL(timeout()), this, SLOT(update()));
+}
+
+SymbolIndex::~SymbolIndex()
+{
+	m_pool.waitForDone();
+}
+
+void SymbolIndex::addDocument(QTextDocument* document)
+{
+	m_documents.append(document);
+	connect(document, SIGNAL(contentsChanged()), &m_updateTimer, SLOT(start()));
+	m_updateTimer.start();
+}
+
+void SymbolIndex::clear()
+{
+	m_documents.clear();
+	m_updateTimer.stop();
+
+	QMutexLocker locker(&m_mutex);
+	m_generation++;
+	m_trie.clear();
+	m_members.clear();
+}
+
+QList<CompletionTrie::Entry> SymbolIndex::complete(const QString& prefix, int maxCount) const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_trie.complete(prefix, maxCount);
+}
+
+QStringList SymbolIndex::members(const QString& variable) const
+{
+	QMutexLocker locker(&m_mutex);
+	return m_members.values(variable);
+}
+
+void SymbolIndex::update()
+{
+	QString text;
+	foreach (QTextDocument* document, m_documents)
+	{
+		if (document != NULL)
+			text += document->toPlainText() + "\n";
+	}
+
+	int generation;
+	{
+		QMutexLocker locker(&m_mutex);
+		generation = ++m_generation;
+	}
+	m_pool.start(new ParseTask(this, text, generation));
+}
+
+
+//
+Completer::Completer( const EffectFactory* factory, SymbolIndex* symbols, QWidget* parent, Qt::WindowFlags f )
 	: QFrame( parent )
-        ,CLASS_METOD(QListWidgetItem::UserType+1)
-        ,m_extation(extation)
+        ,m_symbols(symbols)
+        ,mEditor(NULL)
 {
         // frame
         setWindowFlags( f );
@@ -51,7 +283,7 @@ Completer::Completer( const QString& extation, QWidget* parent, Qt::WFlags f )
 
         setLayout(vboxLayout);
 
-        loadAtocompliteData();
+        loadAtocompliteData( factory );
 }
 
 
@@ -76,6 +308,9 @@ void Completer::itemClicked( QListWidgetItem* item )
 
 void Completer::showToolTip(QListWidgetItem * current, QListWidgetItem * /*previous */)
 {
+    if(!current)
+        return;
+
     QString s = current->toolTip();
     if(QToolTip::isVisible())
         QToolTip::hideText();
@@ -114,124 +349,101 @@ void Completer::invokeCompletion( QPlainTextEdit* editor )
     }
 }
 
-void Completer::loadAtocompliteData()
+void Completer::loadAtocompliteData( const EffectFactory* factory )
 {
-    QStringList listData = Highlighter::getKeyWords(m_extation);
-
-    if(listData.isEmpty())
+    if(!factory)
         return;
 
-    unsigned char nCount=0; //indicate if keyword, Build Function, ...
-
-    QStringList::const_iterator it;
-     for (it = listData.constBegin(); it != listData.constEnd();
-            ++it)
-     {
-         QString line = (*it), comment;
-
-         if(line == "---END BLOCK---")
-         {
-             ++nCount;
-             continue;
-         }
-
-         int i = line.indexOf("//");
-         if(i != -1)
-         {
-             comment = line.mid(i+2);
-             line.truncate(i);
-             line = line.simplified();
-         }
-
-         i = line.indexOf("{");
-         if(i != -1)
-         {
-             int j = line.indexOf("}");
-             QString prop = line.mid(i+1,j-i-1);
-             line.truncate(i);
-             QStringList l = prop.split(";");
-             if(!l.isEmpty())
-             {
-                 for(i=0;i<l.size();i++)
-                 {
-                     QString s = l.at(i);
-                     s = s.simplified();
-                     if(!s.isEmpty())
-                         m_propertiesStruct.insert(line,s);
-                 }
-             }
-         }
-         QListWidgetItem *item = new QListWidgetItem(lwItems);
-         item->setText(line);
-         item->setToolTip(comment);
-
-         switch(nCount)
-         {
-             case 0: item->setIcon(QIcon(":/images/keyword.png")); break;
-             case 1: item->setIcon(QIcon(":/images/DataType.png")); break;
-             case 2: item->setIcon(QIcon(":/images/BuiltinVar.png")); break;
-             case 3: item->setIcon(QIcon(":/images/BuiltinFunction.png")); break;
-             default: item->setIcon(QIcon(":/images/DataType.png"));
-         }
-     }
-    lwItems->sortItems();
+    // The keywords of the highlighting rules, built once per effect.
+    const QHash<QString, Highlighter::FormatType> keywords = factory->syntax()->keywords();
+
+    QHash<QString, Highlighter::FormatType>::const_iterator it;
+    for (it = keywords.constBegin(); it != keywords.constEnd(); ++it)
+    {
+        switch(it.value())
+        {
+            case Highlighter::Keyword: m_keywords.insert(it.key(), CompletionTrie::Keyword); break;
+            case Highlighter::DataType: m_keywords.insert(it.key(), CompletionTrie::DataType); break;
+            case Highlighter::BuiltinVar: m_keywords.insert(it.key(), CompletionTrie::BuiltinVar); break;
+            case Highlighter::BuiltinFunction: m_keywords.insert(it.key(), CompletionTrie::BuiltinFunction); break;
+            default: break;
+        }
+    }
+}
+
+void Completer::addItem( const CompletionTrie::Entry& entry )
+{
+    QListWidgetItem *item = new QListWidgetItem(entry.word, lwItems);
+    item->setToolTip(entry.toolTip);
+
+    switch(entry.kind)
+    {
+        case CompletionTrie::Keyword: item->setIcon(QIcon(":/images/keyword.png")); break;
+        case CompletionTrie::BuiltinVar: item->setIcon(QIcon(":/images/BuiltinVar.png")); break;
+        case CompletionTrie::BuiltinFunction:
+        case CompletionTrie::Function: item->setIcon(QIcon(":/images/BuiltinFunction.png")); break;
+        default: item->setIcon(QIcon(":/images/DataType.png"));
+    }
 }
 
 
 //
 bool Completer::prepareCompletion()
 {
-    reset();
-    QTextCursor cursor( mEditor->textCursor() );
+    lwItems->clear();
 
     QString s = leftTextCursor();
 
-    if(s.isEmpty())
-        return true;
     if(s.endsWith('.'))
     {
-        for(int i=0; i < lwItems->count(); i++)
-             lwItems->item(i)->setHidden(true);
         s.remove(".");
 
         int i = s.indexOf("[");
         if(i != -1)
             s.truncate(i);
 
-        QList<QString> list = m_propertiesStruct.values(s);
+        QStringList list;
+        if(m_symbols)
+            list = m_symbols->members(s);
 
         if(list.isEmpty())
             return false;
 
-        QListWidgetItem *first = NULL;
-
-        for(int i=0;i<list.size();i++)
+        list.sort();
+        foreach(const QString& member, list)
         {
-            QListWidgetItem *item = new QListWidgetItem(lwItems, CLASS_METOD);
-            if(!i)
-                first = item;
-            item->setText(list.at(i));
+            QListWidgetItem *item = new QListWidgetItem(member, lwItems);
             item->setIcon(QIcon(":/images/DataType.png"));
         }
 
-        lwItems->setCurrentItem(first);
-
+        lwItems->setCurrentRow(0);
         return true;
     }
 
-    QList<QListWidgetItem*> list = lwItems->findItems(s,Qt::MatchStartsWith);
-    if(list.isEmpty())
+    // Both lists are sorted, merge them up to the item limit.
+    QList<CompletionTrie::Entry> keywords = m_keywords.complete(s, s_maxItems);
+    QList<CompletionTrie::Entry> symbols;
+    if(m_symbols)
+        symbols = m_symbols->complete(s, s_maxItems);
+
+    if(keywords.isEmpty() && symbols.isEmpty())
         return false;
 
-    for(int i=0; i < lwItems->count(); i++)
+    int k = 0, u = 0;
+    while(lwItems->count() < s_maxItems && (k < keywords.count() || u < symbols.count()))
     {
-        QListWidgetItem *item = lwItems->item(i);
-        if(list.indexOf(item) == -1)
-            item->setHidden(true);
+        if(u == symbols.count() || (k < keywords.count() && keywords.at(k).word < symbols.at(u).word))
+            addItem(keywords.at(k++));
+        else
+        {
+            // User symbols hide the keywords with the same name.
+            if(k < keywords.count() && keywords.at(k).word == symbols.at(u).word)
+                k++;
+            addItem(symbols.at(u++));
+        }
     }
 
-    lwItems->setCurrentItem(list.first());
-    lwItems->update();
+    lwItems->setCurrentRow(0);
 
     return true;
 }
@@ -241,42 +453,19 @@ QString Completer::leftTextCursor() const
     if(!mEditor)
         return QString("");
 
+    // Scan back from the cursor within its line, so the start of the document
+    // ends the word too. Member access and array indices are part of it.
     QTextCursor cursor( mEditor->textCursor() );
+    const QString line = cursor.block().text().left( cursor.positionInBlock() );
 
-    QString s="", word="";
-    QRegExp rx("(&|\\*|\\(|\\)|\\+|=|\\-|/|\\?|;|:)(;)?");
-
-    do{
-        cursor.movePosition(QTextCursor::Left);
-        cursor.movePosition(QTextCursor::Right, QTextCursor::KeepAnchor);
-        s = cursor.selectedText();
-        cursor.movePosition(QTextCursor::Left);
-
-        s = s.simplified();
-        if(rx.exactMatch(s) || (s == ";"))
-            s = "";
-        if(!s.isEmpty())
-            word.push_front(s);
-    }while(s !="");
-
-    return word;
-}
-
-void Completer::reset()
-{
-    QListWidgetItem *item=NULL;
-
-    for(int i=0; i<lwItems->count(); i++)
+    int start = line.length();
+    while( start > 0 )
     {
-        item = lwItems->item(i);
-
-        if(item->type() == CLASS_METOD)
-        {
-            delete item;
-            continue;
-        }
-
-        item->setHidden(false);
+        const QChar c = line.at( start - 1 );
+        if( !c.isLetterOrNumber() && c != '_' && c != '.' && c != '[' && c != ']' )
+            break;
+        start--;
     }
-    lwItems->setCurrentRow(0);
+
+    return line.mid( start );
 }
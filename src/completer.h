@@ -14,15 +14,102 @@
 #include <QFrame>
 #include <QListWidget>
 #include <QMultiHash>
+#include <QMap>
+#include <QVector>
+#include <QPointer>
+#include <QMutex>
+#include <QTimer>
+#include <QThreadPool>
 //
 class QPlainTextEdit;
+class QTextDocument;
+class EffectFactory;
 //
+
+/// Sorted prefix tree of the completion words.
+class CompletionTrie
+{
+public:
+	enum Kind {
+		Keyword = 0,
+		DataType,
+		BuiltinVar,
+		BuiltinFunction,
+		Function,
+		Struct,
+		Uniform
+	};
+
+	struct Entry
+	{
+		QString word;
+		QString toolTip;
+		Kind kind;
+	};
+
+	CompletionTrie();
+
+	void clear();
+	void insert(const QString& word, Kind kind, const QString& toolTip = QString());
+
+	// At most maxCount entries that start with prefix, in alphabetical order.
+	QList<Entry> complete(const QString& prefix, int maxCount) const;
+
+private:
+	struct Node
+	{
+		Node() : entry(-1) {}
+		QMap<QChar, int> children;	// Sorted, so the walk is in order.
+		int entry;
+	};
+
+	QVector<Node> m_nodes;
+	QVector<Entry> m_entries;
+};
+
+
+/// Functions, structs and uniforms declared in the effect inputs. The
+/// documents are parsed again on a worker thread a moment after they change.
+class SymbolIndex : public QObject
+{
+	Q_OBJECT
+public:
+	SymbolIndex(QObject* parent = 0);
+	~SymbolIndex();
+
+	void addDocument(QTextDocument* document);
+	void clear();
+
+	QList<CompletionTrie::Entry> complete(const QString& prefix, int maxCount) const;
+	QStringList members(const QString& variable) const;
+
+signals:
+	void indexChanged();
+
+private slots:
+	void update();
+
+private:
+	class ParseTask;
+	friend class ParseTask;
+
+	QList< QPointer<QTextDocument> > m_documents;
+	QTimer m_updateTimer;
+	QThreadPool m_pool;
+
+	mutable QMutex m_mutex;
+	int m_generation;	// Results of older parses are dropped.
+	CompletionTrie m_trie;
+	QMultiHash<QString, QString> m_members;	// Of the struct variables.
+};
+
+
 class Completer : public QFrame
 {
 	Q_OBJECT
 	//
 public:
-        Completer( const QString& extation, QWidget* = 0, Qt::WFlags = Qt::Popup );
+        Completer( const EffectFactory* factory, SymbolIndex* symbols, QWidget* = 0, Qt::WindowFlags = Qt::Popup );
         bool prepareCompletion();
         //
         QListWidget* lwItems;
@@ -34,13 +121,12 @@ public slots:
         void showToolTip(QListWidgetItem * current, QListWidgetItem * previous );
 	//
 private:
-        void loadAtocompliteData();
+        void loadAtocompliteData( const EffectFactory* factory );
+        void addItem( const CompletionTrie::Entry& entry );
         QString leftTextCursor() const; //return left text under cursor
-        void reset();
-        const int CLASS_METOD;
 	//
-        QString m_extation;
-        QMultiHash<QString, QString> m_propertiesStruct;
+        CompletionTrie m_keywords;
+        QPointer<SymbolIndex> m_symbols;
 	//
 protected:
         QPlainTextEdit* mEditor;
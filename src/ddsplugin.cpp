@@ -0,0 +1,579 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include "imageplugin.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDebug>
+
+#include <string.h>
+
+
+// Image plugins for the DDS and KTX containers. Their payload is already in
+// a GL format, usually block compressed and with all the mipmaps, so it's
+// uploaded as it is instead of going through QImage.
+
+namespace
+{
+	
+	// Larger images are corrupt, or wouldn't fit in a texture anyway.
+	static const int s_maxDimension = 16384;
+	
+	static quint32 readUInt32(const char * data)
+	{
+		quint32 value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	
+	static quint64 readUInt64(const char * data)
+	{
+		quint64 value;
+		memcpy(&value, data, sizeof(value));
+		return value;
+	}
+	
+	static quint32 swapUInt32(quint32 value)
+	{
+		return ((value & 0x000000ff) << 24) | ((value & 0x0000ff00) << 8) |
+			((value & 0x00ff0000) >> 8) | ((value & 0xff000000) >> 24);
+	}
+	
+	static quint32 fourCC(char a, char b, char c, char d)
+	{
+		return quint32(uchar(a)) | (quint32(uchar(b)) << 8) | (quint32(uchar(c)) << 16) | (quint32(uchar(d)) << 24);
+	}
+	
+	static bool hasSuffix(const QString & fileName, const char * suffix)
+	{
+		return QFileInfo(fileName).suffix().compare(suffix, Qt::CaseInsensitive) == 0;
+	}
+	
+	// Bytes per 4x4 block, or 0 if the format is not block compressed.
+	static int blockSize(GLenum internalFormat)
+	{
+		switch (internalFormat) {
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RED_RGTC1:
+			case GL_COMPRESSED_SIGNED_RED_RGTC1:
+				return 8;
+			case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+			case GL_COMPRESSED_RG_RGTC2:
+			case GL_COMPRESSED_SIGNED_RG_RGTC2:
+			case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+			case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB:
+			case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB:
+			case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB:
+				return 16;
+			default:
+				return 0;
+		}
+	}
+	
+	static bool isSupported(GLenum internalFormat)
+	{
+		switch (internalFormat) {
+			case GL_COMPRESSED_RGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_RGBA_S3TC_DXT5_EXT:
+				return GLEW_EXT_texture_compression_s3tc;
+			case GL_COMPRESSED_SRGB_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT:
+			case GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT:
+				return GLEW_EXT_texture_compression_s3tc && GLEW_EXT_texture_sRGB;
+			case GL_COMPRESSED_RED_RGTC1:
+			case GL_COMPRESSED_SIGNED_RED_RGTC1:
+			case GL_COMPRESSED_RG_RGTC2:
+			case GL_COMPRESSED_SIGNED_RG_RGTC2:
+				return GLEW_ARB_texture_compression_rgtc || GLEW_VERSION_3_0;
+			case GL_COMPRESSED_RGBA_BPTC_UNORM_ARB:
+			case GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB:
+			case GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB:
+			case GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB:
+				return GLEW_ARB_texture_compression_bptc || GLEW_VERSION_4_2;
+			case GL_SRGB8_ALPHA8:
+				return GLEW_EXT_texture_sRGB || GLEW_VERSION_2_1;
+			default:
+				return true;
+		}
+	}
+	
+	/// Set the format of a texture with 32 bit pixels.
+	static void setPixelFormat(TextureImage * texture, GLenum internalFormat, GLenum format)
+	{
+		texture->internalFormat = internalFormat;
+		texture->format = format;
+		texture->type = GL_UNSIGNED_BYTE;
+		texture->compressed = false;
+	}
+	
+	static void setBlockFormat(TextureImage * texture, GLenum internalFormat)
+	{
+		texture->internalFormat = internalFormat;
+		texture->format = 0;
+		texture->type = 0;
+		texture->compressed = true;
+	}
+	
+	// Bytes per pixel of the uncompressed formats that are uploaded as they
+	// are, or 0 if the format and type are not supported.
+	static int bytesPerPixel(GLenum format, GLenum type)
+	{
+		int components;
+		switch (format) {
+			case GL_RED:
+			case GL_LUMINANCE:
+				components = 1;
+				break;
+			case GL_RG:
+			case GL_LUMINANCE_ALPHA:
+				components = 2;
+				break;
+			case GL_RGB:
+			case GL_BGR:
+				components = 3;
+				break;
+			case GL_RGBA:
+			case GL_BGRA:
+				components = 4;
+				break;
+			default:
+				return 0;
+		}
+		
+		switch (type) {
+			case GL_UNSIGNED_BYTE:
+				return components;
+			case GL_UNSIGNED_SHORT:
+			case GL_HALF_FLOAT:
+				return components * 2;
+			case GL_FLOAT:
+				return components * 4;
+			default:
+				return 0;
+		}
+	}
+	
+	static bool isValidSize(int width, int height)
+	{
+		return width > 0 && height > 0 && width <= s_maxDimension && height <= s_maxDimension;
+	}
+	
+	/// Number of levels of a full mipmap chain, floor(log2(max(width, height))) + 1.
+	static int maxLevelCount(int width, int height)
+	{
+		int count = 1;
+		for (int size = qMax(width, height); size > 1; size /= 2) {
+			count++;
+		}
+		return count;
+	}
+	
+	/// Size in bytes of a level of the texture, with the rows aligned to 4
+	/// bytes as they are uploaded.
+	static qint64 levelSize(const TextureImage & texture, int width, int height)
+	{
+		if (texture.compressed) {
+			return qint64(qMax(1, (width + 3) / 4)) * qMax(1, (height + 3) / 4) * blockSize(texture.internalFormat);
+		}
+		const qint64 rowPitch = (qint64(width) * bytesPerPixel(texture.format, texture.type) + 3) & ~3;
+		return rowPitch * height;
+	}
+	
+	/// Add the levels of a 2D texture stored one after the other.
+	static bool addLevels(TextureImage * texture, int width, int height, int levelCount, int offset)
+	{
+		for (int i = 0; i < levelCount; i++) {
+			const qint64 size = levelSize(*texture, width, height);
+			if (size <= 0 || qint64(offset) + size > texture->data.size()) {
+				return false;
+			}
+			
+			TextureLevel level;
+			level.width = width;
+			level.height = height;
+			level.offset = offset;
+			level.size = int(size);
+			texture->levels.append(level);
+			
+			offset += level.size;
+			width = qMax(1, width / 2);
+			height = qMax(1, height / 2);
+		}
+		return true;
+	}
+	
+	static bool checkFormat(const QString & fileName, const TextureImage & texture)
+	{
+		if (texture.compressed && blockSize(texture.internalFormat) == 0) {
+			qDebug() << "Unsupported compressed format" << hex << texture.internalFormat << "in" << fileName;
+			return false;
+		}
+		if (!texture.compressed && bytesPerPixel(texture.format, texture.type) == 0) {
+			qDebug() << "Unsupported pixel format" << hex << texture.format << texture.type << "in" << fileName;
+			return false;
+		}
+		if (!isSupported(texture.internalFormat)) {
+			qDebug() << "Texture format" << hex << texture.internalFormat << "not supported by the driver:" << fileName;
+			return false;
+		}
+		return true;
+	}
+	
+} // namespace
+
+
+class DdsImagePlugin : public ImagePlugin
+{
+public:
+	
+	virtual QList<QByteArray> supportedFormats() const
+	{
+		return QList<QByteArray>() << "dds";
+	}
+	
+	virtual bool canLoad(const QString & fileName) const
+	{
+		return hasSuffix(fileName, "dds");
+	}
+	
+	virtual int priority() const
+	{
+		return 1;
+	}
+	
+	virtual bool load(const QString & fileName, TextureImage * texture) const
+	{
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+		texture->data = file.readAll();
+		
+		const char * data = texture->data.constData();
+		if (texture->data.size() < 128 || memcmp(data, "DDS ", 4) != 0) {
+			return false;
+		}
+		
+		const char * header = data + 4;
+		const quint32 flags = readUInt32(header + 4);
+		const int height = readUInt32(header + 8);
+		const int width = readUInt32(header + 12);
+		const int mipMapCount = readUInt32(header + 24);
+		const quint32 pixelFlags = readUInt32(header + 76);
+		const quint32 code = readUInt32(header + 80);
+		const int bitCount = readUInt32(header + 84);
+		const quint32 redMask = readUInt32(header + 88);
+		const quint32 alphaMask = readUInt32(header + 100);
+		const quint32 caps2 = readUInt32(header + 108);
+		
+		// Only 2D textures, no cube maps or volumes.
+		if ((caps2 & (0x200 | 0x200000)) != 0 || !isValidSize(width, height)) {
+			return false;
+		}
+		
+		int offset = 128;
+		
+		if (pixelFlags & 0x4) {
+			if (code == fourCC('D', 'X', '1', '0')) {
+				if (texture->data.size() < 148 || !setDxgiFormat(texture, readUInt32(data + 128))) {
+					return false;
+				}
+				// Texture arrays and cube maps.
+				if (readUInt32(data + 128 + 4) != 3 || (readUInt32(data + 128 + 8) & 0x4) != 0 || readUInt32(data + 128 + 12) > 1) {
+					return false;
+				}
+				offset += 20;
+			}
+			else if (code == fourCC('D', 'X', 'T', '1')) setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT);
+			else if (code == fourCC('D', 'X', 'T', '2') || code == fourCC('D', 'X', 'T', '3')) setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT);
+			else if (code == fourCC('D', 'X', 'T', '4') || code == fourCC('D', 'X', 'T', '5')) setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT);
+			else if (code == fourCC('A', 'T', 'I', '1') || code == fourCC('B', 'C', '4', 'U')) setBlockFormat(texture, GL_COMPRESSED_RED_RGTC1);
+			else if (code == fourCC('B', 'C', '4', 'S')) setBlockFormat(texture, GL_COMPRESSED_SIGNED_RED_RGTC1);
+			else if (code == fourCC('A', 'T', 'I', '2') || code == fourCC('B', 'C', '5', 'U')) setBlockFormat(texture, GL_COMPRESSED_RG_RGTC2);
+			else if (code == fourCC('B', 'C', '5', 'S')) setBlockFormat(texture, GL_COMPRESSED_SIGNED_RG_RGTC2);
+			else {
+				qDebug() << "Unsupported DDS format:" << QByteArray(header + 80, 4);
+				return false;
+			}
+		}
+		else if ((pixelFlags & 0x40) && bitCount == 32) {
+			const GLenum internalFormat = alphaMask != 0 ? GL_RGBA8 : GL_RGB8;
+			if (redMask == 0x00ff0000) setPixelFormat(texture, internalFormat, GL_BGRA);
+			else if (redMask == 0x000000ff) setPixelFormat(texture, internalFormat, GL_RGBA);
+			else return false;
+		}
+		else {
+			qDebug() << "Unsupported DDS pixel format in" << fileName;
+			return false;
+		}
+		
+		if (!checkFormat(fileName, *texture)) {
+			return false;
+		}
+		
+		// Some writers store more levels than the chain has, don't trust the count.
+		const int levelCount = (flags & 0x20000) ? qBound(1, mipMapCount, maxLevelCount(width, height)) : 1;
+		return addLevels(texture, width, height, levelCount, offset);
+	}
+	
+private:
+	
+	static bool setDxgiFormat(TextureImage * texture, quint32 format)
+	{
+		switch (format) {
+			case 28: setPixelFormat(texture, GL_RGBA8, GL_RGBA); return true;	// R8G8B8A8_UNORM
+			case 29: setPixelFormat(texture, GL_SRGB8_ALPHA8, GL_RGBA); return true;
+			case 87: setPixelFormat(texture, GL_RGBA8, GL_BGRA); return true;	// B8G8R8A8_UNORM
+			case 91: setPixelFormat(texture, GL_SRGB8_ALPHA8, GL_BGRA); return true;
+			case 71: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT); return true;	// BC1
+			case 72: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT); return true;
+			case 74: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT); return true;	// BC2
+			case 75: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT); return true;
+			case 77: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT); return true;	// BC3
+			case 78: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT); return true;
+			case 80: setBlockFormat(texture, GL_COMPRESSED_RED_RGTC1); return true;	// BC4
+			case 81: setBlockFormat(texture, GL_COMPRESSED_SIGNED_RED_RGTC1); return true;
+			case 83: setBlockFormat(texture, GL_COMPRESSED_RG_RGTC2); return true;	// BC5
+			case 84: setBlockFormat(texture, GL_COMPRESSED_SIGNED_RG_RGTC2); return true;
+			case 95: setBlockFormat(texture, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB); return true;	// BC6H
+			case 96: setBlockFormat(texture, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB); return true;
+			case 98: setBlockFormat(texture, GL_COMPRESSED_RGBA_BPTC_UNORM_ARB); return true;	// BC7
+			case 99: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB); return true;
+			default:
+				qDebug() << "Unsupported DXGI format:" << format;
+				return false;
+		}
+	}
+};
+
+REGISTER_IMAGE_PLUGIN(DdsImagePlugin);
+
+
+class KtxImagePlugin : public ImagePlugin
+{
+public:
+	
+	virtual QList<QByteArray> supportedFormats() const
+	{
+		return QList<QByteArray>() << "ktx" << "ktx2";
+	}
+	
+	virtual bool canLoad(const QString & fileName) const
+	{
+		return hasSuffix(fileName, "ktx") || hasSuffix(fileName, "ktx2");
+	}
+	
+	virtual int priority() const
+	{
+		return 1;
+	}
+	
+	virtual bool load(const QString & fileName, TextureImage * texture) const
+	{
+		static const char ktx1[12] = { '\xAB', 'K', 'T', 'X', ' ', '1', '1', '\xBB', '\r', '\n', '\x1A', '\n' };
+		static const char ktx2[12] = { '\xAB', 'K', 'T', 'X', ' ', '2', '0', '\xBB', '\r', '\n', '\x1A', '\n' };
+		
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+		texture->data = file.readAll();
+		
+		if (texture->data.size() < 80) {
+			return false;
+		}
+		if (memcmp(texture->data.constData(), ktx1, 12) == 0) {
+			return loadKtx1(fileName, texture);
+		}
+		if (memcmp(texture->data.constData(), ktx2, 12) == 0) {
+			return loadKtx2(fileName, texture);
+		}
+		return false;
+	}
+	
+private:
+	
+	static bool loadKtx1(const QString & fileName, TextureImage * texture)
+	{
+		const char * data = texture->data.constData();
+		const int size = texture->data.size();
+		
+		const bool swap = readUInt32(data + 12) == 0x01020304;
+		
+		quint32 header[12];
+		for (int i = 0; i < 12; i++) {
+			header[i] = readUInt32(data + 16 + 4 * i);
+			if (swap) header[i] = swapUInt32(header[i]);
+		}
+		
+		const GLenum type = header[0];
+		const int typeSize = header[1];
+		const int width = header[5];
+		const int height = header[6];
+		
+		// Only 2D textures, no arrays, cube maps or volumes. Swapping the data is not worth it.
+		if (!isValidSize(width, height) || header[7] != 0 || header[8] != 0 || header[9] != 1 || (swap && typeSize > 1)) {
+			return false;
+		}
+		
+		if (type == 0) {
+			setBlockFormat(texture, header[3]);
+		}
+		else {
+			texture->internalFormat = header[3];
+			texture->format = header[2];
+			texture->type = type;
+			texture->compressed = false;
+		}
+		
+		if (!checkFormat(fileName, *texture)) {
+			return false;
+		}
+		
+		const int levelCount = qMax(1, int(header[10]));
+		if (levelCount > maxLevelCount(width, height)) {
+			return false;
+		}
+		qint64 offset = 64 + qint64(header[11]);
+		
+		for (int i = 0; i < levelCount; i++) {
+			if (offset + 4 > size) {
+				return false;
+			}
+			quint32 imageSize = readUInt32(data + offset);
+			if (swap) imageSize = swapUInt32(imageSize);
+			offset += 4;
+			
+			if (offset + qint64(imageSize) > size) {
+				return false;
+			}
+			
+			TextureLevel level;
+			level.width = qMax(1, width >> i);
+			level.height = qMax(1, height >> i);
+			
+			// The driver reads the whole level from the data.
+			if (qint64(imageSize) < levelSize(*texture, level.width, level.height)) {
+				return false;
+			}
+			
+			level.offset = int(offset);
+			level.size = int(imageSize);
+			texture->levels.append(level);
+			
+			// Levels are padded to 4 bytes.
+			offset += (imageSize + 3) & ~3;
+		}
+		
+		return true;
+	}
+	
+	static bool loadKtx2(const QString & fileName, TextureImage * texture)
+	{
+		const char * data = texture->data.constData();
+		const int size = texture->data.size();
+		
+		const quint32 vkFormat = readUInt32(data + 12);
+		const int width = readUInt32(data + 20);
+		const int height = readUInt32(data + 24);
+		const quint32 depth = readUInt32(data + 28);
+		const quint32 layerCount = readUInt32(data + 32);
+		const quint32 faceCount = readUInt32(data + 36);
+		const int levelCount = qMax(1, int(readUInt32(data + 40)));
+		const quint32 supercompression = readUInt32(data + 44);
+		
+		if (!isValidSize(width, height) || depth != 0 || layerCount != 0 || faceCount != 1) {
+			return false;
+		}
+		if (supercompression != 0) {
+			qDebug() << "Supercompressed KTX2 files are not supported:" << fileName;
+			return false;
+		}
+		if (!setVulkanFormat(texture, vkFormat) || !checkFormat(fileName, *texture)) {
+			return false;
+		}
+		if (levelCount > maxLevelCount(width, height) || 80 + 24 * levelCount > size) {
+			return false;
+		}
+		
+		for (int i = 0; i < levelCount; i++) {
+			const quint64 offset = readUInt64(data + 80 + 24 * i);
+			const quint64 length = readUInt64(data + 80 + 24 * i + 8);
+			if (offset > quint64(size) || length > quint64(size) - offset) {
+				return false;
+			}
+			
+			TextureLevel level;
+			level.width = qMax(1, width >> i);
+			level.height = qMax(1, height >> i);
+			
+			if (qint64(length) < levelSize(*texture, level.width, level.height)) {
+				return false;
+			}
+			
+			level.offset = int(offset);
+			level.size = int(length);
+			texture->levels.append(level);
+		}
+		
+		return true;
+	}
+	
+	static bool setVulkanFormat(TextureImage * texture, quint32 format)
+	{
+		switch (format) {
+			case 37: setPixelFormat(texture, GL_RGBA8, GL_RGBA); return true;	// R8G8B8A8_UNORM
+			case 43: setPixelFormat(texture, GL_SRGB8_ALPHA8, GL_RGBA); return true;
+			case 44: setPixelFormat(texture, GL_RGBA8, GL_BGRA); return true;	// B8G8R8A8_UNORM
+			case 50: setPixelFormat(texture, GL_SRGB8_ALPHA8, GL_BGRA); return true;
+			case 131: setBlockFormat(texture, GL_COMPRESSED_RGB_S3TC_DXT1_EXT); return true;	// BC1
+			case 132: setBlockFormat(texture, GL_COMPRESSED_SRGB_S3TC_DXT1_EXT); return true;
+			case 133: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT1_EXT); return true;
+			case 134: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT1_EXT); return true;
+			case 135: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT3_EXT); return true;	// BC2
+			case 136: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT3_EXT); return true;
+			case 137: setBlockFormat(texture, GL_COMPRESSED_RGBA_S3TC_DXT5_EXT); return true;	// BC3
+			case 138: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_S3TC_DXT5_EXT); return true;
+			case 139: setBlockFormat(texture, GL_COMPRESSED_RED_RGTC1); return true;	// BC4
+			case 140: setBlockFormat(texture, GL_COMPRESSED_SIGNED_RED_RGTC1); return true;
+			case 141: setBlockFormat(texture, GL_COMPRESSED_RG_RGTC2); return true;	// BC5
+			case 142: setBlockFormat(texture, GL_COMPRESSED_SIGNED_RG_RGTC2); return true;
+			case 143: setBlockFormat(texture, GL_COMPRESSED_RGB_BPTC_UNSIGNED_FLOAT_ARB); return true;	// BC6H
+			case 144: setBlockFormat(texture, GL_COMPRESSED_RGB_BPTC_SIGNED_FLOAT_ARB); return true;
+			case 145: setBlockFormat(texture, GL_COMPRESSED_RGBA_BPTC_UNORM_ARB); return true;	// BC7
+			case 146: setBlockFormat(texture, GL_COMPRESSED_SRGB_ALPHA_BPTC_UNORM_ARB); return true;
+			default:
+				qDebug() << "Unsupported Vulkan format:" << format;
+				return false;
+		}
+	}
+};
+
+REGISTER_IMAGE_PLUGIN(KtxImagePlugin);
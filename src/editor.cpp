@@ -23,26 +23,73 @@
 #include "gotodialog.h"
 #include "highlighter.h"
 #include "effect.h"
+#include "completer.h"
 
 #include <QDebug>
 #include <QTabBar>
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QTextCursor>
 #include <QTextLayout>
 #include <QTextBlock>
 //#include <QTextDocument>
 #include <QMessageBox>
 #include <QPainter>
+#include <QScrollBar>
 
 
-SourceEdit::SourceEdit(QWidget * parent): QTextEdit(parent), m_line(0), m_lineRect(lineRect())
+namespace {
+
+    /// Gutter on the left of a SourceEdit, painted by the editor.
+    class LineNumberArea : public QWidget
+    {
+    public:
+        LineNumberArea(SourceEdit * edit) : QWidget(edit), m_edit(edit) {}
+
+        QSize sizeHint() const
+        {
+            return QSize(m_edit->lineNumberAreaWidth(), 0);
+        }
+
+    protected:
+        void paintEvent(QPaintEvent * event)
+        {
+            m_edit->paintLineNumbers(event);
+        }
+
+    private:
+        SourceEdit * m_edit;
+    };
+
+} // namespace
+
+
+SourceEdit::SourceEdit(QWidget * parent): QPlainTextEdit(parent), m_line(0)
 {
+    m_lineNumberArea = new LineNumberArea(this);
+
     connect(this, SIGNAL(cursorPositionChanged()), this, SLOT(cursorChanged()));
+    connect(this, SIGNAL(textChanged()), this, SLOT(updateVisibleRange()));
+    connect(verticalScrollBar(), SIGNAL(valueChanged(int)), this, SLOT(updateVisibleRange()));
+    connect(this, SIGNAL(blockCountChanged(int)), this, SLOT(updateLineNumberAreaWidth()));
+    connect(this, SIGNAL(updateRequest(const QRect &, int)), this, SLOT(updateLineNumberArea(const QRect &, int)));
+
+    updateLineNumberAreaWidth();
+}
+
+void SourceEdit::setCompleter(Completer * completer)
+{
+    m_completer = completer;
 }
 
 void SourceEdit::keyPressEvent(QKeyEvent * event)
 {
-    QTextEdit::keyPressEvent(event);
+    if (m_completer != NULL && event->key() == Qt::Key_Space && (event->modifiers() & Qt::ControlModifier))
+    {
+        m_completer->invokeCompletion(this);
+        return;
+    }
+
+    QPlainTextEdit::keyPressEvent(event);
     if (event->key() == Qt::Key_Return || event->key() == Qt::Key_Enter)
     {
         QTextCursor cursor = this->textCursor();
@@ -82,16 +129,30 @@ void SourceEdit::keyPressEvent(QKeyEvent * event)
 void SourceEdit::paintEvent(QPaintEvent * event)
 {
     QPainter p(viewport());
-    QRect rect = lineRect().intersected(event->region().boundingRect());
+    QRect rect = lineRect(textCursor().block()).intersected(event->rect());
     p.fillRect(rect, QBrush(QColor(248, 248, 248)));
     p.end();
     
-    QTextEdit::paintEvent(event);
+    QPlainTextEdit::paintEvent(event);
+}
+
+void SourceEdit::resizeEvent(QResizeEvent * event)
+{
+    QPlainTextEdit::resizeEvent(event);
+
+    const QRect rect = contentsRect();
+    m_lineNumberArea->setGeometry(QRect(rect.left(), rect.top(), lineNumberAreaWidth(), rect.height()));
+
+    updateVisibleRange();
 }
 
-QRect SourceEdit::lineRect()
+/// Viewport rectangle of the given line, empty if it's not laid out.
+QRect SourceEdit::lineRect(const QTextBlock & block) const
 {
-    QRect rect = cursorRect();
+    if (!block.isValid())
+        return QRect();
+
+    QRect rect = blockBoundingGeometry(block).translated(contentOffset()).toAlignedRect();
     rect.setLeft(0);
     rect.setWidth(viewport()->width());
     return rect;
@@ -99,23 +160,76 @@ QRect SourceEdit::lineRect()
 
 void SourceEdit::cursorChanged()
 {
-    if (m_line != textCursor().blockNumber())
+    const QTextBlock block = textCursor().block();
+    if (m_line != block.blockNumber())
     {
-        viewport()->update();
+        // Only the previous and the new current lines change.
+        viewport()->update(lineRect(document()->findBlockByNumber(m_line)));
+        viewport()->update(lineRect(block));
 
-        // @@ Optimize updated.
-        //viewport()->update(m_lineRect);
-        
-        m_lineRect = lineRect();
-        m_line = textCursor().blockNumber();
-        
-        //viewport()->update(m_lineRect);
+        m_line = block.blockNumber();
     }
 }
 
+void SourceEdit::updateVisibleRange()
+{
+    const int start = firstVisibleBlock().position();
+    const int end = cursorForPosition(QPoint(viewport()->width(), viewport()->height())).position();
+    emit visibleRangeChanged(start, end);
+}
+
+int SourceEdit::lineNumberAreaWidth() const
+{
+    int digits = 1;
+    for (int count = qMax(1, blockCount()); count >= 10; count /= 10)
+        digits++;
+
+    return 6 + fontMetrics().width(QLatin1Char('9')) * digits;
+}
+
+void SourceEdit::paintLineNumbers(QPaintEvent * event)
+{
+    QPainter p(m_lineNumberArea);
+    p.fillRect(event->rect(), QColor(240, 240, 240));
+    p.setPen(Qt::gray);
+
+    // Only the blocks in view are visited.
+    QTextBlock block = firstVisibleBlock();
+    int top = qRound(blockBoundingGeometry(block).translated(contentOffset()).top());
+    const int width = m_lineNumberArea->width() - 3;
+    const int height = fontMetrics().height();
+
+    while (block.isValid() && top <= event->rect().bottom())
+    {
+        const int bottom = top + qRound(blockBoundingRect(block).height());
+        if (block.isVisible() && bottom >= event->rect().top())
+            p.drawText(0, top, width, height, Qt::AlignRight, QString::number(block.blockNumber() + 1));
+
+        block = block.next();
+        top = bottom;
+    }
+}
+
+void SourceEdit::updateLineNumberAreaWidth()
+{
+    setViewportMargins(lineNumberAreaWidth(), 0, 0, 0);
+}
+
+void SourceEdit::updateLineNumberArea(const QRect & rect, int dy)
+{
+    if (dy != 0)
+        m_lineNumberArea->scroll(0, dy);
+    else
+        m_lineNumberArea->update(0, rect.y(), m_lineNumberArea->width(), rect.height());
+
+    if (rect.contains(viewport()->rect()))
+        updateLineNumberAreaWidth();
+}
 
 Editor::Editor(QWidget * parent) : QTabWidget(parent)
 {
+    m_symbols = new SymbolIndex(this);
+
 #ifdef Q_OS_MAC
     tabBar()->setDocumentMode(true);
 #endif
@@ -181,9 +295,9 @@ Editor::Editor(QWidget * parent) : QTabWidget(parent)
 //  m_font.setStyleHint(QFont::Courier, QFont::PreferQuality);
 }
 
-QTextEdit * Editor::currentTextEdit() const
+QPlainTextEdit * Editor::currentTextEdit() const
 {
-    return static_cast<QTextEdit *>(currentWidget());
+    return static_cast<QPlainTextEdit *>(currentWidget());
 }
 
 int Editor::line() const
@@ -203,7 +317,7 @@ bool Editor::isModified() const
     const int num = this->count();
     for (int i = 0; i < num; i++)
     {
-        QTextEdit * editor = qobject_cast<QTextEdit *>(this->widget(i));
+        QPlainTextEdit * editor = qobject_cast<QPlainTextEdit *>(this->widget(i));
         
         if (editor != NULL && editor->document()->isModified()) {
             modified = true;
@@ -218,7 +332,7 @@ void Editor::setModified(bool b)
     const int num = this->count();
     for (int i = 0; i < num; i++)
     {
-        QTextEdit * editor = qobject_cast<QTextEdit *>(this->widget(i));
+        QPlainTextEdit * editor = qobject_cast<QPlainTextEdit *>(this->widget(i));
         
         if (editor != NULL) {
             editor->document()->setModified(b);
@@ -403,9 +517,15 @@ void Editor::setEffect(Effect * effect)
         {
             this->removeTab(0);
         }
+
+        m_symbols->clear();
+        delete m_completer;
     }
     else
     {
+        delete m_completer;
+        m_completer = new Completer(effect->factory(), m_symbols, this);
+
         int inputNum = effect->getInputNum();
         for (int i = 0; i < inputNum; i++)
         {
@@ -414,25 +534,28 @@ void Editor::setEffect(Effect * effect)
     }
 }
 
-QTextEdit * Editor::addEditor(const QString & name, const Effect * effect, int i)
+QPlainTextEdit * Editor::addEditor(const QString & name, const Effect * effect, int i)
 {
     SourceEdit * textEdit = new SourceEdit(this);
     this->addTab(textEdit, name);
     textEdit->setFont(m_font);
-    textEdit->setLineWrapMode(QTextEdit::NoWrap);
+    textEdit->setLineWrapMode(QPlainTextEdit::NoWrap);
     textEdit->setTabStopWidth(28);
-    textEdit->setAcceptRichText(false);
 
     QTextDocument * textDocument = textEdit->document();
 
     Highlighter * hl = new Highlighter(textDocument);
-    hl->setRules(effect->factory()->highlightingRules());
-    hl->setMultiLineCommentStart(effect->factory()->multiLineCommentStart());
-    hl->setMultiLineCommentEnd(effect->factory()->multiLineCommentEnd());
+    hl->setSyntax(effect->factory()->syntax());
+
+    // Only the blocks in view are highlighted before the text shows up.
+    connect(textEdit, SIGNAL(visibleRangeChanged(int, int)), hl, SLOT(setVisibleRange(int, int)));
 
     textEdit->setPlainText(effect->getInput(i));
     textDocument->setModified(false);
 
+    textEdit->setCompleter(m_completer);
+    m_symbols->addDocument(textDocument);
+
     connect(textEdit, SIGNAL(textChanged()), this, SIGNAL(textChanged()));
     connect(textEdit, SIGNAL(cursorPositionChanged()), this, SIGNAL(cursorPositionChanged()));
     connect(textDocument, SIGNAL(modificationChanged(bool)), this, SIGNAL(modifiedChanged(bool)));
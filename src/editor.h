@@ -23,11 +23,14 @@
 
 #include <QTabWidget>
 #include <QTextDocument>
-#include <QTextEdit>
+#include <QPlainTextEdit>
+#include <QPointer>
 
-class QTextEdit;
+class QPlainTextEdit;
 
 class Effect;
+class Completer;
+class SymbolIndex;
 
 // @@ Instead of tabs it would be better to use a split screen. See editor2.* for an experiment. I'm not entirely convinced.
 // Ideally we should make the tabs look properly on OSX. See Qt Assistant for an example, it does the following:
@@ -45,8 +48,8 @@ public:
 	
 	void setEffect(Effect * effect);
 	
-	QTextEdit * addEditor(const QString & name, const Effect * effect, int i);
-	QTextEdit * currentTextEdit() const;
+	QPlainTextEdit * addEditor(const QString & name, const Effect * effect, int i);
+	QPlainTextEdit * currentTextEdit() const;
 
 	int line() const;
 	int column() const;
@@ -95,6 +98,9 @@ protected slots:
 private:
 	QFont m_font;
 	
+	SymbolIndex * m_symbols;	// Of all the inputs of the effect.
+	QPointer<Completer> m_completer;	// Moves to the editor it completes for.
+	
 	// @@ This should be pdata, so that QTextDocument is not included in the header
 	QString lastSearch;
 	QTextDocument::FindFlags lastSearchOptions;
@@ -102,25 +108,41 @@ private:
 };
 
 
-class SourceEdit : public QTextEdit
+/// Plain text editor for the effect sources, with line numbers. Only the
+/// blocks in view are laid out and painted, so large files stay responsive.
+class SourceEdit : public QPlainTextEdit
 {
 Q_OBJECT
 
 public:
 	SourceEdit(QWidget * parent = 0);
 
+	void setCompleter(Completer * completer);
+
+	int lineNumberAreaWidth() const;
+	void paintLineNumbers(QPaintEvent * event);
+
+signals:
+	// Document positions in view, for the highlighter.
+	void visibleRangeChanged(int start, int end);
+
 protected:
 	void keyPressEvent(QKeyEvent * event);
 	void paintEvent(QPaintEvent * event);
+	void resizeEvent(QResizeEvent * event);
 
-	QRect lineRect();
+	QRect lineRect(const QTextBlock & block) const;
 	
 protected slots:
 	void cursorChanged();
+	void updateVisibleRange();
+	void updateLineNumberAreaWidth();
+	void updateLineNumberArea(const QRect & rect, int dy);
 
 private:
 	int m_line;
-	QRect m_lineRect;
+	QWidget * m_lineNumberArea;
+	QPointer<Completer> m_completer;	// Shared by the inputs of the effect.
 };
 
 #endif // EDITOR_H
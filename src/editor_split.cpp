@@ -391,9 +391,7 @@ QTextEdit * Editor::addEditor(const QString & name, const Effect * effect, int i
     QTextDocument * textDocument = textEdit->document();
 
     Highlighter * hl = new Highlighter(textDocument);
-    hl->setRules(effect->factory()->highlightingRules());
-    hl->setMultiLineCommentStart(effect->factory()->multiLineCommentStart());
-    hl->setMultiLineCommentEnd(effect->factory()->multiLineCommentEnd());
+    hl->setSyntax(effect->factory()->syntax());
 
     textEdit->setPlainText(effect->getInput(i));
     textDocument->setModified(false);
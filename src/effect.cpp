@@ -17,9 +17,15 @@
     Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
 */
 
+// Include GLEW before anything else.
+#include <GL/glew.h>
+
 #include <QGLWidget>
+#include <QMutexLocker>
 
 #include "effect.h"
+#include "glutils.h"
+#include "outputparser.h"
 
 namespace {
 	static QList<const EffectFactory *> * s_factoryList = NULL;
@@ -37,6 +43,24 @@ const EffectFactory * EffectFactory::factoryForExtension(const QString & ext)
 	return NULL;
 }
 
+EffectFactory::EffectFactory() : m_syntax(NULL)
+{
+}
+
+EffectFactory::~EffectFactory()
+{
+	delete m_syntax;
+}
+
+/// Get the highlighting syntax, shared by all the editors of this kind of effect.
+const Highlighter::Syntax * EffectFactory::syntax() const
+{
+	if( m_syntax == NULL ) {
+		m_syntax = new Highlighter::Syntax(highlightingRules(), multiLineCommentStart(), multiLineCommentEnd());
+	}
+	return m_syntax;
+}
+
 /// Get the list of effect factories.
 const QList<const EffectFactory *> & EffectFactory::factoryList()
 {
@@ -75,6 +99,103 @@ void EffectFactory::removeFactory(const EffectFactory * factory)
 }
 
 
+/// Task that runs Effect::threadedBuild on a GL worker thread.
+class Effect::BuildTask : public GLTask
+{
+	Effect * m_effect;
+	
+public:
+	BuildTask(Effect * effect) : m_effect(effect)
+	{
+	}
+	
+	virtual void run()
+	{
+		bool succeed = m_effect->threadedBuild();
+		
+		// Make sure the new objects are complete before the GUI context uses them.
+		glFinish();
+		
+		emit m_effect->threadedBuildFinished(succeed);
+		
+		// The next build may already have started, only count this one out.
+		QMutexLocker locker(&m_effect->m_buildMutex);
+		m_effect->m_runningBuilds--;
+		m_effect->m_buildCondition.wakeAll();
+	}
+};
+
+
+Effect::Effect(const EffectFactory * factory, QGLWidget * widget) : 
+	m_factory(factory), 
+	m_widget(widget),
+	m_fixedTime(-1),
+	m_buildPending(false),
+	m_runningBuilds(0)
+{
+	qRegisterMetaType<MessagePanel::Type>("MessagePanel::Type");
+	
+	connect(this, SIGNAL(threadedBuildFinished(bool)), this, SLOT(onThreadedBuildFinished(bool)), Qt::QueuedConnection);
+}
+
+/// Build the effect, on a GL worker thread if @a threaded is true.
+void Effect::startBuild(bool threaded)
+{
+	Q_ASSERT(!m_buildPending);
+	
+	if (threaded) {
+		m_buildPending = true;
+		{
+			QMutexLocker locker(&m_buildMutex);
+			m_runningBuilds++;
+		}
+		GLThreadPool::instance(m_widget)->start(new BuildTask(this));
+	}
+	else {
+		this->makeCurrent();
+		bool succeed = threadedBuild();
+		finishBuild(succeed);
+		emit built(succeed);
+	}
+}
+
+/// Block until the worker thread is done with this effect. Call from the dtor of 
+/// derived classes, before destroying anything threadedBuild() uses.
+void Effect::waitForBuild()
+{
+	QMutexLocker locker(&m_buildMutex);
+	while (m_runningBuilds > 0) {
+		m_buildCondition.wait(&m_buildMutex);
+	}
+}
+
+/// The parser belongs to the effect, so the messages are parsed before they
+/// are queued to other threads, which may get them after the effect is gone.
+void Effect::emitBuildMessages(const QString & output, int input, OutputParser * parser)
+{
+	if (parser == NULL) {
+		if (!output.trimmed().isEmpty()) {
+			emit buildMessage(output.trimmed(), MessagePanel::Error, input, -1, -1);
+		}
+		return;
+	}
+	
+	QStringList lines = output.trimmed().split('\n', QString::SkipEmptyParts);
+	foreach (QString line, lines) {
+		parser->parseLine(line);
+		emit buildMessage(line, parser->type(), input, parser->line(), parser->column());
+	}
+}
+
+void Effect::onThreadedBuildFinished(bool succeed)
+{
+	this->makeCurrent();
+	finishBuild(succeed);
+	m_buildPending = false;
+	emit built(succeed);
+}
+
+
 void Effect::makeCurrent()
 {
 	m_widget->makeCurrent();
@@ -25,14 +25,17 @@
 #include <QVariant>
 #include <QList>
 #include <QIcon>
+#include <QTime>
+#include <QMutex>
+#include <QWaitCondition>
 #include "highlighter.h"
+#include "messagepanel.h"
 
 //#undef Q_ASSERT
 //#define Q_ASSERT(b) do { if(!(b)) __asm__ volatile ("trap"); } while(false)
 
 class QFile;
 class QByteArray;
-class MessagePanel;
 class EffectFactory;
 class Parameter;
 class OutputParser;
@@ -51,9 +54,7 @@ public:
 		EditorType_File
 	};
 	
-	Effect(const EffectFactory * factory, QGLWidget * widget) : m_factory(factory), m_widget(widget)
-	{
-	}
+	Effect(const EffectFactory * factory, QGLWidget * widget);
 	
 	const EffectFactory * factory() const
 	{
@@ -101,22 +102,62 @@ public:
 	virtual void endPass() = 0;
 	virtual void end() = 0;
 	
+	// Use a fixed time for animated effects, a negative value restores the real time.
+	void setFixedTime(int msecs) { m_fixedTime = msecs; }
+	
 signals:
 	void infoMessage(QString msg);
 	void errorMessage(QString msg);
-	void buildMessage(QString msg, int input, OutputParser * parser);
+	// A line of the compiler output, already parsed. May be emitted by the GL worker thread.
+	void buildMessage(QString msg, MessagePanel::Type type, int input, int line, int column);
 	
 	void built(bool succeed);
 	
+	// Emitted by the GL worker thread, only used internally.
+	void threadedBuildFinished(bool succeed);
+	
+protected:
+	
+	// Build helpers. threadedBuild() may run on a GL worker thread and must not touch 
+	// the objects used for rendering, finishBuild() always runs on the GUI thread.
+	void startBuild(bool threaded);
+	bool isBuildPending() const { return m_buildPending; }
+	void waitForBuild();
+	
+	// Parse the compiler output in the calling thread and emit a buildMessage() for each line.
+	void emitBuildMessages(const QString & output, int input, OutputParser * parser);
+	
+	// Milliseconds elapsed since @a time was started, or the fixed time.
+	int elapsedTime(const QTime & time) const { return (m_fixedTime >= 0) ? m_fixedTime : time.elapsed(); }
+	
+	virtual bool threadedBuild() { return false; }
+	virtual void finishBuild(bool succeed) { Q_UNUSED(succeed); }
+	
+private slots:
+	void onThreadedBuildFinished(bool succeed);
+	
 private:
 	EffectFactory const * const m_factory;
 	QGLWidget * const m_widget;
+	
+	class BuildTask;
+	friend class BuildTask;
+	
+	int m_fixedTime;
+	
+	bool m_buildPending;
+	int m_runningBuilds;	// Tasks that haven't returned yet, guarded by m_buildMutex.
+	QMutex m_buildMutex;
+	QWaitCondition m_buildCondition;
 
 };
 
 class EffectFactory : public QObject
 {
 public:
+	EffectFactory();
+	~EffectFactory();
+	
 	virtual bool isSupported() const = 0;
 	virtual QString name() const = 0;
 	virtual QString namePlural() const = 0;
@@ -128,11 +169,17 @@ public:
 	virtual QList<Highlighter::Rule> highlightingRules() const = 0;
 	virtual QString multiLineCommentStart() const = 0;
 	virtual QString multiLineCommentEnd() const = 0;
+	
+	// The highlighting rules, compiled the first time they are needed.
+	const Highlighter::Syntax * syntax() const;
 
 	static const EffectFactory * factoryForExtension(const QString & ext);
 	static const QList<const EffectFactory *> & factoryList();
 	static void addFactory(const EffectFactory * factory);
 	static void removeFactory(const EffectFactory * factory);
+	
+private:
+	mutable Highlighter::Syntax * m_syntax;
 };
 
 
@@ -0,0 +1,228 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#include "floatimage.h"
+#include "imageplugin.h"
+
+#include <QVector>
+
+#include <math.h>
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define FLOATIMAGE_USE_SSE
+#include <xmmintrin.h>
+#endif
+
+namespace {
+
+	// Largest size for the preview image.
+	static const int s_previewSize = 512;
+
+	// Round to nearest even, and clamp to the largest half instead of overflowing to infinity.
+	static quint16 floatToHalf(float value)
+	{
+		quint32 f;
+		memcpy(&f, &value, sizeof(f));
+
+		const quint32 sign = f & 0x80000000u;
+		f ^= sign;
+
+		quint16 h;
+		if (f >= (127u + 16u) << 23) {
+			h = (f > 255u << 23) ? 0x7e00 : 0x7bff;
+		}
+		else if (f < 113u << 23) {
+			// Denormal or zero, let the float addition do the rounding.
+			const quint32 magicBits = ((127u - 15u) + (23u - 10u) + 1u) << 23;
+			float magic;
+			memcpy(&magic, &magicBits, sizeof(magic));
+
+			float v;
+			memcpy(&v, &f, sizeof(v));
+			v += magic;
+			memcpy(&f, &v, sizeof(f));
+			h = quint16(f - magicBits);
+		}
+		else {
+			const quint32 odd = (f >> 13) & 1;
+			f += ((15u - 127u) << 23) + 0xfff + odd;
+			h = quint16(f >> 13);
+		}
+
+		return h | quint16(sign >> 16);
+	}
+
+	// As in the EXT_texture_shared_exponent specification.
+	static quint32 floatToRgb9e5(float r, float g, float b)
+	{
+		const int mantissaBits = 9;
+		const int bias = 15;
+		const int maxExponent = 31;
+		const float maxValue = float((1 << mantissaBits) - 1) / (1 << mantissaBits) * float(1 << (maxExponent - bias));
+
+		// NaNs go to zero.
+		r = (r > 0.0f) ? qMin(r, maxValue) : 0.0f;
+		g = (g > 0.0f) ? qMin(g, maxValue) : 0.0f;
+		b = (b > 0.0f) ? qMin(b, maxValue) : 0.0f;
+
+		const float maxc = qMax(r, qMax(g, b));
+
+		int exponent = qMax(-bias - 1, int(floorf(log2f(qMax(maxc, 1e-30f))))) + 1 + bias;
+		if (int(floorf(maxc / ldexpf(1.0f, exponent - bias - mantissaBits) + 0.5f)) == (1 << mantissaBits)) {
+			exponent++;
+		}
+
+		const float scale = ldexpf(1.0f, bias + mantissaBits - exponent);
+		const quint32 rm = quint32(floorf(r * scale + 0.5f));
+		const quint32 gm = quint32(floorf(g * scale + 0.5f));
+		const quint32 bm = quint32(floorf(b * scale + 0.5f));
+
+		return rm | (gm << 9) | (bm << 18) | (quint32(exponent) << 27);
+	}
+
+	static uchar toByte(float value)
+	{
+		// Reinhard and gamma 2.2.
+		value = qMax(value, 0.0f);
+		value = powf(value / (1.0f + value), 1.0f / 2.2f);
+		return uchar(qBound(0, int(value * 255.0f + 0.5f), 255));
+	}
+
+} // namespace
+
+
+// static
+void FloatImage::downsample(const float * src, int width, int height, float * dst)
+{
+	const int w = qMax(1, width / 2);
+	const int h = qMax(1, height / 2);
+
+	// Odd sizes drop the last row or column, 1 pixel wide images repeat it.
+	const int dx = width > 1 ? 4 : 0;
+	const int dy = height > 1 ? 4 * width : 0;
+
+	for (int y = 0; y < h; y++) {
+		const float * row = src + 2 * y * 4 * width;
+
+		for (int x = 0; x < w; x++) {
+			const float * p = row + 2 * x * 4;
+			float * q = dst + (y * w + x) * 4;
+
+#ifdef FLOATIMAGE_USE_SSE
+			__m128 sum = _mm_add_ps(_mm_loadu_ps(p), _mm_loadu_ps(p + dx));
+			sum = _mm_add_ps(sum, _mm_add_ps(_mm_loadu_ps(p + dy), _mm_loadu_ps(p + dy + dx)));
+			_mm_storeu_ps(q, _mm_mul_ps(sum, _mm_set1_ps(0.25f)));
+#else
+			for (int c = 0; c < 4; c++) {
+				q[c] = (p[c] + p[dx + c] + p[dy + c] + p[dy + dx + c]) * 0.25f;
+			}
+#endif
+		}
+	}
+}
+
+// static
+void FloatImage::toHalf(const float * src, int count, quint16 * dst)
+{
+	for (int i = 0; i < 4 * count; i++) {
+		dst[i] = floatToHalf(src[i]);
+	}
+}
+
+// static
+void FloatImage::toRgb9e5(const float * src, int count, quint32 * dst)
+{
+	for (int i = 0; i < count; i++) {
+		dst[i] = floatToRgb9e5(src[4 * i + 0], src[4 * i + 1], src[4 * i + 2]);
+	}
+}
+
+// static
+QImage FloatImage::preview(const float * src, int width, int height)
+{
+	QImage image(width, height, QImage::Format_ARGB32);
+
+	for (int y = 0; y < height; y++) {
+		QRgb * line = (QRgb *)image.scanLine(y);
+		const float * p = src + 4 * y * width;
+		for (int x = 0; x < width; x++, p += 4) {
+			line[x] = qRgb(toByte(p[0]), toByte(p[1]), toByte(p[2]));
+		}
+	}
+
+	return image;
+}
+
+// static
+void FloatImage::buildMipmaps(TextureImage * texture, const float * src, int width, int height)
+{
+	Q_ASSERT(texture->internalFormat == GL_RGB9_E5 || texture->internalFormat == GL_RGBA16F_ARB);
+
+	const int pixelSize = texture->internalFormat == GL_RGB9_E5 ? 4 : 8;
+
+	// Allocate all the levels at once.
+	int size = 0;
+	for (int w = width, h = height; ; w = qMax(1, w / 2), h = qMax(1, h / 2)) {
+		size += w * h * pixelSize;
+		if (w == 1 && h == 1) break;
+	}
+	texture->data.resize(size);
+	texture->levels.clear();
+
+	QVector<float> buffer;
+	const float * level = src;
+	int offset = 0;
+
+	int w = width;
+	int h = height;
+	while (true) {
+		TextureLevel l;
+		l.width = w;
+		l.height = h;
+		l.offset = offset;
+		l.size = w * h * pixelSize;
+		texture->levels.append(l);
+
+		if (pixelSize == 4) {
+			toRgb9e5(level, w * h, (quint32 *)(texture->data.data() + offset));
+		}
+		else {
+			toHalf(level, w * h, (quint16 *)(texture->data.data() + offset));
+		}
+		offset += l.size;
+
+		if (texture->image.isNull() && qMax(w, h) <= s_previewSize) {
+			texture->image = preview(level, w, h);
+		}
+
+		if (w == 1 && h == 1) {
+			break;
+		}
+
+		QVector<float> next(4 * qMax(1, w / 2) * qMax(1, h / 2));
+		downsample(level, w, h, next.data());
+		buffer.swap(next);
+		level = buffer.constData();
+
+		w = qMax(1, w / 2);
+		h = qMax(1, h / 2);
+	}
+}
@@ -0,0 +1,51 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+
+#ifndef FLOATIMAGE_H
+#define FLOATIMAGE_H
+
+#include <QtGlobal>
+#include <QImage>
+
+struct TextureImage;
+
+
+/// Float RGBA images, used to build the mipmaps of HDR textures in the loader
+/// threads instead of relying on the driver to filter float formats.
+class FloatImage
+{
+public:
+	// Average the 2x2 blocks of src into dst, that has max(1, width/2) x max(1, height/2) pixels.
+	static void downsample(const float * src, int width, int height, float * dst);
+
+	// Pack count RGBA pixels.
+	static void toHalf(const float * src, int count, quint16 * dst);
+	static void toRgb9e5(const float * src, int count, quint32 * dst);
+
+	// Tone mapped copy for the previews.
+	static QImage preview(const float * src, int width, int height);
+
+	// Fill the levels of the texture with the whole mipmap chain of the image,
+	// in the texture's internal format, either GL_RGB9_E5 or GL_RGBA16F.
+	static void buildMipmaps(TextureImage * texture, const float * src, int width, int height);
+};
+
+
+#endif // FLOATIMAGE_H
@@ -0,0 +1,198 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "frameprofiler.h"
+
+#include <QFile>
+#include <QTextStream>
+
+#include <string.h>
+
+
+// static
+QAtomicPointer<FrameProfiler> FrameProfiler::s_active;
+
+
+FrameProfiler::FrameProfiler() :
+	m_current(0),
+	m_frameNumber(0),
+	m_timerQueries(false),
+	m_inPass(false),
+	m_thread(0),
+	m_drawCalls(0),
+	m_uniformUploads(0)
+{
+	memset(m_frames, 0, sizeof(m_frames));
+}
+
+void FrameProfiler::init()
+{
+	m_timerQueries = GLEW_ARB_timer_query;
+
+	if (m_timerQueries) {
+		for (int i = 0; i < QueryLatency; i++) {
+			glGenQueries(MaxPasses, m_frames[i].queries);
+		}
+	}
+}
+
+void FrameProfiler::cleanup()
+{
+	s_active.testAndSetRelease(this, NULL);
+
+	if (m_timerQueries) {
+		for (int i = 0; i < QueryLatency; i++) {
+			glDeleteQueries(MaxPasses, m_frames[i].queries);
+			m_frames[i].pending = false;
+		}
+		m_timerQueries = false;
+	}
+}
+
+void FrameProfiler::beginFrame()
+{
+	// Collect the frames whose results are ready, oldest first.
+	for (int i = 0; i < QueryLatency; i++) {
+		Frame & frame = m_frames[(m_current + i) % QueryLatency];
+		if (frame.pending && !collect(frame)) {
+			break;
+		}
+	}
+
+	// The slot is reused now, give up on its GPU times instead of waiting.
+	Frame & frame = m_frames[m_current];
+	if (frame.pending) {
+		for (int p = 0; p < frame.sample.passCount; p++) {
+			frame.sample.gpuTime[p] = -1.0f;
+		}
+		addSample(frame.sample);
+		frame.pending = false;
+	}
+
+	frame.sample.frame = m_frameNumber++;
+	frame.sample.passCount = 0;
+
+	m_thread = QThread::currentThreadId();
+	m_drawCalls = 0;
+	m_uniformUploads = 0;
+	s_active.storeRelease(this);
+
+	m_timer.start();
+}
+
+void FrameProfiler::beginPass(int pass)
+{
+	Q_ASSERT(!m_inPass);
+
+	Frame & frame = m_frames[m_current];
+	if (pass >= MaxPasses) {
+		return;
+	}
+
+	frame.sample.passCount = pass + 1;
+	frame.sample.gpuTime[pass] = -1.0f;
+
+	if (m_timerQueries) {
+		glBeginQuery(GL_TIME_ELAPSED, frame.queries[pass]);
+		m_inPass = true;
+	}
+}
+
+void FrameProfiler::endPass()
+{
+	if (m_inPass) {
+		glEndQuery(GL_TIME_ELAPSED);
+		m_inPass = false;
+	}
+}
+
+void FrameProfiler::endFrame()
+{
+	Frame & frame = m_frames[m_current];
+
+	frame.sample.cpuTime = m_timer.nsecsElapsed() * 1e-6f;
+	frame.sample.drawCalls = m_drawCalls;
+	frame.sample.uniformUploads = m_uniformUploads;
+	s_active.testAndSetRelease(this, NULL);
+
+	if (m_timerQueries && frame.sample.passCount > 0) {
+		frame.pending = true;
+	}
+	else {
+		addSample(frame.sample);
+	}
+
+	m_current = (m_current + 1) % QueryLatency;
+}
+
+bool FrameProfiler::collect(Frame & frame)
+{
+	// Queries complete in order, so it's enough to check the last one.
+	GLint available = 0;
+	glGetQueryObjectiv(frame.queries[frame.sample.passCount - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) {
+		return false;
+	}
+
+	for (int p = 0; p < frame.sample.passCount; p++) {
+		GLuint64 elapsed = 0;
+		glGetQueryObjectui64v(frame.queries[p], GL_QUERY_RESULT, &elapsed);
+		frame.sample.gpuTime[p] = elapsed * 1e-6f;
+	}
+
+	addSample(frame.sample);
+	frame.pending = false;
+	return true;
+}
+
+void FrameProfiler::addSample(const Sample & sample)
+{
+	if (m_history.count() == MaxHistory) {
+		m_history.remove(0, MaxHistory / 2);
+	}
+	m_history.append(sample);
+}
+
+/// Write the history as CSV, one line per pass.
+bool FrameProfiler::exportCsv(const QString & fileName) const
+{
+	QFile file(fileName);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Text)) {
+		return false;
+	}
+
+	QTextStream stream(&file);
+	stream << "frame,cpu_ms,pass,gpu_ms,draw_calls,uniform_uploads\n";
+
+	foreach (const Sample & sample, m_history) {
+		for (int p = 0; p < qMax(1, sample.passCount); p++) {
+			stream << sample.frame << ',' << sample.cpuTime << ',';
+			if (p < sample.passCount) {
+				stream << p << ',';
+				if (sample.gpuTime[p] >= 0.0f) stream << sample.gpuTime[p];
+			}
+			else {
+				stream << ',';
+			}
+			stream << ',' << sample.drawCalls << ',' << sample.uniformUploads << '\n';
+		}
+	}
+
+	return stream.status() == QTextStream::Ok;
+}
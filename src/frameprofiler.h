@@ -0,0 +1,116 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef FRAMEPROFILER_H
+#define FRAMEPROFILER_H
+
+#include <GL/glew.h>
+
+#include <QAtomicPointer>
+#include <QElapsedTimer>
+#include <QString>
+#include <QThread>
+#include <QVector>
+
+
+/// Collects CPU frame times and per pass GPU times of the scene view.
+/// GPU times are read from a ring of timer queries a few frames later, so reading them never stalls.
+class FrameProfiler
+{
+public:
+	enum {
+		MaxPasses = 8,
+		QueryLatency = 4,
+		MaxHistory = 36000
+	};
+
+	struct Sample
+	{
+		int frame;
+		float cpuTime;				// milliseconds
+		int passCount;
+		float gpuTime[MaxPasses];	// milliseconds, negative when not available
+		int drawCalls;
+		int uniformUploads;
+	};
+
+	FrameProfiler();
+
+	// These need a current context.
+	void init();
+	void cleanup();
+
+	void beginFrame();
+	void beginPass(int pass);
+	void endPass();
+	void endFrame();
+
+	bool hasSample() const { return !m_history.isEmpty(); }
+	const Sample & lastSample() const { return m_history.last(); }
+	const QVector<Sample> & history() const { return m_history; }
+
+	bool exportCsv(const QString & fileName) const;
+
+	// Counters updated by the scenes and the effects. Only the work done in the
+	// frame of the profiler, and in its thread, is counted.
+	static void countDrawCall()
+	{
+		FrameProfiler * profiler = s_active.loadAcquire();
+		if (profiler != NULL && profiler->m_thread == QThread::currentThreadId()) {
+			profiler->m_drawCalls++;
+		}
+	}
+	static void countUniformUpload()
+	{
+		FrameProfiler * profiler = s_active.loadAcquire();
+		if (profiler != NULL && profiler->m_thread == QThread::currentThreadId()) {
+			profiler->m_uniformUploads++;
+		}
+	}
+
+private:
+	struct Frame
+	{
+		Sample sample;
+		GLuint queries[MaxPasses];
+		bool pending;
+	};
+
+	bool collect(Frame & frame);
+	void addSample(const Sample & sample);
+
+	Frame m_frames[QueryLatency];
+	int m_current;
+	int m_frameNumber;
+	bool m_timerQueries;
+	bool m_inPass;
+
+	QElapsedTimer m_timer;
+	QVector<Sample> m_history;
+
+	Qt::HANDLE m_thread;
+	int m_drawCalls;
+	int m_uniformUploads;
+
+	// Profiler between beginFrame() and endFrame().
+	static QAtomicPointer<FrameProfiler> s_active;
+};
+
+
+#endif // FRAMEPROFILER_H
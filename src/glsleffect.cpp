@@ -24,6 +24,8 @@
 #include "texmanager.h"
 #include "parameter.h"
 #include "glutils.h"
+#include "programcache.h"
+#include "frameprofiler.h"
 
 #include <QFile>
 #include <QByteArray>
@@ -236,6 +238,91 @@ namespace {
 		return 0;
 	}
 	
+	// Program objects are handles on some platforms.
+	static GLuint programName(GLhandleARB program)
+	{
+		return (GLuint)(size_t)program;
+	}
+	
+	static QVariant getZeroValue(GLenum type)
+	{
+		const int count = qMax(1, getRowNum(type)) * qMax(1, getColumnNum(type));
+		
+		QVariant zero;
+		switch( getBaseType(type) ) {
+			case GL_FLOAT: zero = 0.0; break;
+			case GL_INT: zero = 0; break;
+			case GL_BOOL_ARB: zero = false; break;
+			default: return QVariant();
+		}
+		
+		if( count == 1 ) {
+			return zero;
+		}
+		
+		QVariantList list;
+		for(int i = 0; i < count; i++) {
+			list.append(zero);
+		}
+		return list;
+	}
+	
+	/// CPU copy of a uniform block. Parameters write into it and the dirty range
+	/// is uploaded with a single glBufferSubData per frame.
+	class GLSLUniformBlock
+	{
+	private:
+		GLuint m_binding;
+		GLuint m_buffer;
+		QByteArray m_data;
+		int m_dirtyBegin;
+		int m_dirtyEnd;
+		
+	public:
+		GLSLUniformBlock(GLhandleARB program, GLuint index, GLuint binding) : 
+			m_binding(binding), m_buffer(0)
+		{
+			GLint size = 0;
+			glGetActiveUniformBlockiv(programName(program), index, GL_UNIFORM_BLOCK_DATA_SIZE, &size);
+			glUniformBlockBinding(programName(program), index, binding);
+			
+			m_data.fill(0, size);
+			m_dirtyBegin = 0;
+			m_dirtyEnd = size;
+			
+			glGenBuffers(1, &m_buffer);
+			glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+			glBufferData(GL_UNIFORM_BUFFER, size, NULL, GL_DYNAMIC_DRAW);
+			glBindBuffer(GL_UNIFORM_BUFFER, 0);
+		}
+		~GLSLUniformBlock()
+		{
+			glDeleteBuffers(1, &m_buffer);
+		}
+		
+		void write(int offset, const void * data, int size)
+		{
+			Q_ASSERT(offset >= 0 && offset + size <= m_data.size());
+			memcpy(m_data.data() + offset, data, size);
+			m_dirtyBegin = qMin(m_dirtyBegin, offset);
+			m_dirtyEnd = qMax(m_dirtyEnd, offset + size);
+		}
+		
+		void upload()
+		{
+			if( m_dirtyBegin < m_dirtyEnd ) {
+				glBindBuffer(GL_UNIFORM_BUFFER, m_buffer);
+				glBufferSubData(GL_UNIFORM_BUFFER, m_dirtyBegin, m_dirtyEnd - m_dirtyBegin, m_data.constData() + m_dirtyBegin);
+				glBindBuffer(GL_UNIFORM_BUFFER, 0);
+				FrameProfiler::countUniformUpload();
+				
+				m_dirtyBegin = m_data.size();
+				m_dirtyEnd = 0;
+			}
+			glBindBufferBase(GL_UNIFORM_BUFFER, m_binding, m_buffer);
+		}
+	};
+	
 	/// GLSL Parameter
 	class GLSLParameter : public Parameter
 	{
@@ -244,12 +331,28 @@ namespace {
 		GLint m_location;
 		int m_texUnit; // only valid if isTexture() returns true
 		
+		// Value packed in the layout expected by glUniform, updated in setValue.
+		GLfloat m_floatData[16];
+		GLint m_intData[4];
+		GLTexture m_texture;
+		bool m_dirty;
+		
+		// Block the parameter belongs to, or NULL for default block uniforms.
+		GLSLUniformBlock * m_block;
+		int m_blockOffset;
+		int m_matrixStride;
+		bool m_rowMajor;
+		
 	public:
 		GLSLParameter(const QString& name, GLenum type, GLint location):
-			m_type(type), m_location(location), m_texUnit(0)
+			m_type(type), m_location(location), m_texUnit(0), m_dirty(true),
+			m_block(NULL), m_blockOffset(0), m_matrixStride(0), m_rowMajor(false)
 		{
 			setName(name);
 			
+			memset(m_floatData, 0, sizeof(m_floatData));
+			memset(m_intData, 0, sizeof(m_intData));
+			
 			if( name.contains("color", Qt::CaseInsensitive) ) {
 				if (m_type == GL_FLOAT_VEC3_ARB || m_type == GL_FLOAT_VEC4_ARB) {
 					setWidget(Widget_Color);
@@ -260,12 +363,19 @@ namespace {
 		virtual int rows() const { return getRowNum(m_type); }
 		virtual int columns() const { return getColumnNum(m_type); }
 		
+		virtual void setValue(const QVariant& value)
+		{
+			Parameter::setValue(value);
+			updateData();
+		}
+		
 		GLenum glType() const { return m_type; }
 		GLint location() const { return m_location; }
 		
 		void setLocation(GLint location)
 		{
 			m_location = location;
+			m_dirty = true;
 		}
 		
 		bool isTexture() const
@@ -282,11 +392,151 @@ namespace {
 		void setTextureUnit(int unit)
 		{
 			m_texUnit = unit;
+			m_dirty = true;
 		}
 		
 		GLenum baseType() const {
 			return getBaseType(m_type);		
 		}
+		
+		void setBlock(GLSLUniformBlock * block, int offset, int matrixStride, bool rowMajor)
+		{
+			m_block = block;
+			m_blockOffset = offset;
+			m_matrixStride = matrixStride;
+			m_rowMajor = rowMajor;
+			m_dirty = true;
+		}
+		
+		// Upload the value if it changed since the last call. Textures are always bound.
+		// Called every frame, so it must not allocate.
+		void upload()
+		{
+			if( isTexture() ) {
+				glActiveTextureARB(GL_TEXTURE0_ARB + m_texUnit);
+				glBindTexture(m_texture.target(), m_texture.object());
+			}
+			
+			if( !m_dirty ) {
+				return;
+			}
+			m_dirty = false;
+			
+			if( m_block != NULL ) {
+				writeBlock();
+				return;
+			}
+			
+			FrameProfiler::countUniformUpload();
+			
+			switch( m_type ) {
+				case GL_FLOAT:
+					glUniform1fvARB(m_location, 1, m_floatData);
+					break;
+				case GL_FLOAT_VEC2_ARB:
+					glUniform2fvARB(m_location, 1, m_floatData);
+					break;
+				case GL_FLOAT_VEC3_ARB:
+					glUniform3fvARB(m_location, 1, m_floatData);
+					break;
+				case GL_FLOAT_VEC4_ARB:
+					glUniform4fvARB(m_location, 1, m_floatData);
+					break;
+				case GL_INT:
+				case GL_BOOL_ARB:
+					glUniform1ivARB(m_location, 1, m_intData);
+					break;
+				case GL_INT_VEC2_ARB:
+				case GL_BOOL_VEC2_ARB:
+					glUniform2ivARB(m_location, 1, m_intData);
+					break;
+				case GL_INT_VEC3_ARB:
+				case GL_BOOL_VEC3_ARB:
+					glUniform3ivARB(m_location, 1, m_intData);
+					break;
+				case GL_INT_VEC4_ARB:
+				case GL_BOOL_VEC4_ARB:
+					glUniform4ivARB(m_location, 1, m_intData);
+					break;
+				case GL_FLOAT_MAT2_ARB:
+					glUniformMatrix2fvARB(m_location, 1, false, m_floatData);
+					break;
+				case GL_FLOAT_MAT3_ARB:
+					glUniformMatrix3fvARB(m_location, 1, false, m_floatData);
+					break;
+				case GL_FLOAT_MAT4_ARB:
+					glUniformMatrix4fvARB(m_location, 1, false, m_floatData);
+					break;
+				case GL_SAMPLER_1D_ARB:
+				case GL_SAMPLER_2D_ARB:
+				case GL_SAMPLER_3D_ARB:
+				case GL_SAMPLER_CUBE_ARB:
+				case GL_SAMPLER_2D_RECT_ARB:
+					glUniform1iARB(m_location, m_texUnit);
+					break;
+			}
+		}
+		
+	private:
+		
+		// Copy the value into the block, using the offsets reported by the driver.
+		void writeBlock()
+		{
+			const int columnNum = getColumnNum(m_type);
+			
+			if( columnNum > 1 && m_rowMajor ) {
+				// The values are stored by columns, gather the rows.
+				const int rowNum = getRowNum(m_type);
+				for(int r = 0; r < rowNum; r++) {
+					GLfloat row[4];
+					for(int c = 0; c < columnNum; c++) {
+						row[c] = m_floatData[c * rowNum + r];
+					}
+					m_block->write(m_blockOffset + r * m_matrixStride, row, columnNum * sizeof(GLfloat));
+				}
+			}
+			else if( columnNum > 1 ) {
+				const int rowNum = getRowNum(m_type);
+				for(int c = 0; c < columnNum; c++) {
+					m_block->write(m_blockOffset + c * m_matrixStride, m_floatData + c * rowNum, rowNum * sizeof(GLfloat));
+				}
+			}
+			else if( baseType() == GL_FLOAT ) {
+				m_block->write(m_blockOffset, m_floatData, qMax(1, getRowNum(m_type)) * sizeof(GLfloat));
+			}
+			else {
+				// Booleans are stored as 32 bit integers.
+				m_block->write(m_blockOffset, m_intData, qMax(1, getRowNum(m_type)) * sizeof(GLint));
+			}
+		}
+		
+		void updateData()
+		{
+			m_dirty = true;
+			
+			if( isTexture() ) {
+				m_texture = value().value<GLTexture>();
+				return;
+			}
+			
+			const int count = qMax(1, rows()) * qMax(1, columns());
+			const GLenum base = baseType();
+			
+			if( count == 1 ) {
+				if( base == GL_FLOAT ) m_floatData[0] = float(value().toDouble());
+				else if( base == GL_INT ) m_intData[0] = value().toInt();
+				else if( base == GL_BOOL_ARB ) m_intData[0] = value().toBool();
+				return;
+			}
+			
+			QVariantList list = value().toList();
+			const int n = qMin(count, list.count());
+			for(int i = 0; i < n; i++) {
+				if( base == GL_FLOAT ) m_floatData[i] = float(list.at(i).toDouble());
+				else if( base == GL_INT ) m_intData[i] = list.at(i).toInt();
+				else if( base == GL_BOOL_ARB ) m_intData[i] = list.at(i).toBool();
+			}
+		}
 	};
 
 }
@@ -308,28 +558,20 @@ private:
 	GLint m_timeUniform;
 
 	QVector<GLSLParameter*> m_parameterArray;
+	QList<GLSLUniformBlock*> m_uniformBlockList;
 
 	OutputParser* m_outputParser;
 
-	// Builder thread.
-	class BuilderThread : public GLThread
-	{
-		GLSLEffect * m_effect;
-		
-	public:
-		BuilderThread(QGLWidget * widget, GLSLEffect * effect) : GLThread(widget), m_effect(effect)
-		{
-		}
-		void run() 
-		{
-			this->makeCurrent();
-			bool succeed = m_effect->threadedBuild();
-			this->doneCurrent();
-			emit m_effect->built(succeed);
-		}
-	};
-	friend class BuilderThread;
-	BuilderThread m_thread;
+	// Sources being built and the objects created by the builder, swapped in by finishBuild().
+	QByteArray m_buildVertexShaderText;
+	QByteArray m_buildFragmentShaderText;
+	GLhandleARB m_newVertexShader;
+	GLhandleARB m_newFragmentShader;
+	GLhandleARB m_newProgram;
+	
+	// Sources of the current shader objects.
+	QByteArray m_vertexShaderSource;
+	QByteArray m_fragmentShaderSource;
 	
 public:
 
@@ -342,15 +584,20 @@ public:
 		m_fragmentShaderText(s_fragmentShaderText),
 		m_timeUniform(-1),
 		m_outputParser(0),
-		m_thread(widget, this)
+		m_newVertexShader(0),
+		m_newFragmentShader(0),
+		m_newProgram(0)
 	{
 		this->makeCurrent();
 		
 		const char* vendor = (const char*)glGetString(GL_VENDOR);
+		const char* version = (const char*)glGetString(GL_VERSION);
 		if (strcmp(vendor, "ATI Technologies Inc.") == 0)
 			m_outputParser = new AtiGlslOutputParser;
 		else if (strcmp(vendor, "NVIDIA Corporation") == 0)
 			m_outputParser = new NvidiaOutputParser;
+		else if (strstr(version, "Mesa") != NULL)
+			m_outputParser = new MesaGlslOutputParser;
 		
 		m_time.start();
 	}
@@ -358,12 +605,16 @@ public:
 	// Dtor.
 	virtual ~GLSLEffect()
 	{
+		waitForBuild();
+		
 		this->makeCurrent();
 		
+		deleteNewProgram();
 		deleteProgram();
 		ReportGLErrors();
 		delete m_outputParser;
 		qDeleteAll(m_parameterArray);
+		qDeleteAll(m_uniformBlockList);
 	}
 
 
@@ -501,61 +752,73 @@ public:
 		}
 	}
 
-	bool threadedBuild()
+	virtual bool threadedBuild()
 	{
 		GLhandleARB vertexShader;
 		GLhandleARB fragmentShader;
 		GLhandleARB program;
 		
+		// Try to reuse the binary of a previous build.
+		const QByteArray cacheKey = ProgramCache::key(QList<QByteArray>() << m_buildVertexShaderText << m_buildFragmentShaderText);
 		
-		vertexShader = glCreateShaderObjectARB(GL_VERTEX_SHADER_ARB);
-		
-		emit infoMessage(tr("Compiling vertex shader..."));
-		const char * vertexStrings[] = { m_vertexShaderText.data() };
-		glShaderSourceARB(vertexShader, 1, vertexStrings, NULL);
-		glCompileShaderARB(vertexShader);
-		
-		// Get error log.
-		QByteArray infoLog;
-		GLint charsWritten, infoLogLength;
-		glGetObjectParameterivARB(vertexShader, GL_OBJECT_INFO_LOG_LENGTH_ARB, &infoLogLength);
-		infoLog.resize(infoLogLength);
-		glGetInfoLogARB(vertexShader, infoLogLength, &charsWritten, infoLog.data());
-		emit buildMessage(infoLog, 0, m_outputParser);
+		QList<QByteArray> infoLogs;
+		program = ProgramCache::load(cacheKey, &infoLogs);
+		if( program != 0 ) {
+			emit infoMessage(tr("Using cached program binary."));
+			
+			// Show the warnings of the build that produced the binary again.
+			if( infoLogs.count() == 3 ) {
+				emitBuildMessages(infoLogs.at(0), 0, m_outputParser);
+				emitBuildMessages(infoLogs.at(1), 1, m_outputParser);
+				emitBuildMessages(infoLogs.at(2), -1, m_outputParser);
+			}
+			
+			m_newProgram = program;
+			
+			return true;
+		}
 		
-		fragmentShader = glCreateShaderObjectARB(GL_FRAGMENT_SHADER_ARB);
+		// Only recompile the stages that changed since the last successful build.
+		// The current shader objects are not modified until finishBuild() is called, so they can be shared.
+		const bool vertexChanged = m_vertexShader == 0 || m_buildVertexShaderText != m_vertexShaderSource;
+		const bool fragmentChanged = m_fragmentShader == 0 || m_buildFragmentShaderText != m_fragmentShaderSource;
 		
-		emit infoMessage(tr("Compiling fragment shader..."));
-		const char * fragmentStrings[] = { m_fragmentShaderText.data() };
-		glShaderSourceARB(fragmentShader, 1, fragmentStrings, NULL);
-		glCompileShaderARB(fragmentShader);
+		if( vertexChanged ) {
+			emit infoMessage(tr("Compiling vertex shader..."));
+			vertexShader = compileShader(GL_VERTEX_SHADER_ARB, m_buildVertexShaderText);
+		}
+		else {
+			vertexShader = m_vertexShader;
+		}
+		infoLogs.append(getInfoLog(vertexShader));
+		emitBuildMessages(infoLogs.last(), 0, m_outputParser);
 		
-		// Get error log.
-		infoLog.clear();
-		glGetObjectParameterivARB(fragmentShader, GL_OBJECT_INFO_LOG_LENGTH_ARB, &infoLogLength);
-		infoLog.resize(infoLogLength);
-		glGetInfoLogARB(fragmentShader, infoLogLength, &charsWritten, infoLog.data());
-		emit buildMessage(infoLog, 1, m_outputParser);
+		if( fragmentChanged ) {
+			emit infoMessage(tr("Compiling fragment shader..."));
+			fragmentShader = compileShader(GL_FRAGMENT_SHADER_ARB, m_buildFragmentShaderText);
+		}
+		else {
+			fragmentShader = m_fragmentShader;
+		}
+		infoLogs.append(getInfoLog(fragmentShader));
+		emitBuildMessages(infoLogs.last(), 1, m_outputParser);
 		
 		// Check compilation.
 		GLint vertexCompileSucceed = GL_FALSE;
 		glGetObjectParameterivARB(vertexShader, GL_OBJECT_COMPILE_STATUS_ARB, &vertexCompileSucceed);
-		if( vertexCompileSucceed == GL_FALSE )
-		{
-			glDeleteObjectARB(vertexShader);
-			return false;
-		}
 		
 		GLint fragmentCompileSucceed = GL_FALSE;
 		glGetObjectParameterivARB(fragmentShader, GL_OBJECT_COMPILE_STATUS_ARB, &fragmentCompileSucceed);
-		if( fragmentCompileSucceed == GL_FALSE )
+		
+		if( vertexCompileSucceed == GL_FALSE || fragmentCompileSucceed == GL_FALSE )
 		{
-			glDeleteObjectARB(vertexShader);
-			glDeleteObjectARB(fragmentShader);
+			if( vertexChanged ) glDeleteObjectARB(vertexShader);
+			if( fragmentChanged ) glDeleteObjectARB(fragmentShader);
 			return false;
 		}
 		
 		program = glCreateProgramObjectARB();
+		ProgramCache::prepare(program);
 		
 		// Link the program.
 		emit infoMessage(tr("Linking..."));
@@ -564,11 +827,8 @@ public:
 		glLinkProgramARB(program);
 		
 		// Get error log.
-		infoLog.clear();
-		glGetObjectParameterivARB(program, GL_OBJECT_INFO_LOG_LENGTH_ARB, &infoLogLength);
-		infoLog.resize(infoLogLength);
-		glGetInfoLogARB(program, infoLogLength, &charsWritten, infoLog.data());
-		emit buildMessage(infoLog, -1, m_outputParser);
+		infoLogs.append(getInfoLog(program));
+		emitBuildMessages(infoLogs.last(), -1, m_outputParser);
 		
 		// Test linker result.
 		GLint linkSucceed = GL_FALSE;
@@ -577,47 +837,69 @@ public:
 		{
 			glDetachObjectARB(program, vertexShader);
 			glDetachObjectARB(program, fragmentShader);
-			glDeleteObjectARB(vertexShader);
-			glDeleteObjectARB(fragmentShader);
+			if( vertexChanged ) glDeleteObjectARB(vertexShader);
+			if( fragmentChanged ) glDeleteObjectARB(fragmentShader);
 			glDeleteObjectARB(program);
 			return false;
 		}
 		
+		ProgramCache::store(cacheKey, program, infoLogs);
+		
+		Q_ASSERT( m_newVertexShader == 0 && m_newFragmentShader == 0 && m_newProgram == 0 );
+		
+		m_newVertexShader = vertexShader;
+		m_newFragmentShader = fragmentShader;
+		m_newProgram = program;
+		
+		return true;
+	}
+	
+	virtual void finishBuild(bool succeed)
+	{
+		if( !succeed ) {
+			return;
+		}
+		
+		// Keep the shader objects that are reused by the new program.
+		if( m_vertexShader == m_newVertexShader ) {
+			m_vertexShader = 0;
+		}
+		if( m_fragmentShader == m_newFragmentShader ) {
+			m_fragmentShader = 0;
+		}
+		
 		// Delete previous effect.
 		deleteProgram();
 		
-		Q_ASSERT( m_vertexShader == 0 && vertexShader != 0 );
-		Q_ASSERT( m_fragmentShader == 0 && fragmentShader != 0 );
-		Q_ASSERT( m_program == 0 && program != 0 );
+		Q_ASSERT( m_program == 0 && m_newProgram != 0 );
 		
-		m_vertexShader = vertexShader;
-		m_fragmentShader = fragmentShader;
-		m_program = program;
+		m_vertexShader = m_newVertexShader;
+		m_fragmentShader = m_newFragmentShader;
+		m_program = m_newProgram;
 		
-		initParameters();
+		// Programs loaded from the cache have no shader objects to reuse.
+		m_vertexShaderSource = (m_vertexShader != 0) ? m_buildVertexShaderText : QByteArray();
+		m_fragmentShaderSource = (m_fragmentShader != 0) ? m_buildFragmentShaderText : QByteArray();
 		
-		return true;
+		m_newVertexShader = 0;
+		m_newFragmentShader = 0;
+		m_newProgram = 0;
+		
+		initParameters();
 	}
 	
 	virtual void build(bool threaded)
 	{
-#if defined(Q_OS_LINUX)
-		threaded = false;
-#endif
-
-		if (threaded) {
-			m_thread.start();
-		}
-		else {
-			this->makeCurrent();
-			bool succeed = threadedBuild();
-			emit built(succeed);
-		}
+		// The editors may change the sources while the builder is running.
+		m_buildVertexShaderText = m_vertexShaderText;
+		m_buildFragmentShaderText = m_fragmentShaderText;
+		
+		startBuild(threaded);
 	}
 	
 	virtual bool isBuilding() const 
 	{
-		return m_thread.isRunning();
+		return isBuildPending();
 	}
 
 	// Parameter info.
@@ -730,6 +1012,44 @@ private:
 		}
 	}
 
+	static GLhandleARB compileShader(GLenum type, const QByteArray & text)
+	{
+		GLhandleARB shader = glCreateShaderObjectARB(type);
+		
+		const char * strings[] = { text.constData() };
+		glShaderSourceARB(shader, 1, strings, NULL);
+		glCompileShaderARB(shader);
+		
+		return shader;
+	}
+	
+	static QByteArray getInfoLog(GLhandleARB object)
+	{
+		QByteArray infoLog;
+		GLint charsWritten, infoLogLength;
+		glGetObjectParameterivARB(object, GL_OBJECT_INFO_LOG_LENGTH_ARB, &infoLogLength);
+		infoLog.resize(infoLogLength);
+		glGetInfoLogARB(object, infoLogLength, &charsWritten, infoLog.data());
+		return infoLog;
+	}
+	
+	void deleteNewProgram()
+	{
+		if( m_newProgram != 0 ) {
+			glDeleteObjectARB(m_newProgram);
+			m_newProgram = 0;
+		}
+		// Reused shader objects are owned by the current program.
+		if( m_newVertexShader != 0 && m_newVertexShader != m_vertexShader ) {
+			glDeleteObjectARB(m_newVertexShader);
+		}
+		if( m_newFragmentShader != 0 && m_newFragmentShader != m_fragmentShader ) {
+			glDeleteObjectARB(m_newFragmentShader);
+		}
+		m_newVertexShader = 0;
+		m_newFragmentShader = 0;
+	}
+
 	void initParameters()
 	{
 		m_timeUniform = -1;
@@ -742,6 +1062,24 @@ private:
 		glGetObjectParameterivARB(m_program, GL_OBJECT_ACTIVE_UNIFORMS_ARB, &count);
 
 		QVector<GLSLParameter*> newParameterArray;
+		QList<GLSLUniformBlock*> newUniformBlockList;
+		
+		// Uniforms in blocks are stored in buffers.
+		GLint blockCount = 0;
+		if( GLEW_ARB_uniform_buffer_object ) {
+			GLint maxBindings = 0;
+			glGetIntegerv(GL_MAX_UNIFORM_BUFFER_BINDINGS, &maxBindings);
+			glGetProgramiv(programName(m_program), GL_ACTIVE_UNIFORM_BLOCKS, &blockCount);
+			
+			if( blockCount > maxBindings ) {
+				emit errorMessage(tr("Uniform buffer binding limit hit, ignoring %1 uniform blocks").arg(blockCount - maxBindings));
+				blockCount = maxBindings;
+			}
+			
+			for(int b = 0; b < blockCount; b++) {
+				newUniformBlockList.append(new GLSLUniformBlock(m_program, b, b));
+			}
+		}
 
 		for(int i = 0; i < count; i++) {
 			char str[1024];
@@ -749,6 +1087,25 @@ private:
 			GLint size;
 			GLenum type;
 			glGetActiveUniformARB(m_program, i, 1024, &length, &size, &type, str);
+			
+			GLint blockIndex = -1;
+			GLint blockOffset = 0;
+			GLint arrayStride = 0;
+			GLint matrixStride = 0;
+			GLint rowMajor = GL_FALSE;
+			if( GLEW_ARB_uniform_buffer_object ) {
+				GLuint index = i;
+				glGetActiveUniformsiv(programName(m_program), 1, &index, GL_UNIFORM_BLOCK_INDEX, &blockIndex);
+				glGetActiveUniformsiv(programName(m_program), 1, &index, GL_UNIFORM_OFFSET, &blockOffset);
+				glGetActiveUniformsiv(programName(m_program), 1, &index, GL_UNIFORM_ARRAY_STRIDE, &arrayStride);
+				glGetActiveUniformsiv(programName(m_program), 1, &index, GL_UNIFORM_MATRIX_STRIDE, &matrixStride);
+				glGetActiveUniformsiv(programName(m_program), 1, &index, GL_UNIFORM_IS_ROW_MAJOR, &rowMajor);
+				
+				if( blockIndex >= blockCount ) {
+					continue;
+				}
+			}
+			GLSLUniformBlock * block = (blockIndex >= 0) ? newUniformBlockList.at(blockIndex) : NULL;
 
 			QString name(str);
 
@@ -768,13 +1125,15 @@ private:
 			// Add parameter
 			if( size == 1 ) {
 				GLSLParameter * param = new GLSLParameter(name, type, location);
+				if( block != NULL ) param->setBlock(block, blockOffset, matrixStride, rowMajor != GL_FALSE);
 				param->setValue(getParameterValue(param));
 				newParameterArray.push_back(param);
 			}
 			else {
 				// parameter array.
 				for(int i = 0; i < size; i++) {
-					GLSLParameter * param = new GLSLParameter(name + "[" + QString::number(i) + "]", type, location+i);
+					GLSLParameter * param = new GLSLParameter(name + "[" + QString::number(i) + "]", type, (block != NULL) ? -1 : location+i);
+					if( block != NULL ) param->setBlock(block, blockOffset + i * arrayStride, matrixStride, rowMajor != GL_FALSE);
 					param->setValue(getParameterValue(param));
 					newParameterArray.push_back(param);
 				}
@@ -783,6 +1142,9 @@ private:
 
 		qDeleteAll(m_parameterArray);
 		m_parameterArray = newParameterArray;
+		
+		qDeleteAll(m_uniformBlockList);
+		m_uniformBlockList = newUniformBlockList;
 
 		// Get number of texture units.
 		GLint texUnitNum = 8;
@@ -810,157 +1172,21 @@ private:
 	void setParameters()
 	{
 		// Set user parameters
-		foreach(GLSLParameter * p, m_parameterArray) {
-			setParameter(p);
+		const int count = m_parameterArray.count();
+		for(int i = 0; i < count; i++) {
+			m_parameterArray.at(i)->upload();
+		}
+		
+		// Upload the blocks the parameters wrote into.
+		const int blockCount = m_uniformBlockList.count();
+		for(int i = 0; i < blockCount; i++) {
+			m_uniformBlockList.at(i)->upload();
 		}
 
 		// Set standard parameters.
 		if( m_timeUniform != -1 ) {
-			glUniform1fARB(m_timeUniform, 0.001f * m_time.elapsed());
-		}
-	}
-
-	void setParameter(const GLSLParameter * param)
-	{
-		switch( param->glType() ) {
-			case GL_FLOAT:
-				glUniform1fARB(param->location(), float(param->value().toDouble()));
-				break;
-			case GL_FLOAT_VEC2_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 2);
-				glUniform2fARB(param->location(), list.at(0).toDouble(), list.at(1).toDouble());
-				break;
-			}
-			case GL_FLOAT_VEC3_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 3);	
-				glUniform3fARB(param->location(), list.at(0).toDouble(), list.at(1).toDouble(), list.at(2).toDouble());
-				break;
-			}
-			case GL_FLOAT_VEC4_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 4);
-				glUniform4fARB(param->location(), list.at(0).toDouble(), list.at(1).toDouble(), list.at(2).toDouble(), list.at(3).toDouble());
-				break;
-			}
-			case GL_INT:
-				glUniform1iARB(param->location(), param->value().toInt());
-				break;
-			case GL_INT_VEC2_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 2);
-				glUniform2iARB(param->location(), list.at(0).toInt(), list.at(1).toInt());
-				break;
-			}
-			case GL_INT_VEC3_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 3);
-				glUniform3iARB(param->location(), list.at(0).toInt(), list.at(1).toInt(), list.at(2).toInt());
-				break;
-			}
-			case GL_INT_VEC4_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 4);
-				glUniform4iARB(param->location(), list.at(0).toInt(), list.at(1).toInt(), list.at(2).toInt(), list.at(3).toInt());
-				break;
-			}
-			case GL_BOOL_ARB:
-				glUniform1iARB(param->location(), param->value().toBool());
-				break;
-			case GL_BOOL_VEC2_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 2);
-				glUniform2iARB(param->location(), list.at(0).toBool(), list.at(1).toBool());
-				break;
-			}
-			case GL_BOOL_VEC3_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 3);
-				glUniform3iARB(param->location(), list.at(0).toBool(), list.at(1).toBool(), list.at(2).toBool());
-				break;
-			}
-			case GL_BOOL_VEC4_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 4);
-				glUniform4iARB(param->location(), list.at(0).toBool(), list.at(1).toBool(), list.at(2).toBool(), list.at(3).toBool());
-				break;
-			}
-			case GL_FLOAT_MAT2_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 4);
-				
-				float values[4];
-				for(int i = 0; i < 2*2; i++) {
-					values[i] = (float)list.at(0).toDouble();
-				}
-				
-				glUniformMatrix2fv(param->location(), 1, false, values);
-				break;
-			}
-			case GL_FLOAT_MAT3_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 9);
-				
-				float values[9];
-				for(int i = 0; i < 3*3; i++) {
-					values[i] = (float)list.at(0).toDouble();
-				}
-				
-				glUniformMatrix3fv(param->location(), 1, false, values);
-				break;
-			}
-			case GL_FLOAT_MAT4_ARB:
-			{
-				Q_ASSERT(param->value().canConvert(QVariant::List));
-				QVariantList list = param->value().toList();
-				Q_ASSERT(list.count() == 16);
-				
-				float values[16];
-				for(int i = 0; i < 4*4; i++) {
-					values[i] = (float)list.at(0).toDouble();
-				}
-				
-				glUniformMatrix4fv(param->location(), 1, false, values);
-				break;
-			}
-			case GL_SAMPLER_1D_ARB:
-			case GL_SAMPLER_2D_ARB:
-			case GL_SAMPLER_3D_ARB:
-			case GL_SAMPLER_CUBE_ARB:
-			case GL_SAMPLER_2D_RECT_ARB: {
-				GLTexture tex = param->value().value<GLTexture>();
-				glUniform1iARB(param->location(), param->textureUnit());
-				glActiveTextureARB(GL_TEXTURE0_ARB + param->textureUnit());
-				glBindTexture(tex.target(), tex.object());
-				break;
-			}
-			case GL_SAMPLER_1D_SHADOW_ARB:
-			case GL_SAMPLER_2D_SHADOW_ARB:
-			case GL_SAMPLER_2D_RECT_SHADOW_ARB:
-				break;
+			glUniform1fARB(m_timeUniform, 0.001f * elapsedTime(m_time));
+			FrameProfiler::countUniformUpload();
 		}
 	}
 
@@ -973,6 +1199,11 @@ private:
 			}
 		}					
 		
+		// Uniforms in blocks can't be queried, they start zeroed.
+		if( param->location() == -1 ) {
+			return getZeroValue(param->glType());
+		}
+		
 		// Get default value of the corresponding type.
 		switch( param->glType() ) {
 			case GL_FLOAT:
@@ -22,6 +22,11 @@
 
 #include "glutils.h"
 
+#include <QCoreApplication>
+#include <QMutexLocker>
+#include <QOffscreenSurface>
+#include <QOpenGLContext>
+
 //#include <QX11Info>
 
 //extern "C"
@@ -82,17 +87,123 @@ public:
 };
 */
 
-void GLThread::makeCurrent()
+/// Worker thread that owns a GL context and an offscreen surface.
+class GLThreadPool::Worker : public QThread
+{
+	GLThreadPool * m_pool;
+	QOpenGLContext * m_context;
+	QOffscreenSurface * m_surface;
+	
+public:
+	Worker(GLThreadPool * pool, QOpenGLContext * shareContext) : m_pool(pool)
+	{
+		// Surfaces have to be created in the GUI thread.
+		m_surface = new QOffscreenSurface();
+		m_surface->setFormat(shareContext->format());
+		m_surface->create();
+		
+		m_context = new QOpenGLContext();
+		m_context->setFormat(shareContext->format());
+		m_context->setShareContext(shareContext);
+		m_context->create();
+		m_context->moveToThread(this);
+	}
+	~Worker()
+	{
+		delete m_context;
+		delete m_surface;
+	}
+	
+	QOpenGLContext * context() const { return m_context; }
+	
+	void run()
+	{
+		m_context->makeCurrent(m_surface);
+		
+		while (true) {
+			GLTask * task = NULL;
+			{
+				QMutexLocker locker(&m_pool->m_mutex);
+				while (m_pool->m_taskList.isEmpty() && !m_pool->m_quit) {
+					m_pool->m_condition.wait(&m_pool->m_mutex);
+				}
+				if (m_pool->m_quit) {
+					break;
+				}
+				task = m_pool->m_taskList.takeFirst();
+			}
+			
+			task->run();
+			delete task;
+		}
+		
+		m_context->doneCurrent();
+		
+		// Give the context back so that it can be destroyed by the GUI thread.
+		m_context->moveToThread(QCoreApplication::instance()->thread());
+	}
+};
+
+
+// static
+GLThreadPool * GLThreadPool::s_instance = NULL;
+
+// static
+GLThreadPool * GLThreadPool::instance(QGLWidget * shareWidget)
+{
+	Q_ASSERT(shareWidget != NULL);
+	
+	if (s_instance == NULL) {
+		// Builds of a single effect are serialized, so there's no point in having many threads.
+		s_instance = new GLThreadPool(shareWidget, qBound(1, QThread::idealThreadCount(), 2));
+		qAddPostRoutine(cleanup);
+	}
+	
+	// All effects are created with the same share widget.
+	Q_ASSERT(QOpenGLContext::areSharing(s_instance->m_workerList.first()->context(), shareWidget->context()->contextHandle()));
+	
+	return s_instance;
+}
+
+// static
+void GLThreadPool::cleanup()
+{
+	delete s_instance;
+	s_instance = NULL;
+}
+
+GLThreadPool::GLThreadPool(QGLWidget * shareWidget, int threadCount) : m_quit(false)
 {
-	//XLock lock;
-	//XLockDisplay(QX11Info::display());
-	m_glWidget->makeCurrent();
+	QOpenGLContext * shareContext = shareWidget->context()->contextHandle();
+	Q_ASSERT(shareContext != NULL);
+	
+	for (int i = 0; i < threadCount; i++) {
+		Worker * worker = new Worker(this, shareContext);
+		m_workerList.append(worker);
+		worker->start();
+	}
 }
 
-void GLThread::doneCurrent()
+GLThreadPool::~GLThreadPool()
 {
-	//XLock lock;
-	m_glWidget->doneCurrent();
-	//XUnlockDisplay(QX11Info::display());
+	{
+		QMutexLocker locker(&m_mutex);
+		m_quit = true;
+		m_condition.wakeAll();
+	}
+	
+	foreach (Worker * worker, m_workerList) {
+		worker->wait();
+	}
+	qDeleteAll(m_workerList);
+	qDeleteAll(m_taskList);
 }
 
+void GLThreadPool::start(GLTask * task)
+{
+	Q_ASSERT(task != NULL);
+	
+	QMutexLocker locker(&m_mutex);
+	m_taskList.append(task);
+	m_condition.wakeOne();
+}
@@ -26,6 +26,7 @@
 
 #include <QThread>
 #include <QMutex>
+#include <QWaitCondition>
 #include <QGLContext>
 #include <QGLWidget>
 
@@ -51,23 +52,41 @@ protected:
 };
 
 
-/// A thread that wraps a dummy GL context. 
-class GLThread : public QThread
+/// A unit of work that runs on a GL worker thread.
+class GLTask
 {
-	QGLWidget * m_glWidget;
-	
 public:
-	GLThread(QGLWidget * shareWidget)
-	{
-		m_glWidget = new QGLWidget(NULL, shareWidget);
-	}
-	~GLThread()
-	{
-		delete m_glWidget;
-	}
+	virtual ~GLTask() { }
+	virtual void run() = 0;
+};
+
+
+/// Pool of threads with persistent GL contexts that share objects with the
+/// GUI context. The contexts are created once, the first time the pool is used.
+class GLThreadPool
+{
+public:
+	static GLThreadPool * instance(QGLWidget * shareWidget);
+	
+	// Run the given task on a worker thread with its context current. Takes ownership of the task.
+	void start(GLTask * task);
+	
+private:
+	GLThreadPool(QGLWidget * shareWidget, int threadCount);
+	~GLThreadPool();
+	
+	static void cleanup();
+	
+	class Worker;
+	friend class Worker;
+	
+	QList<Worker *> m_workerList;
+	QList<GLTask *> m_taskList;
+	QMutex m_mutex;
+	QWaitCondition m_condition;
+	bool m_quit;
 	
-	void makeCurrent();
-	void doneCurrent();
+	static GLThreadPool * s_instance;
 };
 
 
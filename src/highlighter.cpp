@@ -19,28 +19,396 @@
 
 #include "highlighter.h"
 
+#include <QStringList>
+#include <QTextDocument>
+#include <QTextBlock>
+#include <QElapsedTimer>
+
+
+namespace {
+
+	// Same as the word boundaries of QRegExp.
+	static bool isWordChar(QChar c)
+	{
+		return c.isLetterOrNumber() || c.isMark() || c == QLatin1Char('_');
+	}
+
+	static bool isSpecialChar(QChar c)
+	{
+		return QString("\\^$.|?*+()[]{}").contains(c);
+	}
+
+	// Rules that expand to more words than this keep their regular expression.
+	static const int s_maxWords = 4096;
+
+	/// Expands the finite patterns the keyword rules are made of: word characters,
+	/// character ranges, groups, alternations and optional items.
+	class WordExpander
+	{
+	public:
+		WordExpander(const QString& pattern) : m_pattern(pattern), m_pos(0) {}
+
+		bool expand(QStringList* words)
+		{
+			if (!alternation(words) || m_pos != m_pattern.length())
+				return false;
+			return !words->contains(QString());
+		}
+
+	private:
+		bool atEnd() const { return m_pos >= m_pattern.length(); }
+		QChar peek() const { return atEnd() ? QChar() : m_pattern.at(m_pos); }
+
+		bool alternation(QStringList* words)
+		{
+			if (!sequence(words))
+				return false;
+
+			while (peek() == QLatin1Char('|')) {
+				m_pos++;
+				QStringList more;
+				if (!sequence(&more))
+					return false;
+				*words += more;
+			}
+			return words->count() <= s_maxWords;
+		}
+
+		bool sequence(QStringList* words)
+		{
+			*words = QStringList(QString());
+
+			while (!atEnd() && peek() != QLatin1Char('|') && peek() != QLatin1Char(')')) {
+				QStringList item;
+				if (!atom(&item))
+					return false;
+				if (peek() == QLatin1Char('?')) {
+					m_pos++;
+					item.prepend(QString());
+				}
+
+				QStringList product;
+				foreach (const QString& prefix, *words) {
+					foreach (const QString& suffix, item) {
+						product.append(prefix + suffix);
+					}
+				}
+				if (product.count() > s_maxWords)
+					return false;
+				*words = product;
+			}
+			return true;
+		}
+
+		bool atom(QStringList* words)
+		{
+			const QChar c = m_pattern.at(m_pos++);
+
+			if (c == QLatin1Char('(')) {
+				if (!alternation(words) || peek() != QLatin1Char(')'))
+					return false;
+				m_pos++;
+				return true;
+			}
+
+			if (c == QLatin1Char('[')) {
+				while (!atEnd() && peek() != QLatin1Char(']')) {
+					const QChar first = m_pattern.at(m_pos++);
+					QChar last = first;
+					if (peek() == QLatin1Char('-') && m_pos + 1 < m_pattern.length() && m_pattern.at(m_pos + 1) != QLatin1Char(']')) {
+						last = m_pattern.at(m_pos + 1);
+						m_pos += 2;
+					}
+					if (last < first)
+						return false;
+					for (ushort u = first.unicode(); u <= last.unicode(); u++) {
+						if (!isWordChar(QChar(u)))
+							return false;
+						words->append(QChar(u));
+					}
+				}
+				if (atEnd())
+					return false;
+				m_pos++;
+				return !words->isEmpty();
+			}
+
+			if (isWordChar(c)) {
+				words->append(c);
+				return true;
+			}
+			return false;
+		}
+
+		const QString m_pattern;
+		int m_pos;
+	};
+
+	/// Split the pattern at the alternations that are not inside a group or a class.
+	static QStringList splitAlternatives(const QString& pattern)
+	{
+		QStringList alternatives;
+		int depth = 0;
+		bool inClass = false;
+		int start = 0;
+
+		for (int i = 0; i < pattern.length(); i++) {
+			const QChar c = pattern.at(i);
+			if (c == QLatin1Char('\\')) {
+				i++;
+			}
+			else if (inClass) {
+				inClass = c != QLatin1Char(']');
+			}
+			else if (c == QLatin1Char('[')) {
+				inClass = true;
+			}
+			else if (c == QLatin1Char('(')) {
+				depth++;
+			}
+			else if (c == QLatin1Char(')')) {
+				depth--;
+			}
+			else if (c == QLatin1Char('|') && depth == 0) {
+				alternatives.append(pattern.mid(start, i - start));
+				start = i + 1;
+			}
+		}
+		alternatives.append(pattern.mid(start));
+		return alternatives;
+	}
+
+	/// Inner pattern of "\b(...)\b", if the group spans all of it.
+	static bool wordGroup(const QString& pattern, QString* inner)
+	{
+		if (!pattern.startsWith("\\b(") || !pattern.endsWith(")\\b"))
+			return false;
+
+		*inner = pattern.mid(3, pattern.length() - 6);
+
+		// The group has to span the whole pattern, in "\b(a)|(b)\b" it doesn't.
+		int depth = 0;
+		bool inClass = false;
+		for (int i = 0; i < inner->length(); i++) {
+			const QChar c = inner->at(i);
+			if (c == QLatin1Char('\\')) {
+				i++;
+			}
+			else if (inClass) {
+				inClass = c != QLatin1Char(']');
+			}
+			else if (c == QLatin1Char('[')) {
+				inClass = true;
+			}
+			else if (c == QLatin1Char('(')) {
+				depth++;
+			}
+			else if (c == QLatin1Char(')') && --depth < 0) {
+				return false;
+			}
+		}
+		return depth == 0 && !inClass;
+	}
+
+	/// Literal text without any special character.
+	static bool isLiteral(const QString& s)
+	{
+		if (s.isEmpty())
+			return false;
+		for (int i = 0; i < s.length(); i++) {
+			if (isSpecialChar(s.at(i)))
+				return false;
+		}
+		return true;
+	}
+
+} // namespace
+
+
+Highlighter::Syntax::Syntax(const QList<Rule>& rules, const QString& multiLineCommentStart, const QString& multiLineCommentEnd) :
+	m_multiLineCommentStart(multiLineCommentStart),
+	m_multiLineCommentEnd(multiLineCommentEnd)
+{
+	QRegExp lineRegExp("^(.+)\\.\\*(\\$|\\([^()]*\\|\\$\\))$");
+
+	// Passes that come later override the formats of the previous ones, as the rules did.
+	foreach (const Rule& rule, rules)
+	{
+		const QRegExp& rx = rule.pattern;
+		const QString pattern = rx.pattern();
+
+		const bool plain = (rx.patternSyntax() == QRegExp::RegExp || rx.patternSyntax() == QRegExp::RegExp2) &&
+			rx.caseSensitivity() == Qt::CaseSensitive && !rx.isMinimal();
+		if (!plain) {
+			addRegExp(rx, rule.type);
+			continue;
+		}
+
+		// "\b(if|else|vec[2-4])\b" matches whole identifiers only.
+		QString inner;
+		if (wordGroup(pattern, &inner)) {
+			QStringList words;
+			QStringList others;
+			foreach (const QString& alternative, splitAlternatives(inner)) {
+				QStringList expanded;
+				if (WordExpander(alternative).expand(&expanded))
+					words += expanded;
+				else
+					others.append(alternative);
+			}
+
+			addWords(words, rule.type);
+			if (!others.isEmpty())
+				addRegExp(QRegExp("\\b(" + others.join("|") + ")\\b"), rule.type);
+			continue;
+		}
+
+		// "//.*$" and "#.*(//|$)" go to the end of the block.
+		if (lineRegExp.exactMatch(pattern) && isLiteral(lineRegExp.cap(1))) {
+			Pass pass;
+			pass.kind = LinePass;
+			pass.type = rule.type;
+			pass.delimiter = lineRegExp.cap(1);
+			m_passes.append(pass);
+			continue;
+		}
+
+		// "\".*\"" goes from the first quote to the last one.
+		if (pattern.length() == 4 && pattern.mid(1, 2) == ".*" && pattern.at(0) == pattern.at(3) && isLiteral(pattern.left(1))) {
+			Pass pass;
+			pass.kind = QuotePass;
+			pass.type = rule.type;
+			pass.delimiter = pattern.left(1);
+			m_passes.append(pass);
+			continue;
+		}
+
+		addRegExp(rx, rule.type);
+	}
+}
+
+QHash<QString, Highlighter::FormatType> Highlighter::Syntax::keywords() const
+{
+	QHash<QString, FormatType> keywords;
+	foreach (const Pass& pass, m_passes) {
+		if (pass.kind != WordPass)
+			continue;
+
+		// Later passes win, like they do in the document.
+		QHash<QString, FormatType>::const_iterator it;
+		for (it = pass.words.constBegin(); it != pass.words.constEnd(); ++it)
+			keywords.insert(it.key(), it.value());
+	}
+	return keywords;
+}
+
+void Highlighter::Syntax::addWords(const QStringList& words, FormatType type)
+{
+	if (words.isEmpty())
+		return;
+
+	// Consecutive keyword rules share a single pass, the last rule wins like before.
+	if (m_passes.isEmpty() || m_passes.last().kind != WordPass) {
+		Pass pass;
+		pass.kind = WordPass;
+		pass.type = type;
+		m_passes.append(pass);
+	}
+
+	QHash<QString, FormatType>& table = m_passes.last().words;
+	foreach (const QString& word, words) {
+		table.insert(word, type);
+	}
+}
+
+void Highlighter::Syntax::addRegExp(const QRegExp& pattern, FormatType type)
+{
+	Pass pass;
+	pass.kind = RegExpPass;
+	pass.type = type;
+	pass.pattern = pattern;
+	m_passes.append(pass);
+}
+
+
 // static
 QVector<QTextCharFormat> Highlighter::s_formats;
 
-Highlighter::Highlighter(QTextDocument* parent): QSyntaxHighlighter(parent)
+// Time spent on the pending blocks before going back to the event loop, in ms.
+static const int s_highlightSlice = 10;
+
+Highlighter::Highlighter(QTextDocument* parent): QSyntaxHighlighter(parent), m_syntax(NULL),
+	m_frontier(parent), m_visibleStart(0), m_visibleEnd(-1)
 {
 	if (s_formats.size() == 0)
 		createFormats();
+
+	// Text typed at the frontier is still pending.
+	m_frontier.setKeepPositionOnInsert(true);
+
+	m_pendingTimer.setSingleShot(true);
+	m_pendingTimer.setInterval(0);
+	connect(&m_pendingTimer, SIGNAL(timeout()), this, SLOT(highlightPending()));
+}
+
+void Highlighter::setSyntax(const Syntax* syntax)
+{
+	m_syntax = syntax;
 }
 
-void Highlighter::setRules(const QList<Rule>& rules)
+void Highlighter::setVisibleRange(int start, int end)
 {
-	m_rules = rules;
+	m_visibleStart = start;
+	m_visibleEnd = end;
+
+	if (m_frontier.isNull())
+		return;
+
+	// The comment state of these blocks is a guess until the frontier gets there.
+	QTextBlock block = document()->findBlock(qMax(start, m_frontier.position()));
+	while (block.isValid() && block.position() <= end) {
+		if (block.userState() == PendingState)
+			rehighlightBlock(block);
+		block = block.next();
+	}
 }
 
-void Highlighter::setMultiLineCommentStart(const QString& s)
+bool Highlighter::isPending(const QTextBlock& block) const
 {
-	m_multiLineCommentStart = s;
+	if (m_frontier.isNull() || block.position() < m_frontier.position())
+		return false;
+
+	const bool visible = block.position() <= m_visibleEnd && block.position() + block.length() > m_visibleStart;
+	return !visible;
 }
 
-void Highlighter::setMultiLineCommentEnd(const QString& s)
+/// Move the frontier forward for a slice of time.
+void Highlighter::highlightPending()
 {
-	m_multiLineCommentEnd = s;
+	if (m_frontier.isNull())
+		return;
+
+	QElapsedTimer timer;
+	timer.start();
+
+	QTextBlock block = document()->findBlock(m_frontier.position());
+	while (block.isValid()) {
+		const QTextBlock next = block.next();
+		if (next.isValid())
+			m_frontier.setPosition(next.position());
+		else
+			m_frontier = QTextCursor();
+
+		// The blocks that follow are redone while their state changes, up to the frontier.
+		rehighlightBlock(block);
+		block = next;
+
+		if (timer.elapsed() >= s_highlightSlice)
+			break;
+	}
+
+	if (!m_frontier.isNull())
+		m_pendingTimer.start();
 }
 
 // static
@@ -85,36 +453,88 @@ void Highlighter::createFormats()
 
 void Highlighter::highlightBlock(const QString& text)
 {
-	foreach (Rule rule, m_rules)
+	if (m_syntax == NULL)
+		return;
+
+	if (isPending(currentBlock())) {
+		setCurrentBlockState(PendingState);
+		if (!m_pendingTimer.isActive())
+			m_pendingTimer.start();
+		return;
+	}
+
+	const int length = text.length();
+
+	for (int p = 0; p < m_syntax->m_passes.count(); p++)
 	{
-		int index = text.indexOf(rule.pattern);
-		while (index >= 0)
-		{
-			int length = rule.pattern.matchedLength();
-			setFormat(index, length, s_formats[rule.type]);
-			index = text.indexOf(rule.pattern, index + length);
+		const Syntax::Pass& pass = m_syntax->m_passes.at(p);
+
+		if (pass.kind == Syntax::WordPass) {
+			int i = 0;
+			while (i < length) {
+				if (!isWordChar(text.at(i))) {
+					i++;
+					continue;
+				}
+
+				const int start = i;
+				while (i < length && isWordChar(text.at(i)))
+					i++;
+
+				// Look the identifier up without copying it.
+				const QString word = QString::fromRawData(text.unicode() + start, i - start);
+				QHash<QString, FormatType>::const_iterator it = pass.words.constFind(word);
+				if (it != pass.words.constEnd())
+					setFormat(start, i - start, s_formats[it.value()]);
+			}
+		}
+		else if (pass.kind == Syntax::LinePass) {
+			const int index = text.indexOf(pass.delimiter);
+			if (index >= 0)
+				setFormat(index, length - index, s_formats[pass.type]);
+		}
+		else if (pass.kind == Syntax::QuotePass) {
+			const int first = text.indexOf(pass.delimiter);
+			const int last = text.lastIndexOf(pass.delimiter);
+			if (first >= 0 && last > first)
+				setFormat(first, last - first + 1, s_formats[pass.type]);
+		}
+		else {
+			// QRegExp keeps the last match, so each block works on a copy.
+			QRegExp pattern = pass.pattern;
+			int index = text.indexOf(pattern);
+			while (index >= 0)
+			{
+				int matchLength = pattern.matchedLength();
+				setFormat(index, matchLength, s_formats[pass.type]);
+				index = text.indexOf(pattern, index + qMax(matchLength, 1));
+			}
 		}
 	}
 
-	if (!m_multiLineCommentStart.isEmpty())
-	{
-		setCurrentBlockState(0);
+	const QString& commentStart = m_syntax->m_multiLineCommentStart;
+	const QString& commentEnd = m_syntax->m_multiLineCommentEnd;
 
+	// Not pending anymore, even without multi-line comments.
+	setCurrentBlockState(0);
+
+	if (!commentStart.isEmpty())
+	{
 		int startIndex = 0;
 		if (previousBlockState() != 1)
-			startIndex = text.indexOf(m_multiLineCommentStart);
+			startIndex = text.indexOf(commentStart);
 
 		while (startIndex >= 0) {
-			int endIndex = text.indexOf(m_multiLineCommentEnd, startIndex);
+			int endIndex = text.indexOf(commentEnd, startIndex);
 			int commentLength;
 			if (endIndex == -1) {
 				setCurrentBlockState(1);
 				commentLength = text.length() - startIndex;
 			} else {
-				commentLength = endIndex - startIndex + m_multiLineCommentStart.length();
+				commentLength = endIndex - startIndex + commentStart.length();
 			}
 			setFormat(startIndex, commentLength, s_formats[Comment]);
-			startIndex = text.indexOf(m_multiLineCommentStart, startIndex + commentLength);
+			startIndex = text.indexOf(commentStart, startIndex + commentLength);
 		}
 	}
 }
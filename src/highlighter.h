@@ -23,9 +23,17 @@
 #include <QSyntaxHighlighter>
 #include <QList>
 #include <QVector>
+#include <QHash>
+#include <QRegExp>
 #include <QTextCharFormat>
+#include <QTextCursor>
+#include <QTimer>
 
 
+/// Highlights the blocks in view right away, and the rest of the document in
+/// short slices when the editor is idle. The blocks before the frontier are
+/// highlighted in order, with the right multi-line comment state; the blocks
+/// after it are pending, unless they are in view.
 class Highlighter: public QSyntaxHighlighter
 {
 	Q_OBJECT
@@ -49,19 +57,71 @@ public:
 		FormatType type;
 	};
 
+	/// Rules compiled once, so that each block is scanned in a few linear passes.
+	/// Keyword alternations become a hash of identifiers, the comment, preprocessor
+	/// and string rules become plain searches, and the other rules keep their
+	/// regular expression. The formats are the same as applying the rules in order.
+	class Syntax
+	{
+	public:
+		Syntax(const QList<Rule>& rules, const QString& multiLineCommentStart, const QString& multiLineCommentEnd);
+
+		// All the words of the keyword rules, for the completer.
+		QHash<QString, FormatType> keywords() const;
+
+	private:
+		friend class Highlighter;
+
+		enum PassType {
+			WordPass,	// Identifiers found in words.
+			LinePass,	// From the first delimiter to the end of the block.
+			QuotePass,	// From the first delimiter to the last one.
+			RegExpPass
+		};
+
+		struct Pass
+		{
+			PassType kind;
+			FormatType type;
+			QHash<QString, FormatType> words;
+			QString delimiter;
+			QRegExp pattern;
+		};
+
+		void addWords(const QStringList& words, FormatType type);
+		void addRegExp(const QRegExp& pattern, FormatType type);
+
+		QList<Pass> m_passes;
+		QString m_multiLineCommentStart;
+		QString m_multiLineCommentEnd;
+	};
+
     Highlighter(QTextDocument* parent);
 
-	void setRules(const QList<Rule>& rules);
-	void setMultiLineCommentStart(const QString& s);
-	void setMultiLineCommentEnd(const QString& s);
+	// The syntax is not owned, it's shared by all the documents of a kind.
+	void setSyntax(const Syntax* syntax);
+
+public slots:
+	// Document positions shown by the editor.
+	void setVisibleRange(int start, int end);
 
 protected:
 	void highlightBlock(const QString& text);
 
+private slots:
+	void highlightPending();
+
 private:
-	QList<Rule> m_rules;
-	QString m_multiLineCommentStart;
-	QString m_multiLineCommentEnd;
+	enum { PendingState = -2 };
+
+	bool isPending(const QTextBlock& block) const;
+
+	const Syntax* m_syntax;
+
+	QTextCursor m_frontier;	// Null once the whole document is done.
+	QTimer m_pendingTimer;
+	int m_visibleStart;
+	int m_visibleEnd;
 
 	static QVector<QTextCharFormat> s_formats; // idx is FormatType
 	static void createFormats();
@@ -18,8 +18,11 @@
 */
 
 #include "imageplugin.h"
+#include "floatimage.h"
 
 #include <QList>
+#include <QFile>
+#include <QFileInfo>
 //#include <QImage>
 #include <QImageReader>
 
@@ -29,36 +32,28 @@ namespace
 	static QList<const ImagePlugin *> * s_pluginList = NULL;
 	
 	
-	// Taken from Qt, but do not mirror.
-	static QImage convertToBGRA(const QImage &image)
+	// Use the pixels as they are when GL can read them, convert them otherwise.
+	static void setPixels(TextureImage * texture, const QImage & image)
 	{
-		QImage img = image;
-		if (image.format() != QImage::Format_ARGB32) {
-			img = image.convertToFormat(QImage::Format_ARGB32);
-		}
-		
-		if (QSysInfo::ByteOrder == QSysInfo::BigEndian) {
-			// mirror + swizzle
-			QImage res = img.copy();
-			for (int i=0; i < img.height(); i++) {
-				uint *p = (uint*) img.scanLine(i);
-			//	uint *q = (uint*) res.scanLine(img.height() - i - 1);
-				uint *q = (uint*) res.scanLine(i);
-				uint *end = p + img.width();
-				while (p < end) {
-					*q = ((*p << 24) & 0xff000000)
-						 | ((*p >> 24) & 0x000000ff)
-						 | ((*p << 8) & 0x00ff0000)
-						 | ((*p >> 8) & 0x0000ff00);
-					p++;
-					q++;
-				}
-			}
-			return res;
-		}
-		else {
-			return img;
-		//	return img.mirrored();
+		switch (image.format()) {
+			case QImage::Format_RGBA8888:
+			case QImage::Format_RGBX8888:
+				texture->pixels = image;
+				texture->format = GL_RGBA;
+				texture->type = GL_UNSIGNED_BYTE;
+				break;
+			case QImage::Format_ARGB32:
+			case QImage::Format_RGB32:
+				// 0xAARRGGBB words, whatever the byte order.
+				texture->pixels = image;
+				texture->format = GL_BGRA;
+				texture->type = GL_UNSIGNED_INT_8_8_8_8_REV;
+				break;
+			default:
+				texture->pixels = image.convertToFormat(QImage::Format_ARGB32);
+				texture->format = GL_BGRA;
+				texture->type = GL_UNSIGNED_INT_8_8_8_8_REV;
+				break;
 		}
 	}
 	
@@ -74,14 +69,19 @@ namespace
 } // namespace
 
 
-// @@ Add plugin priorities. Use sorted list.
 void ImagePluginManager::addPlugin(const ImagePlugin * plugin)
 {
 	Q_ASSERT(plugin != NULL);
 	if( s_pluginList == NULL ) {
 		s_pluginList = new QList<const ImagePlugin *>();
 	}
-	s_pluginList->append(plugin);
+	
+	// Keep the list sorted by priority, in registration order otherwise.
+	int index = 0;
+	while (index < s_pluginList->count() && s_pluginList->at(index)->priority() >= plugin->priority()) {
+		index++;
+	}
+	s_pluginList->insert(index, plugin);
 }
 
 void ImagePluginManager::removePlugin(const ImagePlugin * plugin)
@@ -111,65 +111,142 @@ QList<QByteArray> ImagePluginManager::supportedFormats()
 	return list;
 }
 
-QImage ImagePluginManager::load(QString name, GLuint obj, GLuint * target)
+TextureImage ImagePluginManager::decode(QString name, int maxTextureSize)
 {
+	TextureImage texture;
+	
 	if (s_pluginList != NULL) {
 		foreach(const ImagePlugin * plugin, *s_pluginList) {
-			if (plugin->canLoad(name)) {
-				return plugin->load(name, obj, target);
+			if (!plugin->canLoad(name)) {
+				continue;
+			}
+			if (plugin->load(name, &texture)) {
+				break;
 			}
+			// Give the next plugin a chance.
+			texture = TextureImage();
 		}
 	}
-
-	return QImage();
-}
-
-
-// @@ Add dds plugin.
-// @@ Add exr plugin.
-// @@ Add hdr plugin.
-
-
-static void updateOpenGLImage(QImage image, GLuint obj, GLuint * target)
-{
-	QImage glImage = convertToBGRA(image);
-
-	int w = glImage.width();
-	int h = glImage.height();
-
+	
+	if (!texture.levels.isEmpty()) {
+		// Drop the levels that don't fit, if there are smaller ones.
+		while (texture.levels.count() > 1 && qMax(texture.levels.first().width, texture.levels.first().height) > maxTextureSize) {
+			texture.levels.removeFirst();
+		}
+		if (qMax(texture.levels.first().width, texture.levels.first().height) > maxTextureSize) {
+			return TextureImage();
+		}
+		return texture;
+	}
+	
+	if (texture.image.isNull()) {
+		return texture;
+	}
+	
+	int w = texture.image.width();
+	int h = texture.image.height();
+	
 	// Resize texture if NP2 not supported.
 	if (!GLEW_ARB_texture_non_power_of_two) {
 		w = nextPowerOfTwo(w);
 		h = nextPowerOfTwo(h);
 	}
-
+	
 	// Clamp to maximum texture size.
-	GLint maxTextureSize = 256;
-	glGetIntegerv( GL_MAX_TEXTURE_SIZE, &maxTextureSize );
-	if (w > maxTextureSize ) w = maxTextureSize;
-	if (h > maxTextureSize ) h = maxTextureSize;
-
-	if (glImage.width() != w || glImage.height() != h) {
-		glImage = glImage.scaled(w, h);
+	if (w > maxTextureSize) w = maxTextureSize;
+	if (h > maxTextureSize) h = maxTextureSize;
+	
+	if (texture.image.width() != w || texture.image.height() != h) {
+		setPixels(&texture, texture.image.scaled(w, h));
 	}
+	else {
+		setPixels(&texture, texture.image);
+	}
+	
+	return texture;
+}
 
+void ImagePluginManager::upload(const TextureImage & texture, GLuint obj, GLuint * target)
+{
+	Q_ASSERT(obj != 0);
+	Q_ASSERT(target != NULL);
+	
 	*target = GL_TEXTURE_2D;
 	glBindTexture(GL_TEXTURE_2D, obj);
-
+	
+	if (!texture.levels.isEmpty()) {
+		glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+		for (int i = 0; i < texture.levels.count(); i++) {
+			uploadLevel(texture, i, texture.data.constData() + texture.levels.at(i).offset);
+		}
+		setupLevels(texture);
+		ReportGLErrors();
+		return;
+	}
+	
+	const QImage & glImage = texture.pixels;
+	
 	if (GLEW_SGIS_generate_mipmap || GLEW_VERSION_1_4) {
 		glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
-		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, glImage.width(), glImage.height(), 0, GL_BGRA, GL_UNSIGNED_BYTE, glImage.bits());
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA, glImage.width(), glImage.height(), 0, texture.format, texture.type, glImage.bits());
 	}
 	else {
-		gluBuild2DMipmaps(GL_TEXTURE_2D, 4, glImage.width(), glImage.height(), GL_BGRA, GL_UNSIGNED_BYTE, glImage.bits());
+		gluBuild2DMipmaps(GL_TEXTURE_2D, 4, glImage.width(), glImage.height(), texture.format, texture.type, glImage.bits());
 	}
-
+	
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR_MIPMAP_LINEAR);
 	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-
+	
 	ReportGLErrors();
 }
 
+QImage ImagePluginManager::load(QString name, GLuint obj, GLuint * target)
+{
+	GLint maxTextureSize = 256;
+	glGetIntegerv(GL_MAX_TEXTURE_SIZE, &maxTextureSize);
+	
+	TextureImage texture = decode(name, maxTextureSize);
+	if (!texture.isNull()) {
+		upload(texture, obj, target);
+	}
+	
+	return texture.image;
+}
+
+void ImagePluginManager::uploadLevel(const TextureImage & texture, int index, const GLvoid * data)
+{
+	const TextureLevel & level = texture.levels.at(index);
+	
+	if (texture.compressed) {
+		glCompressedTexImage2D(GL_TEXTURE_2D, index, texture.internalFormat, level.width, level.height, 0, level.size, data);
+	}
+	else {
+		glTexImage2D(GL_TEXTURE_2D, index, texture.internalFormat, level.width, level.height, 0, texture.format, texture.type, data);
+	}
+}
+
+/// Set the level range and filters once all the levels are uploaded.
+void ImagePluginManager::setupLevels(const TextureImage & texture)
+{
+	bool mipmapped = texture.levels.count() > 1;
+	
+	// Complete the chain of uncompressed images without mipmaps.
+	if (!mipmapped && !texture.compressed && (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object)) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+		mipmapped = true;
+	}
+	else {
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, texture.levels.count() - 1);
+	}
+	
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+}
+
+
+// @@ Add exr plugin.
+
+
 // Image plugin that supports all the image types that Qt supports.
 class QtImagePlugin : public ImagePlugin
 {
@@ -186,26 +263,20 @@ public:
 		return true;
 	}
 	
-	virtual QImage load(const QString & name, GLuint obj, GLuint * target) const
+	virtual bool load(const QString & name, TextureImage * texture) const
 	{
-		Q_ASSERT(obj != 0);
-		Q_ASSERT(target != NULL);
-		
-		QImage image;
+		QImage & image = texture->image;
 		if( name.isEmpty() || !image.load(name) ) {
 			image.load(":/images/default.png");
 		}
-
-		updateOpenGLImage(image, obj, target);
 		
-		return image;
+		return !image.isNull();
 	}
 };
 
 REGISTER_IMAGE_PLUGIN(QtImagePlugin);
 
 
-#define STBI_NO_HDR
 #include "stb_image.c"
 
 class StbImagePlugin : public ImagePlugin
@@ -217,42 +288,88 @@ class StbImagePlugin : public ImagePlugin
 
 	virtual bool canLoad(const QString & fileName) const
 	{
-		Q_UNUSED(fileName);
-		return true;
-
-		//QByteArray name = fileName.toLatin1();
-		//int x, y, comp;
-		//return stbi_info(name.data(), &x, &y, &comp) != 0;
+		const QString suffix = QFileInfo(fileName).suffix().toLower();
+		return supportedFormats().contains(suffix.toLatin1());
 	}
 
-	virtual QImage load(const QString & fileName, GLuint obj, GLuint * target) const
+	virtual int priority() const
 	{
-		Q_ASSERT(obj != 0);
-		Q_ASSERT(target != NULL);
+		return 1;
+	}
 
-		QByteArray name = fileName.toLatin1();
+	virtual bool load(const QString & fileName, TextureImage * texture) const
+	{
+		QByteArray name = QFile::encodeName(fileName);
 
 		int w, h, comp;
 		unsigned char * data = stbi_load(name.data(), &w, &h, &comp, 4);
 
 		if (data == NULL) {
-			return QImage();
+			return false;
 		}
 
-		QImage image(w, h, QImage::Format_ARGB32);
+		// Wrap the decoder's buffer, it's freed with the last copy of the image.
+		texture->image = QImage(data, w, h, 4 * w, QImage::Format_RGBA8888, stbi_image_free, data);
 
-		for (int y = 0; y < h; y++) {
-			for (int x = 0; x < w; x++) {
-				QRgb value = qRgba(data[0], data[1], data[2], data[3]);
-				image.setPixel(x, y, value);
-				data += 4;
-			}
+		return true;
+	}
+};
+
+REGISTER_IMAGE_PLUGIN(StbImagePlugin);
+
+
+// Radiance HDR images. They skip QImage and are uploaded as float textures,
+// with the mipmaps built in the loader thread.
+class HdrImagePlugin : public ImagePlugin
+{
+	virtual QList<QByteArray> supportedFormats() const
+	{
+		return QList<QByteArray>() << "hdr";
+	}
+
+	virtual bool canLoad(const QString & fileName) const
+	{
+		return QFileInfo(fileName).suffix().compare("hdr", Qt::CaseInsensitive) == 0;
+	}
+
+	virtual int priority() const
+	{
+		return 1;
+	}
+
+	virtual bool load(const QString & fileName, TextureImage * texture) const
+	{
+		QByteArray name = QFile::encodeName(fileName);
+
+		int w, h, comp;
+		float * data = stbi_loadf(name.data(), &w, &h, &comp, 4);
+
+		if (data == NULL) {
+			return false;
 		}
 
-		updateOpenGLImage(image, obj, target);
+		// Shared exponents take half the memory, and HDR files have no alpha anyway.
+		if (GLEW_EXT_texture_shared_exponent || GLEW_VERSION_3_0) {
+			texture->internalFormat = GL_RGB9_E5;
+			texture->format = GL_RGB;
+			texture->type = GL_UNSIGNED_INT_5_9_9_9_REV;
+			FloatImage::buildMipmaps(texture, data, w, h);
+		}
+		else if (GLEW_ARB_texture_float && GLEW_ARB_half_float_pixel) {
+			texture->internalFormat = GL_RGBA16F_ARB;
+			texture->format = GL_RGBA;
+			texture->type = GL_HALF_FLOAT_ARB;
+			FloatImage::buildMipmaps(texture, data, w, h);
+		}
+		else {
+			// No float textures, use the tone mapped image.
+			texture->image = FloatImage::preview(data, w, h);
+		}
 
-		return image;
+		stbi_image_free(data);
+
+		return true;
 	}
 };
 
-REGISTER_IMAGE_PLUGIN(StbImagePlugin);
+REGISTER_IMAGE_PLUGIN(HdrImagePlugin);
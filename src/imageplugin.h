@@ -24,6 +24,39 @@
 
 #include <QString>
 #include <QImage>
+#include <QByteArray>
+#include <QList>
+
+
+/// Mipmap level stored in TextureImage::data.
+struct TextureLevel
+{
+	int width;
+	int height;
+	int offset;
+	int size;
+};
+
+
+/// Texture data decoded by an image plugin. Decoding doesn't touch GL, so
+/// it can happen in any thread; only the upload needs a context.
+struct TextureImage
+{
+	TextureImage() : internalFormat(GL_RGBA8), format(GL_BGRA), type(GL_UNSIGNED_BYTE), compressed(false) {}
+	
+	bool isNull() const { return pixels.isNull() && levels.isEmpty(); }
+	
+	QImage image;	// As loaded, for the previews.
+	QImage pixels;	// Resized to fit the texture limits, in format and type.
+	
+	// Containers with precomputed levels are uploaded as they are, without conversion.
+	GLenum internalFormat;
+	GLenum format;
+	GLenum type;
+	bool compressed;
+	QByteArray data;
+	QList<TextureLevel> levels;
+};
 
 
 // Image plugin interface.
@@ -33,7 +66,10 @@ public:
 	virtual ~ImagePlugin() {}
 	virtual QList<QByteArray> supportedFormats() const = 0;
 	virtual bool canLoad(const QString & name) const = 0;
-	virtual QImage load(const QString & name, GLuint obj, GLuint * target) const = 0;
+	// Plugins with a higher priority are asked first.
+	virtual int priority() const { return 0; }
+	// Fill either the image or the levels. Must be thread safe, textures are decoded by the loader threads.
+	virtual bool load(const QString & name, TextureImage * texture) const = 0;
 };
 
 
@@ -45,7 +81,16 @@ namespace ImagePluginManager
 
 	QList<QByteArray> supportedFormats();
 	
-	QImage load(QString name, GLuint obj, GLuint * target);	
+	// Thread safe. The maximum size is the one of the context that will upload the image.
+	TextureImage decode(QString name, int maxTextureSize);
+	
+	// These need a current context.
+	void upload(const TextureImage & image, GLuint obj, GLuint * target);
+	QImage load(QString name, GLuint obj, GLuint * target);
+	
+	// Upload one of the precomputed levels to the bound texture, data can be a pixel buffer offset.
+	void uploadLevel(const TextureImage & image, int level, const GLvoid * data);
+	void setupLevels(const TextureImage & image);
 };
 
 
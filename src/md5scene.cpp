@@ -1,6 +1,17 @@
 #include "md5scene.h"
 #include "effect.h"
 
+#include <QDir>
+#include <QFileInfo>
+#include <QRunnable>
+
+#include <string.h>
+
+#if defined(__SSE__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 1)
+#define MD5_USE_SSE
+#include <xmmintrin.h>
+#endif
+
 void quatFromVec (vec3_t vec, quat_t quat)
 {
 	quat[0] = 0;
@@ -135,123 +146,119 @@ vec_t VectorNormalize(vec3_t v)
 	return length;
 }
 
-parsingFile::parsingFile(const char* filename)
+parsingFile::parsingFile(const QString & filename) :
+	file(filename),
+	current(NULL),
+	end(NULL)
 {
-	if (!filename)
-		return;
-
-	FILE* file = fopen(filename, "r");
-	if (!file)
+	if (!file.open(QIODevice::ReadOnly))
 		return;
 
-	fseek(file, SEEK_END, SEEK_END);
-	unsigned long fileSize = ftell(file);
-	fseek(file, SEEK_SET, SEEK_SET);
-
-	string = (char*)malloc(fileSize);
-	if (!string)
-		return;
-
-	memset(string, 0, fileSize);
-	fread(string, fileSize, 1, file);
-	fclose(file);
-
-	index = 0;
-}
+	const qint64 size = file.size();
+	const char* data = (const char*)file.map(0, size);
+	if (!data)
+	{
+		// Mapping is not supported everywhere, read the file instead.
+		buffer = file.readAll();
+		data = buffer.constData();
+	}
 
-parsingFile::~parsingFile()
-{
-	free(string);
+	current = data;
+	end = data + size;
 }
 
-const char* parsingFile::getNextToken()
+token_t parsingFile::getNextToken()
 {
-	if (!string)
-		return NULL;
-
-	char result[1024];
-	char token[1024];
-	char actualChar;
-	int len;
+	token_t token;
+	token.begin = NULL;
+	token.length = 0;
 
-	memset(token, 0, 1024);
-	memset(result, 0, 1024);
+	if (!current)
+		return token;
 
-	actualChar = string[index];
-	while (actualChar)
+	while (current < end)
 	{
-		// We have a comment here, take everything until the end of the line
-		if (actualChar == '/' && string[index + 1] == '/')
+		const char c = *current;
+
+		// Tab, WhiteSpace, newline - separate the tokens
+		if (c == ' ' || c == '\t' || c == '\n' || c == '\r')
 		{
-			// Next Character is a slash too
-			index++;
-			while (actualChar != '\n')
-				actualChar = string[++index];
+			current++;
+			continue;
+		}
 
-			actualChar = string[++index];
+		// We have a comment here, skip everything until the end of the line
+		if (c == '/' && current + 1 < end && current[1] == '/')
+		{
+			const char* eol = (const char*)memchr(current, '\n', end - current);
+			current = eol ? eol + 1 : end;
 			continue;
 		}
-		else
+
 		// Double Quotes, means a full string until the next double quotes
-		if (actualChar == '\"')
+		if (c == '\"')
 		{
-			actualChar = string[++index];
-
-			if (actualChar == '\"')
-				actualChar = string[++index];
-			else
-			while (actualChar && actualChar != '\"')
-			{
-				len = strlen(token);
-				token[len] = actualChar;
+			const char* begin = current + 1;
+			const char* quote = (const char*)memchr(begin, '\"', end - begin);
+			const char* last = quote ? quote : end;
+
+			token.begin = begin;
+			token.length = last - begin;
+			current = quote ? quote + 1 : end;
+			return token;
+		}
 
-				actualChar = string[++index];
-			}
+		token.begin = current;
+		while (current < end && *current != ' ' && *current != '\t' && *current != '\n' && *current != '\r')
+			current++;
+		token.length = current - token.begin;
+		return token;
+	}
 
-			if (actualChar == '\"')
-				actualChar = string[++index];
-		}
-		
-		// Tab, WhiteSpace, newline - breaks the string
-		if (actualChar == ' ' || actualChar == '\t' || actualChar == '\n')
-		{
-			actualChar = string[++index];
-			
-			// If our token is empty, continue looking.
-			// We dont want to spend time here
-			if (!token[0])
-				continue;
-			else
-				break;
-		}
+	return token;
+}
 
-		// Insert Character into "Token"
-		len = strlen(token);
-		token[len] = actualChar;
+bool parsingFile::skipTo(const char* text)
+{
+	token_t token = getNextToken();
+	while (token.begin && !tokenIs(token, text))
+		token = getNextToken();
 
-		actualChar = string[++index];
-	}
+	return token.begin != NULL;
+}
 
-	len = strlen(token);
-	if (!len)
-		result[0] = '\0';
+// static
+bool parsingFile::tokenIs(const token_t & token, const char* text)
+{
+	const int len = strlen(text);
+	return token.begin && token.length == len && memcmp(token.begin, text, len) == 0;
+}
 
-	if (len > 1024)
-	{
-		strncpy(result, token, 1024);
-		result[1024] = 0;
-	}
-	else
-	{
-		strncpy(result, token, len);
-		result[len] = 0;
-	}
+// static
+int parsingFile::tokenToInt(const token_t & token)
+{
+	if (!token.begin)
+		return 0;
+	return QByteArray::fromRawData(token.begin, token.length).toInt();
+}
 
-	return result;
+// static
+float parsingFile::tokenToFloat(const token_t & token)
+{
+	if (!token.begin)
+		return 0.0f;
+	return QByteArray::fromRawData(token.begin, token.length).toFloat();
 }
 
-md5Scene::md5Scene()
+md5Scene::md5Scene() :
+	scale(1.0f),
+	numBones(0),
+	bones(NULL),
+	numFrames(0),
+	frameRate(24)
 {
+	VectorClear(position);
+
 	QString fileName = QFileDialog::getOpenFileName(NULL, QObject::tr("Open File"), 
 			SceneFactory::lastFile(), QString(QObject::tr("md5mesh (%1)")).arg("*.md5mesh"));
 
@@ -265,19 +272,35 @@ md5Scene::md5Scene()
 
 md5Scene::~md5Scene()
 {
+	skinningPool.waitForDone();
+
+	qDeleteAll(gpuMeshList);
+	qDeleteAll(skinList);
+
 	foreach (mesh_t * mesh, meshList)
 	{
-		free(mesh->normalList);
-		free(mesh->indexList);
 		free(mesh->tris);
 		free(mesh->weights);
 		free(mesh->vertex);
-		delete mesh;
+		free(mesh);
 	}
+	free(bones);
 }
 
 void md5Scene::transform() const
-{}
+{
+	// md5 models are Z up
+	glRotated(270.0, 1.0, 0.0, 0.0);
+	glScalef(scale, scale, scale);
+	glTranslatef(-position[0], -position[1], -position[2]);
+}
+
+// Skin the meshes once per frame, so that all the passes draw the same pose.
+void md5Scene::update()
+{
+	if (numFrames > 1)
+		skin();
+}
 
 void md5Scene::draw(Effect* effect) const
 {
@@ -285,411 +308,724 @@ void md5Scene::draw(Effect* effect) const
 	if (!meshList.size())
 		return;
 
-	foreach (const mesh_t * mesh, meshList)
+	foreach (const Mesh * mesh, gpuMeshList)
 	{
-		float scale = 0.05;
-		glScalef(scale, scale, scale);
-
 		if(effect) 
 			effect->beginMaterialGroup();
 
-		// Draw Mesh
-		glEnableClientState(GL_VERTEX_ARRAY);
-		glVertexPointer(3, GL_FLOAT, sizeof(vert_t), mesh->vertex[0].basePos);
+		mesh->draw();
+	}
+}
 		
-		glEnableClientState(GL_NORMAL_ARRAY);
-		glNormalPointer(GL_FLOAT, 0, mesh->normalList);
+// Look for the animation of the model next to it, same name first.
+static QString findAnim(const QString & filename)
+{
+	QFileInfo info(filename);
 
-		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
-		glTexCoordPointer(2, GL_FLOAT, sizeof(vert_t), mesh->vertex[0].uv);
+	QString sameName = info.dir().filePath(info.completeBaseName() + ".md5anim");
+	if (QFile::exists(sameName))
+		return sameName;
 
-		glDrawElements(GL_TRIANGLES, mesh->numTris*3, GL_UNSIGNED_INT, mesh->indexList);
-	}
+	QStringList anims = info.dir().entryList(QStringList("*.md5anim"), QDir::Files, QDir::Name);
+	if (!anims.isEmpty())
+		return info.dir().filePath(anims.first());
+
+	return QString();
 }
-		
+
 void md5Scene::load(QString filename)
 {
-	parsingFile file(filename.toAscii().data());
-	
-	const char* token;
-	const char* param;
+	parsingFile file(filename);
+	if (!file.isOpen())
+		return;
 
-	token = file.getNextToken();
-	while(token[0])
+	token_t token = file.getNextToken();
+	while (token.begin)
 	{
-		if (!strcmp(token, "mesh"))
+		if (parsingFile::tokenIs(token, "mesh"))
 		{
-			mesh_t* thisMesh = new mesh_t;
+			mesh_t* thisMesh = loadMesh(file);
 			if (!thisMesh)
 				return;
 
-			// Get The number of vertices and allocate
-			param = file.getNextToken();
-			while (strcmp(param, "numverts"))
-				param = file.getNextToken();
-
-			param = file.getNextToken();
-			thisMesh->numVerts = atoi(param);
-			if (!thisMesh->numVerts)
+			meshList.push_back(thisMesh);
+		}
+		else
+		if (parsingFile::tokenIs(token, "numJoints"))
+		{
+			numBones = parsingFile::tokenToInt(file.getNextToken());
+			if (numBones <= 0)
 			{
-				delete thisMesh;
+				numBones = 0;
 				return;
 			}
-			else
-			{
-				int i;
 
-				thisMesh->vertex = (vert_t*)malloc(sizeof(vert_t)*thisMesh->numVerts);
-				if (!thisMesh->vertex)
-				{
-					delete thisMesh;
-					continue;
-				}
-				else
-				for (i = 0; i < thisMesh->numVerts; i++)
-				{
-					param = file.getNextToken();
-					if (strcmp(param, "vert"))
-						break;
-
-					// Should Get Index
-					param = file.getNextToken();
-
-					// UV DATA
-					param = file.getNextToken(); // (
-					param = file.getNextToken();
-					thisMesh->vertex[i].uv[0] = atof(param);
-					param = file.getNextToken();
-					thisMesh->vertex[i].uv[1] = atof(param);
-					param = file.getNextToken(); // )
-
-					// Weight Data
-					param = file.getNextToken();
-					thisMesh->vertex[i].weight[0] = atoi(param);
-					param = file.getNextToken();
-					thisMesh->vertex[i].weight[1] = atoi(param);
-
-					// Clean normals
-					VectorClear(thisMesh->vertex[i].baseNormal);
-				}
+			free(bones);
+			bones = (bone_t*)calloc(numBones, sizeof(bone_t));
+			if (!bones)
+			{
+				numBones = 0;
+				return;
 			}
+		}
+		else
+		if (parsingFile::tokenIs(token, "joints"))
+		{
+			if (!bones || !loadJoints(file))
+				return;
+		}
+		token = file.getNextToken();
+	}
 
-			param = file.getNextToken();
-			while (strcmp(param, "numtris"))
-				param = file.getNextToken();
+	compileBase();
 
-			param = file.getNextToken();
-			thisMesh->numTris = atoi(param);
-			if (!thisMesh->numTris)
-			{
-				free(thisMesh->vertex);
-				delete thisMesh;
+	QString animName = findAnim(filename);
+	if (!animName.isEmpty() && loadAnim(animName))
+		skin();
+}
 
-				return;
-			}
-			else
-			{
-				int i;
+bool md5Scene::loadJoints(parsingFile & file)
+{
+	token_t param = file.getNextToken(); // {
+	for (int i = 0; i < numBones; i++)
+	{
+		float x, y, z;
 
-				thisMesh->tris = (triangle_t*)malloc(sizeof(triangle_t)*thisMesh->numTris);
-				memset(thisMesh->tris, 0, sizeof(triangle_t)*thisMesh->numTris);
-				if (!thisMesh->tris)
-				{
-					free(thisMesh->vertex);
-					delete thisMesh;
+		// Name
+		param = file.getNextToken();
 
-					return;
-				}
-				else
-				for (i = 0; i < thisMesh->numTris; i++)
-				{
-					param = file.getNextToken();
-					if (strcmp(param, "tri"))
-						break;
-
-					param = file.getNextToken(); // index
-					param = file.getNextToken();
-					thisMesh->tris[i].index[0] = atoi(param);
-					param = file.getNextToken();
-					thisMesh->tris[i].index[1] = atoi(param);
-					param = file.getNextToken();
-					thisMesh->tris[i].index[2] = atoi(param);
-				}
-			}
+		// Index
+		bones[i].index = i;
 
-			// Read Weight Data
-			param = file.getNextToken();
-			while (strcmp(param, "numweights"))
-				param = file.getNextToken();
+		// Parent
+		bones[i].parentIndex = parsingFile::tokenToInt(file.getNextToken());
 
-			param = file.getNextToken();
-			thisMesh->numWeight = atoi(param);
-			if (!thisMesh->numWeight)
-			{
-				free(thisMesh->vertex);
-				free(thisMesh->tris);
-				delete thisMesh;
+		param = file.getNextToken(); // (
+		bones[i].pos[0] = parsingFile::tokenToFloat(file.getNextToken());
+		bones[i].pos[1] = parsingFile::tokenToFloat(file.getNextToken());
+		bones[i].pos[2] = parsingFile::tokenToFloat(file.getNextToken());
+		param = file.getNextToken(); // )
 
-				return;
-			}
-			else
-			{
-				thisMesh->weights = (weight_t*)malloc(sizeof(weight_t)*thisMesh->numWeight);
-				memset(thisMesh->weights, 0, sizeof(weight_t)*thisMesh->numWeight);
-				if (!thisMesh->weights)
-				{
-					free(thisMesh->vertex);
-					free(thisMesh->tris);
-					delete thisMesh;
+		param = file.getNextToken(); // (
+		x = parsingFile::tokenToFloat(file.getNextToken());
+		y = parsingFile::tokenToFloat(file.getNextToken());
+		z = parsingFile::tokenToFloat(file.getNextToken());
+		param = file.getNextToken(); // )
 
-					return;
-				}
-				else
-				{
-					int i;
-					for (i = 0; i < thisMesh->numWeight; i++)
-					{
-						param = file.getNextToken();
-						if (strcmp(param, "weight"))
-							break;
-
-						param = file.getNextToken(); // index
-						param = file.getNextToken();
-						thisMesh->weights[i].jointIndex = atoi(param);
-
-						param = file.getNextToken();
-						thisMesh->weights[i].value = atof(param);
-
-						param = file.getNextToken(); // (
-						param = file.getNextToken();
-						thisMesh->weights[i].pos[0] = atof(param);
-						param = file.getNextToken();
-						thisMesh->weights[i].pos[1] = atof(param);
-						param = file.getNextToken();
-						thisMesh->weights[i].pos[2] = atof(param);
-						param = file.getNextToken(); // )
-					}
-				}
-			}
+		if (!param.begin || bones[i].parentIndex < -1 || bones[i].parentIndex >= numBones)
+			return false;
 
-			thisMesh->normalList = 0;
-			thisMesh->indexList = 0;
-			meshList.push_back(thisMesh);
-		}
-		else
-		if (!strcmp(token, "numJoints"))
+		quatFromMD5(x, y, z, bones[i].orientation);
+
+		VectorCopy(bones[i].pos, bones[i].basePos);
+		quatCopy(bones[i].orientation, bones[i].baseOrientation);
+	}
+	param = file.getNextToken(); // }
+
+	return true;
+}
+
+mesh_t* md5Scene::loadMesh(parsingFile & file)
+{
+	mesh_t* thisMesh = (mesh_t*)calloc(1, sizeof(mesh_t));
+	if (!thisMesh)
+		return NULL;
+
+	bool valid = false;
+
+	// Get The number of vertices and allocate
+	if (file.skipTo("numverts"))
+	{
+		thisMesh->numVerts = parsingFile::tokenToInt(file.getNextToken());
+		if (thisMesh->numVerts > 0)
+			thisMesh->vertex = (vert_t*)calloc(thisMesh->numVerts, sizeof(vert_t));
+
+		valid = thisMesh->vertex != NULL;
+		for (int i = 0; valid && i < thisMesh->numVerts; i++)
 		{
-			param = file.getNextToken();
-			numBones = atoi(param);
+			valid = parsingFile::tokenIs(file.getNextToken(), "vert");
+			if (!valid)
+				break;
 
-			if (!numBones)
-			{
-				numBones = 0;
-				bones = 0;
-				return;
-			}
+			// Should Get Index
+			file.getNextToken();
 
-			printf("Number of Bones %d\n", numBones);
+			// UV DATA
+			file.getNextToken(); // (
+			thisMesh->vertex[i].uv[0] = parsingFile::tokenToFloat(file.getNextToken());
+			thisMesh->vertex[i].uv[1] = parsingFile::tokenToFloat(file.getNextToken());
+			file.getNextToken(); // )
 
-			bones = (bone_t*)malloc(sizeof(bone_t)*numBones);
-			memset(bones, 0, sizeof(bone_t)*numBones);
+			// Weight Data
+			thisMesh->vertex[i].weight[0] = parsingFile::tokenToInt(file.getNextToken());
+			thisMesh->vertex[i].weight[1] = parsingFile::tokenToInt(file.getNextToken());
 		}
-		else
-		if (!strcmp(token, "joints"))
+	}
+
+	if (valid && file.skipTo("numtris"))
+	{
+		thisMesh->numTris = parsingFile::tokenToInt(file.getNextToken());
+		if (thisMesh->numTris > 0)
+			thisMesh->tris = (triangle_t*)calloc(thisMesh->numTris, sizeof(triangle_t));
+
+		valid = thisMesh->tris != NULL;
+		for (int i = 0; valid && i < thisMesh->numTris; i++)
 		{
-			if (!bones)
-				return;
+			valid = parsingFile::tokenIs(file.getNextToken(), "tri");
+			if (!valid)
+				break;
 
-			param = file.getNextToken(); // {
-			for (int i = 0; i < numBones; i++)
+			file.getNextToken(); // index
+			for (int k = 0; k < 3; k++)
 			{
-				int len;
-				float x, y, z;
-
-				// Name
-				param = file.getNextToken();
-
-				// Index
-				bones[i].index = i;
-
-				// Parent
-				param = file.getNextToken();
-				bones[i].parentIndex = atoi(param);
-
-				param = file.getNextToken(); // (
-				param = file.getNextToken();
-				bones[i].pos[0] = atof(param);
-				param = file.getNextToken();
-				bones[i].pos[1] = atof(param);
-				param = file.getNextToken();
-				bones[i].pos[2] = atof(param);
-				param = file.getNextToken(); // )
-
-				param = file.getNextToken(); // (
-				param = file.getNextToken();
-				x = atof(param);
-				param = file.getNextToken();
-				y = atof(param);
-				param = file.getNextToken();
-				z = atof(param);
-				param = file.getNextToken(); // )
-				
-				printf("Bone %d  ( %f %f %f ) ( %f %f %f )\n", i, bones[i].pos[0], bones[i].pos[1], bones[i].pos[2],
-						x, y, z);
-
-				quatFromMD5(x, y, z, bones[i].orientation);
-
-				VectorCopy(bones[i].pos, bones[i].basePos);
-				quatCopy(bones[i].orientation, bones[i].baseOrientation);
+				int index = parsingFile::tokenToInt(file.getNextToken());
+				valid = valid && index >= 0 && index < thisMesh->numVerts;
+				thisMesh->tris[i].index[k] = index;
 			}
-			param = file.getNextToken(); // }
 		}
-		token = file.getNextToken();
 	}
+	else
+		valid = false;
 
-	compileBase();
+	// Read Weight Data
+	if (valid && file.skipTo("numweights"))
+	{
+		thisMesh->numWeight = parsingFile::tokenToInt(file.getNextToken());
+		if (thisMesh->numWeight > 0)
+			thisMesh->weights = (weight_t*)calloc(thisMesh->numWeight, sizeof(weight_t));
+
+		valid = thisMesh->weights != NULL;
+		for (int i = 0; valid && i < thisMesh->numWeight; i++)
+		{
+			valid = parsingFile::tokenIs(file.getNextToken(), "weight");
+			if (!valid)
+				break;
+
+			file.getNextToken(); // index
+			thisMesh->weights[i].jointIndex = parsingFile::tokenToInt(file.getNextToken());
+			thisMesh->weights[i].value = parsingFile::tokenToFloat(file.getNextToken());
+
+			file.getNextToken(); // (
+			thisMesh->weights[i].pos[0] = parsingFile::tokenToFloat(file.getNextToken());
+			thisMesh->weights[i].pos[1] = parsingFile::tokenToFloat(file.getNextToken());
+			thisMesh->weights[i].pos[2] = parsingFile::tokenToFloat(file.getNextToken());
+			file.getNextToken(); // )
+
+			valid = thisMesh->weights[i].jointIndex >= 0 && thisMesh->weights[i].jointIndex < numBones;
+		}
+	}
+	else
+		valid = false;
+
+	// Vertex weights have to be in range
+	for (int i = 0; valid && i < thisMesh->numVerts; i++)
+	{
+		const vert_t & vertex = thisMesh->vertex[i];
+		valid = vertex.weight[0] >= 0 && vertex.weight[1] >= 0 &&
+			vertex.weight[0] + vertex.weight[1] <= thisMesh->numWeight;
+	}
+
+	if (!valid)
+	{
+		free(thisMesh->vertex);
+		free(thisMesh->tris);
+		free(thisMesh->weights);
+		free(thisMesh);
+		return NULL;
+	}
+
+	return thisMesh;
 }
 		
+// The skins are not stored in the MeshCache: it only holds static geometry, while
+// the skins also need the weights and their joint space frames to animate.
 void md5Scene::compileBase()
 {
+	float vmin[3] = {1e10f, 1e10f, 1e10f};
+	float vmax[3] = {-1e10f, -1e10f, -1e10f};
+
 	foreach (mesh_t * mesh, meshList)
 	{
-		int v, v1;
-	
-		// Vertex Positions
-		for (v = 0; v < mesh->numVerts; v++)
+		md5Skin* skin = new md5Skin(mesh, bones);
+		skinList.append(skin);
+
+		// Bounds of the bind pose
+		foreach (const MeshVertex & v, skin->getVertices())
 		{
-			vec3_t pos;
-			int w;
+			for (int c = 0; c < 3; c++)
+			{
+				vmin[c] = qMin(vmin[c], v.position[c]);
+				vmax[c] = qMax(vmax[c], v.position[c]);
+			}
+		}
 
-			vert_t* vertex = &mesh->vertex[v];
-			if (!vertex)
-				return;
+		Mesh* gpuMesh = new Mesh;
+		gpuMesh->upload(skin->getVertices(), skin->getIndices());
+		gpuMeshList.append(gpuMesh);
+	}
 
-			memset(pos, 0, sizeof(vec3_t));
-			for (w = vertex->weight[0]; w < vertex->weight[0]+vertex->weight[1]; w++)
+	float extent = 0.0f;
+	for (int c = 0; c < 3; c++)
+	{
+		position[c] = (vmax[c] + vmin[c]) * 0.5f;
+		extent = qMax(extent, vmax[c] - position[c]);
+	}
+	scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+}
+
+// Joints of all the frames of an animation, 28 bytes each.
+static const int s_maxAnimJoints = 1 << 22;
+
+bool md5Scene::loadAnim(const QString & filename)
+{
+	parsingFile file(filename);
+	if (!file.isOpen())
+		return false;
+
+	// The animation is parsed aside, and only replaces the current one when
+	// the whole file is valid.
+	int frameCount = 0;
+	int rate = frameRate;
+	int numComponents = 0;
+	QVector<int> parents, flags, startIndices;
+	QVector<joint_t> baseFrame;
+	QVector<joint_t> poses;
+	QVector<bool> parsedFrames;
+
+	token_t token = file.getNextToken();
+	while (token.begin)
+	{
+		if (parsingFile::tokenIs(token, "numFrames"))
+		{
+			frameCount = parsingFile::tokenToInt(file.getNextToken());
+			if (frameCount <= 0 || numBones <= 0 || frameCount > s_maxAnimJoints / numBones || !poses.isEmpty())
+				return false;
+			poses.resize(frameCount * numBones);
+			parsedFrames.fill(false, frameCount);
+		}
+		else
+		if (parsingFile::tokenIs(token, "numJoints"))
+		{
+			// The animation has to match the skeleton of the mesh
+			if (parsingFile::tokenToInt(file.getNextToken()) != numBones)
+				return false;
+		}
+		else
+		if (parsingFile::tokenIs(token, "frameRate"))
+		{
+			rate = qMax(1, parsingFile::tokenToInt(file.getNextToken()));
+		}
+		else
+		if (parsingFile::tokenIs(token, "numAnimatedComponents"))
+		{
+			numComponents = parsingFile::tokenToInt(file.getNextToken());
+			if (numComponents < 0)
+				return false;
+		}
+		else
+		if (parsingFile::tokenIs(token, "hierarchy"))
+		{
+			file.getNextToken(); // {
+			parents.resize(numBones);
+			flags.resize(numBones);
+			startIndices.resize(numBones);
+			for (int i = 0; i < numBones; i++)
+			{
+				file.getNextToken(); // name
+				parents[i] = parsingFile::tokenToInt(file.getNextToken());
+				flags[i] = parsingFile::tokenToInt(file.getNextToken());
+				startIndices[i] = parsingFile::tokenToInt(file.getNextToken());
+
+				// Parents come first, so that the frames are built in one pass
+				if (parents[i] < -1 || parents[i] >= i || startIndices[i] < 0)
+					return false;
+			}
+			file.getNextToken(); // }
+		}
+		else
+		if (parsingFile::tokenIs(token, "baseframe"))
+		{
+			file.getNextToken(); // {
+			baseFrame.resize(numBones);
+			for (int i = 0; i < numBones; i++)
 			{
-				vec3_t tempPos;
-				bone_t* bone = NULL;
-				weight_t* weight = &mesh->weights[w];
-				if (!weight)
-					return;
-				
-				bone = &bones[weight->jointIndex];
-				if (!bone)
-					return;
-
-				pointByQuat(weight->pos, bone->orientation, tempPos);
-				pos[0] += (tempPos[0]+bone->pos[0])*weight->value;
-				pos[1] += (tempPos[1]+bone->pos[1])*weight->value;
-				pos[2] += (tempPos[2]+bone->pos[2])*weight->value;
+				file.getNextToken(); // (
+				for (int c = 0; c < 3; c++)
+					baseFrame[i].pos[c] = parsingFile::tokenToFloat(file.getNextToken());
+				file.getNextToken(); // )
+				file.getNextToken(); // (
+				for (int c = 0; c < 3; c++)
+					baseFrame[i].orientation[c + 1] = parsingFile::tokenToFloat(file.getNextToken());
+				file.getNextToken(); // )
 			}
+			file.getNextToken(); // }
+		}
+		else
+		if (parsingFile::tokenIs(token, "frame"))
+		{
+			const int frame = parsingFile::tokenToInt(file.getNextToken());
+			if (frame < 0 || frame >= frameCount || parents.isEmpty() || baseFrame.isEmpty())
+				return false;
+			parsedFrames[frame] = true;
+
+			QVector<float> components(numComponents);
+			file.getNextToken(); // {
+			for (int i = 0; i < numComponents; i++)
+				components[i] = parsingFile::tokenToFloat(file.getNextToken());
+			if (!parsingFile::tokenIs(file.getNextToken(), "}"))
+				return false;
+
+			joint_t* pose = poses.data() + frame * numBones;
+			for (int i = 0; i < numBones; i++)
+			{
+				// Replace the animated components of the base frame
+				vec3_t pos;
+				vec3_t orient;
+				VectorCopy(baseFrame[i].pos, pos);
+				VectorCopy(baseFrame[i].orientation + 1, orient);
+
+				int component = startIndices[i];
+				for (int c = 0; c < 6; c++)
+				{
+					if (!(flags[i] & (1 << c)))
+						continue;
+					if (component >= numComponents)
+						return false;
+
+					if (c < 3)
+						pos[c] = components[component++];
+					else
+						orient[c - 3] = components[component++];
+				}
 
-			VectorCopy(pos, vertex->basePos);
-			VectorCopy(pos, vertex->renderPos);
-			VectorClear(vertex->baseNormal);
+				quat_t local;
+				quatFromMD5(orient[0], orient[1], orient[2], local);
+
+				// Joints are relative to their parent
+				joint_t & joint = pose[i];
+				if (parents[i] < 0)
+				{
+					VectorCopy(pos, joint.pos);
+					quatCopy(local, joint.orientation);
+				}
+				else
+				{
+					const joint_t & parent = pose[parents[i]];
+					vec3_t rotated;
+					pointByQuat(pos, (vec_t*)parent.orientation, rotated);
+					VectorAdd(parent.pos, rotated, joint.pos);
+					quatProduct((vec_t*)parent.orientation, local, joint.orientation);
+					quatNormalize(joint.orientation);
+				}
+			}
 		}
+		token = file.getNextToken();
+	}
 
-		// Normals
-		for (unsigned int t = 0; t < mesh->numTris; t++)
-		{
-			vec3_t v1, v2, v3;
-			vec3_t edge1, edge2;
-			vec3_t normal;
+	// Every frame has to be there
+	if (frameCount == 0 || parsedFrames.contains(false))
+		return false;
 
-			triangle_t* tri = &mesh->tris[t];
-			if (!tri)
-				return;
+	numFrames = frameCount;
+	frameRate = rate;
+	frames = poses;
+
+	time.start();
+	return true;
+}
 
-			VectorCopy(mesh->vertex[tri->index[0]].basePos, v1);
-			VectorCopy(mesh->vertex[tri->index[1]].basePos, v2);
-			VectorCopy(mesh->vertex[tri->index[2]].basePos, v3);
+// Interpolate the pose of the current time between the two closest frames.
+void md5Scene::computePose(joint_t* pose) const
+{
+	const double t = time.elapsed() * 0.001 * frameRate;
+	const int frame0 = int(t) % numFrames;
+	const int frame1 = (frame0 + 1) % numFrames;
+	const float f = float(t - floor(t));
 
-			VectorSubtract(v2, v1, edge1);
-			VectorSubtract(v3, v1, edge2);
+	const joint_t* a = frames.constData() + frame0 * numBones;
+	const joint_t* b = frames.constData() + frame1 * numBones;
 
-			CrossProduct(edge1, edge2, normal);
-			VectorNormalize(normal);
+	for (int i = 0; i < numBones; i++)
+	{
+		for (int c = 0; c < 3; c++)
+			pose[i].pos[c] = a[i].pos[c] + (b[i].pos[c] - a[i].pos[c]) * f;
+
+		// Normalized lerp, through the shortest path
+		float dot = a[i].orientation[0] * b[i].orientation[0] + a[i].orientation[1] * b[i].orientation[1] +
+			a[i].orientation[2] * b[i].orientation[2] + a[i].orientation[3] * b[i].orientation[3];
+		float sign = dot < 0.0f ? -1.0f : 1.0f;
+		for (int c = 0; c < 4; c++)
+			pose[i].orientation[c] = a[i].orientation[c] * (1.0f - f) + b[i].orientation[c] * sign * f;
+		quatNormalize(pose[i].orientation);
+	}
+}
 
-			VectorAdd(normal, mesh->vertex[tri->index[0]].baseNormal, mesh->vertex[tri->index[0]].baseNormal);
-			VectorAdd(normal, mesh->vertex[tri->index[1]].baseNormal, mesh->vertex[tri->index[1]].baseNormal);
-			VectorAdd(normal, mesh->vertex[tri->index[2]].baseNormal, mesh->vertex[tri->index[2]].baseNormal);
+static void jointMatrix(const joint_t & joint, float* m)
+{
+	const float w = joint.orientation[0];
+	const float x = joint.orientation[1];
+	const float y = joint.orientation[2];
+	const float z = joint.orientation[3];
+
+	m[0] = 1 - 2*(y*y + z*z); m[1] = 2*(x*y - w*z);     m[2] = 2*(x*z + w*y);      m[3] = joint.pos[0];
+	m[4] = 2*(x*y + w*z);     m[5] = 1 - 2*(x*x + z*z); m[6] = 2*(y*z - w*x);      m[7] = joint.pos[1];
+	m[8] = 2*(x*z - w*y);     m[9] = 2*(y*z + w*x);     m[10] = 1 - 2*(x*x + y*y); m[11] = joint.pos[2];
+}
+
+namespace {
+
+	class SkinTask : public QRunnable
+	{
+	public:
+		SkinTask(md5Skin* skin, const float* jointMatrices) : m_skin(skin), m_jointMatrices(jointMatrices) { }
+
+		virtual void run()
+		{
+			m_skin->update(m_jointMatrices);
 		}
 
-		// Normalize normals
-		for (v1 = 0; v1 < mesh->numVerts; v1++)
+	private:
+		md5Skin* m_skin;
+		const float* m_jointMatrices;
+	};
+
+} // namespace
+
+// Skin all the meshes with the current pose, one mesh per thread.
+void md5Scene::skin() const
+{
+	QVector<joint_t> pose(numBones);
+	computePose(pose.data());
+
+	jointMatrices.resize(12 * numBones);
+	for (int i = 0; i < numBones; i++)
+		jointMatrix(pose[i], jointMatrices.data() + 12 * i);
+
+	if (skinList.count() > 1)
+	{
+		foreach (md5Skin* skin, skinList)
+			skinningPool.start(new SkinTask(skin, jointMatrices.constData()));
+		skinningPool.waitForDone();
+	}
+	else
+	{
+		foreach (md5Skin* skin, skinList)
+			skin->update(jointMatrices.constData());
+	}
+
+	for (int i = 0; i < skinList.count(); i++)
+	{
+		const QVector<MeshVertex> & vertices = skinList[i]->getVertices();
+		gpuMeshList[i]->updateVertices(vertices.constData(), vertices.count());
+	}
+}
+
+
+md5Skin::md5Skin(const mesh_t* mesh, const bone_t* bones) :
+	mesh(mesh)
+{
+	// Bind pose positions
+	vertices.resize(mesh->numVerts);
+	for (int v = 0; v < mesh->numVerts; v++)
+	{
+		const vert_t & vertex = mesh->vertex[v];
+		MeshVertex & out = vertices[v];
+		memset(&out, 0, sizeof(out));
+
+		for (int w = vertex.weight[0]; w < vertex.weight[0] + vertex.weight[1]; w++)
 		{
-			vert_t* vertex = &mesh->vertex[v1];
-			if (!vertex)
-				return;
+			const weight_t & weight = mesh->weights[w];
+			const bone_t & bone = bones[weight.jointIndex];
 
-			VectorNormalize(vertex->baseNormal);
-			VectorCopy(vertex->baseNormal, vertex->renderNormal);
+			vec3_t rotated;
+			pointByQuat((vec_t*)weight.pos, (vec_t*)bone.orientation, rotated);
+			for (int c = 0; c < 3; c++)
+				out.position[c] += (rotated[c] + bone.pos[c]) * weight.value;
 		}
 
-		// Rotate normals by the inverse weight
-		// joint orientation in order to get
-		// normals for each frame
-		for (v = 0; v < mesh->numVerts; v++)
+		out.texcoord[0] = vertex.uv[0];
+		out.texcoord[1] = vertex.uv[1];
+	}
+
+	indices.resize(3 * mesh->numTris);
+	for (int t = 0; t < mesh->numTris; t++)
+		for (int k = 0; k < 3; k++)
+			indices[3 * t + k] = mesh->tris[t].index[k];
+
+	QVector<quint32> sources;
+	Mesh::computeNormals(vertices, indices);
+	Mesh::computeTangents(vertices, indices, &sources);
+
+	// Vertices split by the tangents get copies of the weights of their source,
+	// so that the copies can have their own frames.
+	QVector<int> weightSource;
+	for (int w = 0; w < mesh->numWeight; w++)
+		weightSource.append(w);
+
+	weightStart.resize(vertices.count());
+	weightCount.resize(vertices.count());
+	for (int v = 0; v < vertices.count(); v++)
+	{
+		const vert_t & vertex = mesh->vertex[v < mesh->numVerts ? v : sources[v - mesh->numVerts]];
+		weightCount[v] = vertex.weight[1];
+		if (v < mesh->numVerts)
 		{
-			vec3_t normal;
-			int w;
+			weightStart[v] = vertex.weight[0];
+			continue;
+		}
 
-			vert_t* vertex = &mesh->vertex[v];
-			if (!vertex)
-				return;
+		weightStart[v] = weightSource.count();
+		for (int w = vertex.weight[0]; w < vertex.weight[0] + vertex.weight[1]; w++)
+			weightSource.append(w);
+	}
+
+	numWeights = (weightSource.count() + 3) & ~3;
 
-			VectorClear(normal);
-			for (w = vertex->weight[0]; w < vertex->weight[0]+vertex->weight[1]; w++)
+	joint.fill(0, numWeights);
+	bias.fill(0.0f, numWeights);
+	for (int c = 0; c < 12; c++)
+	{
+		local[c].fill(0.0f, numWeights);
+		skinned[c].fill(0.0f, numWeights);
+	}
+
+	for (int w = 0; w < weightSource.count(); w++)
+	{
+		const weight_t & weight = mesh->weights[weightSource[w]];
+		joint[w] = weight.jointIndex;
+		bias[w] = weight.value;
+		for (int c = 0; c < 3; c++)
+			local[c][w] = weight.pos[c];
+	}
+
+	// Move the bind pose frame of every vertex to the space of its weights' joints
+	for (int v = 0; v < vertices.count(); v++)
+	{
+		MeshVertex & out = vertices[v];
+
+		for (int w = weightStart[v]; w < weightStart[v] + weightCount[v]; w++)
+		{
+			const bone_t & bone = bones[joint[w]];
+
+			vec3_t n, t, b;
+			invPointByQuat(out.normal, (vec_t*)bone.orientation, n);
+			invPointByQuat(out.tangent, (vec_t*)bone.orientation, t);
+			invPointByQuat(out.bitangent, (vec_t*)bone.orientation, b);
+			for (int c = 0; c < 3; c++)
 			{
-				vec3_t tempPos;
-				bone_t* bone = NULL;
-				weight_t* weight = &mesh->weights[w];
-				if (!weight)
-					return;
-				
-				bone = &bones[weight->jointIndex];
-				if (!bone)
-					return;
-
-				invPointByQuat(vertex->baseNormal, bone->orientation, tempPos);
-				VectorAdd(normal, tempPos, normal);
+				local[3 + c][w] = n[c];
+				local[6 + c][w] = t[c];
+				local[9 + c][w] = b[c];
 			}
-			VectorNormalize(normal);
-			VectorCopy(normal, vertex->normal);
 		}
 	}
+}
 
-	// Time to make the vertexLists ;)
-	foreach (mesh_t * mesh, meshList)
+void md5Skin::update(const float* jointMatrices)
+{
+	// Transform every weight by its joint, four at a time
+	for (int w = 0; w < numWeights; w += 4)
 	{
-		if (!mesh->normalList)
-			mesh->normalList = (vec_t*)malloc(sizeof(vec_t)*mesh->numVerts*3);
+		const float* m[4] = {
+			jointMatrices + 12 * joint[w + 0],
+			jointMatrices + 12 * joint[w + 1],
+			jointMatrices + 12 * joint[w + 2],
+			jointMatrices + 12 * joint[w + 3]
+		};
 
-		if (!mesh->normalList)
-			return;
+#ifdef MD5_USE_SSE
+		__m128 row[12];
+		for (int k = 0; k < 12; k++)
+			row[k] = _mm_set_ps(m[3][k], m[2][k], m[1][k], m[0][k]);
 
-		memset(mesh->normalList, 0, sizeof(vec_t)*3*mesh->numVerts);
-		for (unsigned int i = 0; i < mesh->numVerts; i++)
+		const __m128 b = _mm_loadu_ps(bias.constData() + w);
+
+		for (int set = 0; set < 4; set++)
 		{
-			mesh->normalList[i+2*i] = mesh->vertex[i].renderNormal[0];
-			mesh->normalList[i+2*i+1] = mesh->vertex[i].renderNormal[1];
-			mesh->normalList[i+2*i+2] = mesh->vertex[i].renderNormal[2];
-		}
+			const __m128 x = _mm_loadu_ps(local[3 * set + 0].constData() + w);
+			const __m128 y = _mm_loadu_ps(local[3 * set + 1].constData() + w);
+			const __m128 z = _mm_loadu_ps(local[3 * set + 2].constData() + w);
 
-		if (!mesh->indexList)
-			mesh->indexList = (GLuint*)malloc(sizeof(GLuint)*mesh->numTris*3);
+			for (int c = 0; c < 3; c++)
+			{
+				__m128 r = _mm_add_ps(_mm_add_ps(_mm_mul_ps(row[4 * c + 0], x), _mm_mul_ps(row[4 * c + 1], y)), _mm_mul_ps(row[4 * c + 2], z));
 
-		if (!mesh->indexList)
-			return;
+				// Only positions are translated
+				if (set == 0)
+					r = _mm_add_ps(r, row[4 * c + 3]);
 
-		memset(mesh->indexList, 0, sizeof(GLuint)*3*mesh->numTris);
-		for (unsigned int i = 0; i < mesh->numTris; i++)
+				_mm_storeu_ps(skinned[3 * set + c].data() + w, _mm_mul_ps(r, b));
+			}
+		}
+#else
+		for (int lane = 0; lane < 4; lane++)
 		{
-			mesh->indexList[i+2*i] = mesh->tris[i].index[0];
-			mesh->indexList[i+2*i+1] = mesh->tris[i].index[1];
-			mesh->indexList[i+2*i+2] = mesh->tris[i].index[2];
+			const float* row = m[lane];
+			const float b = bias[w + lane];
+
+			for (int set = 0; set < 4; set++)
+			{
+				const float x = local[3 * set + 0][w + lane];
+				const float y = local[3 * set + 1][w + lane];
+				const float z = local[3 * set + 2][w + lane];
+
+				for (int c = 0; c < 3; c++)
+				{
+					float r = row[4 * c + 0] * x + row[4 * c + 1] * y + row[4 * c + 2] * z;
+					if (set == 0)
+						r += row[4 * c + 3];
+					skinned[3 * set + c][w + lane] = r * b;
+				}
+			}
 		}
+#endif
+	}
+
+	// Sum the weights of every vertex
+	for (int v = 0; v < vertices.count(); v++)
+	{
+		MeshVertex & out = vertices[v];
+
+		float sum[12] = {0};
+		for (int w = weightStart[v]; w < weightStart[v] + weightCount[v]; w++)
+			for (int c = 0; c < 12; c++)
+				sum[c] += skinned[c][w];
+
+		VectorCopy(sum + 0, out.position);
+		VectorCopy(sum + 3, out.normal);
+		VectorCopy(sum + 6, out.tangent);
+		VectorCopy(sum + 9, out.bitangent);
+		VectorNormalize(out.normal);
+		VectorNormalize(out.tangent);
+		VectorNormalize(out.bitangent);
 	}
 }
 
+
+// md5 scene factory.
+class md5SceneFactory : public SceneFactory
+{
+public:
+	virtual QString name() const
+	{
+		return tr("MD5 mesh");
+	}
+	virtual QString description() const
+	{
+		return tr("Doom 3 animated model");
+	}
+	virtual QIcon icon() const
+	{
+		return QIcon();
+	}
+	virtual Scene * createScene() const
+	{
+		return new md5Scene();
+	}
+	virtual bool isInteractive() const
+	{
+		return true;
+	}
+};
+
+REGISTER_SCENE_FACTORY(md5SceneFactory);
@@ -20,16 +20,21 @@
 #ifndef MD5_H
 #define MD5_H
 
+// Include GLEW before anything else.
+#include <GL/glew.h>
+
 #include "scene.h"
+#include "mesh.h"
 
 #include <QString>
 #include <QFile>
 #include <QFileDialog>
 #include <QAction>
 #include <QMenu>
+#include <QTime>
+#include <QThreadPool>
+#include <QVector>
 
-#include <GL/glew.h>
-#include <fstream>
 #include <cmath>
 
 typedef GLfloat vec_t;
@@ -51,6 +56,13 @@ typedef struct
 	quat_t baseOrientation;
 } bone_t;
 
+// Joint of an animation frame, in object space
+typedef struct
+{
+	vec3_t pos;
+	quat_t orientation;
+} joint_t;
+
 typedef struct
 {
 	int jointIndex;
@@ -63,16 +75,6 @@ typedef struct
 {
 	vec2_t uv;
 	int weight[2];
-
-	vec3_t renderPos;
-	vec3_t renderNormal;
-
-	// normal unasigned to a bone
-	vec3_t normal;
-
-	// For the bind position, prevent recalculation
-	vec3_t basePos;
-	vec3_t baseNormal;
 } vert_t;
 
 typedef struct
@@ -93,10 +95,6 @@ typedef struct
 	// Weight Data
 	int numWeight;
 	weight_t* weights;
-
-	// for glDrawElements =)
-	vec_t* normalList;
-	GLuint* indexList;
 } mesh_t;
 
 #define VectorClear(a)			((a)[0]=(a)[1]=(a)[2]=0)
@@ -109,19 +107,72 @@ typedef struct
 #define quatClear(a) 			((a)[0]=1, (a)[1]=(a)[2]=(a)[3]=0)
 #define quatCopy(a,b) 			((b)[0]=(a)[0],(b)[1]=(a)[1],(b)[2]=(a)[2],(b)[3]=(a)[3])
 
+// Token of an md5 file, pointing into the file data. begin is NULL at the end of the file.
+typedef struct
+{
+	const char* begin;
+	int length;
+} token_t;
+
+// Lexer of md5mesh and md5anim files. The file is mapped, and tokens are
+// returned without copying them.
 class parsingFile
 {
 	private:
-		unsigned long index;
-		char* string;
-	
+		QFile file;
+		QByteArray buffer;
+		const char* current;
+		const char* end;
+
+	public:
+		parsingFile(const QString & filename);
+
+		bool isOpen() const { return current != NULL; }
+		token_t getNextToken();
+
+		// Skip tokens until the given one, returns false at the end of the file.
+		bool skipTo(const char* text);
+
+		static bool tokenIs(const token_t & token, const char* text);
+		static int tokenToInt(const token_t & token);
+		static float tokenToFloat(const token_t & token);
+};
+
+// Skinned vertices of a mesh. The weights are kept in structure of arrays
+// form, so that they are transformed four at a time with SSE.
+class md5Skin
+{
+	private:
+		const mesh_t* mesh;
+
+		// Number of weights, padded to a multiple of 4
+		int numWeights;
+
+		QVector<int> joint;
+		QVector<float> bias;
+
+		// Weights of every vertex. Vertices split from another one have
+		// their own copies of its weights.
+		QVector<int> weightStart;
+		QVector<int> weightCount;
+
+		// Position, normal, tangent and bitangent of the weights in joint
+		// space, and transformed by the current pose. One array per component.
+		QVector<float> local[12];
+		QVector<float> skinned[12];
+
+		QVector<MeshVertex> vertices;
+		QVector<quint32> indices;
+
 	public:
-		parsingFile(const char* filename);
-		~parsingFile();
+		md5Skin(const mesh_t* mesh, const bone_t* bones);
+
+		// Skin the vertices with the joint matrices of the pose, 3x4 row major.
+		void update(const float* jointMatrices);
 
-		const char* getNextToken();
+		const QVector<MeshVertex> & getVertices() const { return vertices; }
+		const QVector<quint32> & getIndices() const { return indices; }
 };
-		
 
 class md5Scene : public Scene
 {
@@ -131,9 +182,28 @@ class md5Scene : public Scene
 
 		QList<mesh_t*> meshList;
 
-		unsigned int numBones;
+		int numBones;
 		bone_t* bones;
 
+		// Skinning
+		QList<md5Skin*> skinList;
+		QList<Mesh*> gpuMeshList;
+		mutable QVector<float> jointMatrices;
+		mutable QThreadPool skinningPool;
+
+		// Animation, numBones joints per frame
+		int numFrames;
+		int frameRate;
+		QVector<joint_t> frames;
+		QTime time;
+
+		mesh_t* loadMesh(parsingFile & file);
+		bool loadJoints(parsingFile & file);
+		bool loadAnim(const QString & filename);
+
+		void computePose(joint_t* pose) const;
+		void skin() const;
+
 	public:
 		md5Scene();
 		~md5Scene();
@@ -143,6 +213,8 @@ class md5Scene : public Scene
 
 		virtual void transform() const;
 		virtual void draw(Effect* effect) const;
+		virtual bool isAnimated() const { return numFrames > 1; }
+		virtual void update();
 
 		virtual void setupMenu(QMenu * menu) const
 		{
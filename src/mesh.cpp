@@ -0,0 +1,705 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "mesh.h"
+#include "frameprofiler.h"
+
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <math.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace {
+
+	// Core profile contexts don't have the built-in vertex arrays.
+	static bool hasBuiltinArrays()
+	{
+		if (!GLEW_VERSION_3_2) {
+			return true;
+		}
+		GLint mask = 0;
+		glGetIntegerv(GL_CONTEXT_PROFILE_MASK, &mask);
+		return (mask & GL_CONTEXT_CORE_PROFILE_BIT) == 0;
+	}
+
+	static bool hasVertexArrayObjects()
+	{
+		return GLEW_ARB_vertex_array_object || GLEW_VERSION_3_0;
+	}
+
+	static const GLvoid * attributeOffset(size_t offset)
+	{
+		return (const GLvoid *)offset;
+	}
+
+	static void sub(float * r, const float * a, const float * b)
+	{
+		r[0] = a[0] - b[0];
+		r[1] = a[1] - b[1];
+		r[2] = a[2] - b[2];
+	}
+
+	static void add(float * r, const float * a)
+	{
+		r[0] += a[0];
+		r[1] += a[1];
+		r[2] += a[2];
+	}
+
+	static void normalize(float * v)
+	{
+		float length = sqrtf(v[0] * v[0] + v[1] * v[1] + v[2] * v[2]);
+		if (length > 0.0f) {
+			v[0] /= length;
+			v[1] /= length;
+			v[2] /= length;
+		}
+	}
+
+	static float dot(const float * a, const float * b)
+	{
+		return a[0] * b[0] + a[1] * b[1] + a[2] * b[2];
+	}
+
+	static void cross(float * r, const float * a, const float * b)
+	{
+		r[0] = a[1] * b[2] - a[2] * b[1];
+		r[1] = a[2] * b[0] - a[0] * b[2];
+		r[2] = a[0] * b[1] - a[1] * b[0];
+	}
+
+	// Remove the component of v along the unit vector n.
+	static void orthogonalize(float * v, const float * n)
+	{
+		const float d = dot(v, n);
+		v[0] -= n[0] * d;
+		v[1] -= n[1] * d;
+		v[2] -= n[2] * d;
+	}
+
+	// Angle between the edges that leave p towards a and b.
+	static float cornerAngle(const float * p, const float * a, const float * b)
+	{
+		float ea[3], eb[3];
+		sub(ea, a, p);
+		sub(eb, b, p);
+		normalize(ea);
+		normalize(eb);
+		return acosf(qBound(-1.0f, dot(ea, eb), 1.0f));
+	}
+
+	// Meshes smaller than this are processed on the calling thread.
+	static const int s_minParallelTriangles = 32 * 1024;
+
+	// Every thread has a full copy of the accumulators, so their number is
+	// capped, and so is the memory of the copies beyond the first one.
+	static const int s_maxAccumulators = 8;
+	static const qint64 s_maxAccumulatorBytes = 64 << 20;
+
+	static int accumulatorCount(int triangleCount, int vertexCount, int floatsPerVertex)
+	{
+		const qint64 bytes = qMax(qint64(1), qint64(vertexCount) * floatsPerVertex * qint64(sizeof(float)));
+		const int memoryCount = int(qMin(qint64(s_maxAccumulators), 1 + s_maxAccumulatorBytes / bytes));
+		return qBound(1, triangleCount / s_minParallelTriangles, qMin(memoryCount, qMin(s_maxAccumulators, QThread::idealThreadCount())));
+	}
+
+	// Start of the i-th of count even ranges of [0, size).
+	static int rangeStart(int size, int count, int i)
+	{
+		return int(qint64(size) * i / count);
+	}
+
+	// Runs the tasks on a local pool, or inline when there is only one.
+	static void runTasks(const QList<QRunnable *> & tasks)
+	{
+		if (tasks.count() == 1) {
+			tasks.first()->run();
+			delete tasks.first();
+			return;
+		}
+
+		QThreadPool pool;
+		pool.setMaxThreadCount(tasks.count());
+		foreach (QRunnable * task, tasks) {
+			pool.start(task);
+		}
+		pool.waitForDone();
+	}
+
+	/// Adds the area weighted face normals of a range of triangles to a private accumulator.
+	class NormalTask : public QRunnable
+	{
+	public:
+		NormalTask(const MeshVertex * vertices, int vertexCount, const quint32 * indices, int first, int last, float * normals) :
+			m_vertices(vertices), m_vertexCount(vertexCount), m_indices(indices), m_first(first), m_last(last), m_normals(normals) { }
+
+		virtual void run()
+		{
+			memset(m_normals, 0, 3 * m_vertexCount * sizeof(float));
+
+			for (int t = m_first; t < m_last; t++) {
+				const quint32 * tri = m_indices + 3 * t;
+				const float * p0 = m_vertices[tri[0]].position;
+				const float * p1 = m_vertices[tri[1]].position;
+				const float * p2 = m_vertices[tri[2]].position;
+
+				float e1[3], e2[3], n[3];
+				sub(e1, p1, p0);
+				sub(e2, p2, p0);
+				cross(n, e1, e2);
+
+				add(m_normals + 3 * tri[0], n);
+				add(m_normals + 3 * tri[1], n);
+				add(m_normals + 3 * tri[2], n);
+			}
+		}
+
+	private:
+		const MeshVertex * m_vertices;
+		int m_vertexCount;
+		const quint32 * m_indices;
+		int m_first, m_last;
+		float * m_normals;
+	};
+
+	/// Sums the normal accumulators of a range of vertices.
+	class NormalReduceTask : public QRunnable
+	{
+	public:
+		NormalReduceTask(MeshVertex * vertices, int first, int last, const QVector<float *> & normals) :
+			m_vertices(vertices), m_first(first), m_last(last), m_normals(normals) { }
+
+		virtual void run()
+		{
+			for (int i = m_first; i < m_last; i++) {
+				float * n = m_vertices[i].normal;
+				n[0] = n[1] = n[2] = 0.0f;
+				foreach (const float * normals, m_normals) {
+					add(n, normals + 3 * i);
+				}
+				normalize(n);
+			}
+		}
+
+	private:
+		MeshVertex * m_vertices;
+		int m_first, m_last;
+		QVector<float *> m_normals;
+	};
+
+	// Floats per vertex in the tangent accumulators: the tangent sum and the
+	// weight sum of the corners with a positive, then negative, handedness.
+	static const int s_tangentFloats = 8;
+
+	// Sign of the texture area of a triangle, which gives the handedness of its
+	// tangent frame. Returns 0 if the texture coordinates are degenerate.
+	static float textureSign(const MeshVertex & v0, const MeshVertex & v1, const MeshVertex & v2)
+	{
+		const float det = (v1.texcoord[0] - v0.texcoord[0]) * (v2.texcoord[1] - v0.texcoord[1]) -
+			(v2.texcoord[0] - v0.texcoord[0]) * (v1.texcoord[1] - v0.texcoord[1]);
+		if (fabsf(det) < 1e-12f) {
+			return 0.0f;
+		}
+		return det > 0.0f ? 1.0f : -1.0f;
+	}
+
+	/// Adds the face tangents of a range of triangles to a private accumulator,
+	/// separately for each handedness. As in MikkTSpace, the tangents are
+	/// projected on the plane of each corner's normal, normalized and weighted
+	/// by the corner angle, so the result doesn't depend on the tessellation or
+	/// the texture scale.
+	class TangentTask : public QRunnable
+	{
+	public:
+		TangentTask(const MeshVertex * vertices, int vertexCount, const quint32 * indices, int first, int last, float * frames) :
+			m_vertices(vertices), m_vertexCount(vertexCount), m_indices(indices), m_first(first), m_last(last), m_frames(frames) { }
+
+		virtual void run()
+		{
+			memset(m_frames, 0, s_tangentFloats * m_vertexCount * sizeof(float));
+
+			for (int t = m_first; t < m_last; t++) {
+				const quint32 * tri = m_indices + 3 * t;
+				const MeshVertex & v0 = m_vertices[tri[0]];
+				const MeshVertex & v1 = m_vertices[tri[1]];
+				const MeshVertex & v2 = m_vertices[tri[2]];
+
+				// Only the orientation of the texture matters, not its scale.
+				const float sign = textureSign(v0, v1, v2);
+				if (sign == 0.0f) {
+					continue;
+				}
+
+				float e1[3], e2[3];
+				sub(e1, v1.position, v0.position);
+				sub(e2, v2.position, v0.position);
+
+				const float t1 = v1.texcoord[1] - v0.texcoord[1];
+				const float t2 = v2.texcoord[1] - v0.texcoord[1];
+
+				float ft[3];
+				for (int c = 0; c < 3; c++) {
+					ft[c] = (e1[c] * t2 - e2[c] * t1) * sign;
+				}
+
+				const MeshVertex * corner[3] = { &v0, &v1, &v2 };
+				for (int k = 0; k < 3; k++) {
+					const float angle = cornerAngle(corner[k]->position, corner[(k + 1) % 3]->position, corner[(k + 2) % 3]->position);
+
+					float t[3] = { ft[0], ft[1], ft[2] };
+					orthogonalize(t, corner[k]->normal);
+					normalize(t);
+
+					float * frame = m_frames + s_tangentFloats * tri[k] + (sign > 0.0f ? 0 : 4);
+					for (int c = 0; c < 3; c++) {
+						frame[c] += t[c] * angle;
+					}
+					frame[3] += angle;
+				}
+			}
+		}
+
+	private:
+		const MeshVertex * m_vertices;
+		int m_vertexCount;
+		const quint32 * m_indices;
+		int m_first, m_last;
+		float * m_frames;
+	};
+
+	/// Sums the tangent accumulators of a range of vertices into the first one.
+	class TangentReduceTask : public QRunnable
+	{
+	public:
+		TangentReduceTask(int first, int last, const QVector<float *> & frames) :
+			m_first(first), m_last(last), m_frames(frames) { }
+
+		virtual void run()
+		{
+			float * sum = m_frames[0];
+			for (int f = 1; f < m_frames.count(); f++) {
+				const float * frames = m_frames[f];
+				for (int i = s_tangentFloats * m_first; i < s_tangentFloats * m_last; i++) {
+					sum[i] += frames[i];
+				}
+			}
+		}
+
+	private:
+		int m_first, m_last;
+		QVector<float *> m_frames;
+	};
+
+	/// Builds the orthonormal frames of a range of vertices from the summed
+	/// accumulator. Vertices keep the positive handedness when their corners
+	/// have both, the split copies appended after them get the negative one.
+	class TangentFrameTask : public QRunnable
+	{
+	public:
+		TangentFrameTask(MeshVertex * vertices, int vertexCount, const quint32 * sources, int first, int last, const float * frames) :
+			m_vertices(vertices), m_vertexCount(vertexCount), m_sources(sources), m_first(first), m_last(last), m_frames(frames) { }
+
+		virtual void run()
+		{
+			for (int i = m_first; i < m_last; i++) {
+				MeshVertex & v = m_vertices[i];
+
+				float sign;
+				const float * frame;
+				if (i < m_vertexCount) {
+					frame = m_frames + s_tangentFloats * i;
+					sign = (frame[3] > 0.0f || frame[7] == 0.0f) ? 1.0f : -1.0f;
+				}
+				else {
+					frame = m_frames + s_tangentFloats * m_sources[i - m_vertexCount];
+					sign = -1.0f;
+				}
+				if (sign < 0.0f) {
+					frame += 4;
+				}
+
+				float t[3] = { frame[0], frame[1], frame[2] };
+				orthogonalize(t, v.normal);
+				if (dot(t, t) < 1e-20f) {
+					// No texture mapping around this vertex, pick any direction in the plane.
+					const float axis[3] = { 1.0f, 0.0f, 0.0f };
+					const float other[3] = { 0.0f, 1.0f, 0.0f };
+					cross(t, fabsf(v.normal[0]) < 0.9f ? axis : other, v.normal);
+				}
+				normalize(t);
+
+				float bitangent[3];
+				cross(bitangent, v.normal, t);
+
+				for (int c = 0; c < 3; c++) {
+					v.tangent[c] = t[c];
+					v.bitangent[c] = bitangent[c] * sign;
+				}
+			}
+		}
+
+	private:
+		MeshVertex * m_vertices;
+		int m_vertexCount;
+		const quint32 * m_sources;
+		int m_first, m_last;
+		const float * m_frames;
+	};
+
+	/// Points the negative handedness corners of a range of triangles to the
+	/// split copies of their vertices.
+	class TangentRemapTask : public QRunnable
+	{
+	public:
+		TangentRemapTask(const MeshVertex * vertices, const quint32 * splits, quint32 * indices, int first, int last) :
+			m_vertices(vertices), m_splits(splits), m_indices(indices), m_first(first), m_last(last) { }
+
+		virtual void run()
+		{
+			for (int t = m_first; t < m_last; t++) {
+				quint32 * tri = m_indices + 3 * t;
+				if (textureSign(m_vertices[tri[0]], m_vertices[tri[1]], m_vertices[tri[2]]) >= 0.0f) {
+					continue;
+				}
+				for (int k = 0; k < 3; k++) {
+					if (m_splits[tri[k]] != 0) {
+						tri[k] = m_splits[tri[k]];
+					}
+				}
+			}
+		}
+
+	private:
+		const MeshVertex * m_vertices;
+		const quint32 * m_splits;
+		quint32 * m_indices;
+		int m_first, m_last;
+	};
+
+} // namespace
+
+
+MeshMaterial::MeshMaterial() :
+	shininess(20.0f)
+{
+	const float ka[4] = {0.1f, 0.1f, 0.1f, 1.0f};
+	const float kd[4] = {1.0f, 1.0f, 1.0f, 1.0f};
+	const float ks[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+	memcpy(ambient, ka, sizeof(ambient));
+	memcpy(diffuse, kd, sizeof(diffuse));
+	memcpy(specular, ks, sizeof(specular));
+}
+
+void MeshMaterial::bind() const
+{
+	glMaterialfv(GL_FRONT, GL_AMBIENT, ambient);
+	glMaterialfv(GL_FRONT, GL_DIFFUSE, diffuse);
+	glMaterialfv(GL_FRONT, GL_SPECULAR, specular);
+	glMaterialf(GL_FRONT, GL_SHININESS, shininess);
+}
+
+
+Mesh::Mesh() :
+	m_vertexBuffer(0),
+	m_indexBuffer(0),
+	m_vertexArray(0),
+	m_vertexCount(0),
+	m_indexCount(0),
+	m_builtinArrays(true),
+	m_builtinTexCoords(0)
+{
+}
+
+Mesh::~Mesh()
+{
+	release();
+}
+
+void Mesh::release()
+{
+	if (m_vertexArray != 0) {
+		glDeleteVertexArrays(1, &m_vertexArray);
+		m_vertexArray = 0;
+	}
+	if (m_indexBuffer != 0) {
+		glDeleteBuffers(1, &m_indexBuffer);
+		m_indexBuffer = 0;
+	}
+	if (m_vertexBuffer != 0) {
+		glDeleteBuffers(1, &m_vertexBuffer);
+		m_vertexBuffer = 0;
+	}
+	m_vertexCount = 0;
+	m_indexCount = 0;
+}
+
+void Mesh::upload(const QVector<MeshVertex> & vertices, const QVector<quint32> & indices)
+{
+	upload(vertices.constData(), vertices.count(), indices.constData(), indices.count());
+}
+
+void Mesh::upload(const MeshVertex * vertices, int vertexCount, const quint32 * indices, int indexCount)
+{
+	release();
+
+	m_vertexCount = vertexCount;
+	m_indexCount = indexCount;
+
+	m_builtinArrays = hasBuiltinArrays();
+	m_builtinTexCoords = 0;
+	if (m_builtinArrays) {
+		glGetIntegerv(GL_MAX_TEXTURE_COORDS, &m_builtinTexCoords);
+	}
+
+	if (hasVertexArrayObjects()) {
+		glGenVertexArrays(1, &m_vertexArray);
+		glBindVertexArray(m_vertexArray);
+	}
+
+	glGenBuffers(1, &m_vertexBuffer);
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	glBufferData(GL_ARRAY_BUFFER, m_vertexCount * sizeof(MeshVertex), vertices, GL_STATIC_DRAW);
+
+	glGenBuffers(1, &m_indexBuffer);
+	glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+	glBufferData(GL_ELEMENT_ARRAY_BUFFER, m_indexCount * sizeof(quint32), indices, GL_STATIC_DRAW);
+
+	if (m_vertexArray != 0) {
+		// The vertex array keeps the attribute state and the index buffer binding.
+		bindAttributes();
+		glBindVertexArray(0);
+	}
+	else {
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+	}
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+/// Replace the vertices of an uploaded mesh, for meshes animated on the CPU.
+void Mesh::updateVertices(const MeshVertex * vertices, int vertexCount)
+{
+	Q_ASSERT(vertexCount == m_vertexCount);
+
+	glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+	// Orphan the previous storage so that the driver doesn't wait for the draws using it.
+	glBufferData(GL_ARRAY_BUFFER, vertexCount * sizeof(MeshVertex), NULL, GL_STREAM_DRAW);
+	glBufferSubData(GL_ARRAY_BUFFER, 0, vertexCount * sizeof(MeshVertex), vertices);
+	glBindBuffer(GL_ARRAY_BUFFER, 0);
+}
+
+void Mesh::bindAttributes() const
+{
+	const GLsizei stride = sizeof(MeshVertex);
+
+	if (m_builtinArrays) {
+		glEnableClientState(GL_VERTEX_ARRAY);
+		glVertexPointer(3, GL_FLOAT, stride, attributeOffset(offsetof(MeshVertex, position)));
+		glEnableClientState(GL_NORMAL_ARRAY);
+		glNormalPointer(GL_FLOAT, stride, attributeOffset(offsetof(MeshVertex, normal)));
+
+		glClientActiveTexture(GL_TEXTURE0);
+		glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+		glTexCoordPointer(2, GL_FLOAT, stride, attributeOffset(offsetof(MeshVertex, texcoord)));
+
+		if (m_builtinTexCoords >= 8) {
+			glClientActiveTexture(GL_TEXTURE6);
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(3, GL_FLOAT, stride, attributeOffset(offsetof(MeshVertex, tangent)));
+			glClientActiveTexture(GL_TEXTURE7);
+			glEnableClientState(GL_TEXTURE_COORD_ARRAY);
+			glTexCoordPointer(3, GL_FLOAT, stride, attributeOffset(offsetof(MeshVertex, bitangent)));
+			glClientActiveTexture(GL_TEXTURE0);
+		}
+	}
+	else {
+		// Attribute 0 aliases gl_Vertex, so it's only set when the built-in array is not there.
+		glEnableVertexAttribArray(PositionAttribute);
+		glVertexAttribPointer(PositionAttribute, 3, GL_FLOAT, GL_FALSE, stride, attributeOffset(offsetof(MeshVertex, position)));
+	}
+
+	glEnableVertexAttribArray(NormalAttribute);
+	glVertexAttribPointer(NormalAttribute, 3, GL_FLOAT, GL_FALSE, stride, attributeOffset(offsetof(MeshVertex, normal)));
+	glEnableVertexAttribArray(TexCoordAttribute);
+	glVertexAttribPointer(TexCoordAttribute, 2, GL_FLOAT, GL_FALSE, stride, attributeOffset(offsetof(MeshVertex, texcoord)));
+	glEnableVertexAttribArray(TangentAttribute);
+	glVertexAttribPointer(TangentAttribute, 3, GL_FLOAT, GL_FALSE, stride, attributeOffset(offsetof(MeshVertex, tangent)));
+	glEnableVertexAttribArray(BitangentAttribute);
+	glVertexAttribPointer(BitangentAttribute, 3, GL_FLOAT, GL_FALSE, stride, attributeOffset(offsetof(MeshVertex, bitangent)));
+}
+
+void Mesh::unbindAttributes() const
+{
+	if (m_builtinArrays) {
+		glDisableClientState(GL_VERTEX_ARRAY);
+		glDisableClientState(GL_NORMAL_ARRAY);
+		if (m_builtinTexCoords >= 8) {
+			glClientActiveTexture(GL_TEXTURE6);
+			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+			glClientActiveTexture(GL_TEXTURE7);
+			glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+		}
+		glClientActiveTexture(GL_TEXTURE0);
+		glDisableClientState(GL_TEXTURE_COORD_ARRAY);
+	}
+	else {
+		glDisableVertexAttribArray(PositionAttribute);
+	}
+
+	glDisableVertexAttribArray(NormalAttribute);
+	glDisableVertexAttribArray(TexCoordAttribute);
+	glDisableVertexAttribArray(TangentAttribute);
+	glDisableVertexAttribArray(BitangentAttribute);
+}
+
+void Mesh::draw() const
+{
+	draw(0, m_indexCount);
+}
+
+/// Draw @a count indices starting at @a first, as triangles.
+void Mesh::draw(int first, int count) const
+{
+	if (m_indexBuffer == 0 || count <= 0) {
+		return;
+	}
+
+	if (m_vertexArray != 0) {
+		glBindVertexArray(m_vertexArray);
+	}
+	else {
+		glBindBuffer(GL_ARRAY_BUFFER, m_vertexBuffer);
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, m_indexBuffer);
+		bindAttributes();
+	}
+
+	glDrawRangeElements(GL_TRIANGLES, 0, m_vertexCount - 1, count, GL_UNSIGNED_INT, attributeOffset(first * sizeof(quint32)));
+	FrameProfiler::countDrawCall();
+
+	if (m_vertexArray != 0) {
+		glBindVertexArray(0);
+	}
+	else {
+		unbindAttributes();
+		glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, 0);
+		glBindBuffer(GL_ARRAY_BUFFER, 0);
+	}
+}
+
+/// Compute smooth normals by adding the face normals weighted by their area.
+/// Large meshes are split in triangle ranges that accumulate in parallel.
+// static
+void Mesh::computeNormals(QVector<MeshVertex> & vertices, const QVector<quint32> & indices)
+{
+	const int vertexCount = vertices.count();
+	const int triangleCount = indices.count() / 3;
+	const int count = accumulatorCount(triangleCount, vertexCount, 3);
+
+	QVector<float *> normals(count);
+	QList<QRunnable *> tasks;
+	for (int i = 0; i < count; i++) {
+		normals[i] = new float[3 * vertexCount];
+		tasks.append(new NormalTask(vertices.constData(), vertexCount, indices.constData(),
+			rangeStart(triangleCount, count, i), rangeStart(triangleCount, count, i + 1), normals[i]));
+	}
+	runTasks(tasks);
+
+	tasks.clear();
+	for (int i = 0; i < count; i++) {
+		tasks.append(new NormalReduceTask(vertices.data(), rangeStart(vertexCount, count, i), rangeStart(vertexCount, count, i + 1), normals));
+	}
+	runTasks(tasks);
+
+	foreach (float * n, normals) {
+		delete [] n;
+	}
+}
+
+/// Compute the tangent frames from the texture coordinates, the way MikkTSpace does,
+/// so that normal maps baked by other tools look the same. Needs the normals.
+/// Texture seams are already split by the indexing. Vertices shared by triangles of
+/// both handedness, on mirrored mappings, are split: the copy is appended to the
+/// vertices, its source is appended to sources when given, and the indices of the
+/// negative triangles are changed to use it.
+// static
+void Mesh::computeTangents(QVector<MeshVertex> & vertices, QVector<quint32> & indices, QVector<quint32> * sources /*= NULL*/)
+{
+	const int vertexCount = vertices.count();
+	const int triangleCount = indices.count() / 3;
+	const int count = accumulatorCount(triangleCount, vertexCount, s_tangentFloats);
+
+	QVector<float *> frames(count);
+	QList<QRunnable *> tasks;
+	for (int i = 0; i < count; i++) {
+		frames[i] = new float[s_tangentFloats * vertexCount];
+		tasks.append(new TangentTask(vertices.constData(), vertexCount, indices.constData(),
+			rangeStart(triangleCount, count, i), rangeStart(triangleCount, count, i + 1), frames[i]));
+	}
+	runTasks(tasks);
+
+	tasks.clear();
+	for (int i = 0; i < count; i++) {
+		tasks.append(new TangentReduceTask(rangeStart(vertexCount, count, i), rangeStart(vertexCount, count, i + 1), frames));
+	}
+	runTasks(tasks);
+
+	// Split the vertices with corners of both handedness. Copies are never at index 0.
+	const float * sum = frames[0];
+	QVector<quint32> splits(vertexCount, 0);
+	QVector<quint32> splitSources;
+	for (int i = 0; i < vertexCount; i++) {
+		if (sum[s_tangentFloats * i + 3] > 0.0f && sum[s_tangentFloats * i + 7] > 0.0f) {
+			splits[i] = vertexCount + splitSources.count();
+			splitSources.append(i);
+		}
+	}
+
+	if (!splitSources.isEmpty()) {
+		vertices.reserve(vertexCount + splitSources.count());
+		foreach (quint32 source, splitSources) {
+			vertices.append(vertices[source]);
+		}
+
+		// The texture signs are read from the vertices, which the remapping doesn't change.
+		tasks.clear();
+		for (int i = 0; i < count; i++) {
+			tasks.append(new TangentRemapTask(vertices.constData(), splits.constData(), indices.data(),
+				rangeStart(triangleCount, count, i), rangeStart(triangleCount, count, i + 1)));
+		}
+		runTasks(tasks);
+	}
+
+	const int totalCount = vertices.count();
+	tasks.clear();
+	for (int i = 0; i < count; i++) {
+		tasks.append(new TangentFrameTask(vertices.data(), vertexCount, splitSources.constData(),
+			rangeStart(totalCount, count, i), rangeStart(totalCount, count, i + 1), sum));
+	}
+	runTasks(tasks);
+
+	if (sources != NULL) {
+		*sources += splitSources;
+	}
+
+	foreach (float * f, frames) {
+		delete [] f;
+	}
+}
@@ -0,0 +1,129 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MESH_H
+#define MESH_H
+
+#include <GL/glew.h>
+
+#include <QString>
+#include <QStringList>
+#include <QVector>
+
+
+/// Interleaved vertex of the scene meshes.
+struct MeshVertex
+{
+	float position[3];
+	float normal[3];
+	float texcoord[2];
+	float tangent[3];
+	float bitangent[3];
+};
+
+
+/// Material of a group of triangles, used by the fixed function lighting.
+struct MeshMaterial
+{
+	MeshMaterial();
+
+	void bind() const;
+
+	QString name;
+	float ambient[4];
+	float diffuse[4];
+	float specular[4];
+	float shininess;
+};
+
+/// Range of indices drawn with one material.
+struct MeshGroup
+{
+	int material;
+	int first;
+	int count;
+};
+
+/// Geometry of an imported model, ready to be uploaded.
+struct MeshData
+{
+	QVector<MeshVertex> vertices;
+	QVector<quint32> indices;
+	QVector<MeshMaterial> materials;
+	QVector<MeshGroup> groups;
+
+	// Other files the data was imported from, such as material libraries.
+	QStringList dependencies;
+
+	// Transform that fits the model in the unit cube.
+	float center[3];
+	float scale;
+};
+
+
+/// Indexed triangle mesh stored in GL buffers.
+/// The attributes are bound both to the built-in arrays and to generic attributes,
+/// so the same mesh works with the built-in shader inputs and on core profile contexts.
+class Mesh
+{
+public:
+	/// Generic attribute locations. They match the way NVIDIA aliases the built-in
+	/// attributes, so both can be enabled at the same time.
+	enum Attribute {
+		PositionAttribute = 0,
+		NormalAttribute = 2,
+		TexCoordAttribute = 8,		// gl_MultiTexCoord0
+		TangentAttribute = 14,		// gl_MultiTexCoord6
+		BitangentAttribute = 15		// gl_MultiTexCoord7
+	};
+
+	Mesh();
+	~Mesh();
+
+	// These need a current context.
+	void upload(const QVector<MeshVertex> & vertices, const QVector<quint32> & indices);
+	void upload(const MeshVertex * vertices, int vertexCount, const quint32 * indices, int indexCount);
+	void updateVertices(const MeshVertex * vertices, int vertexCount);
+	void draw() const;
+	void draw(int first, int count) const;
+
+	int vertexCount() const { return m_vertexCount; }
+	int indexCount() const { return m_indexCount; }
+
+	static void computeNormals(QVector<MeshVertex> & vertices, const QVector<quint32> & indices);
+	static void computeTangents(QVector<MeshVertex> & vertices, QVector<quint32> & indices, QVector<quint32> * sources = NULL);
+
+private:
+	Q_DISABLE_COPY(Mesh)
+
+	void release();
+	void bindAttributes() const;
+	void unbindAttributes() const;
+
+	GLuint m_vertexBuffer;
+	GLuint m_indexBuffer;
+	GLuint m_vertexArray;
+	int m_vertexCount;
+	int m_indexCount;
+	bool m_builtinArrays;
+	int m_builtinTexCoords;
+};
+
+
+#endif // MESH_H
@@ -0,0 +1,358 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "meshcache.h"
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <string.h>
+
+namespace {
+
+	static const quint32 s_fileMagic = 0x5153424D;	// 'QSBM'
+	static const quint32 s_fileVersion = 2;
+
+	// Only the beginning and the end of the source are hashed, so that validating
+	// the entry of a huge model doesn't cost as much as parsing it.
+	static const qint64 s_signatureBlockSize = 1 << 20;
+
+	enum { MaterialNameLength = 64 };
+
+	struct CacheHeader
+	{
+		quint32 magic;
+		quint32 version;
+		quint32 vertexSize;
+		quint32 reserved;
+
+		qint64 sourceSize;
+		qint64 sourceTime;
+		char sourceSignature[20];
+
+		quint32 vertexCount;
+		quint32 indexCount;
+		quint32 materialCount;
+		quint32 groupCount;
+		quint32 dependencyCount;
+		quint32 pathSize;
+
+		float center[3];
+		float scale;
+
+		quint64 vertexOffset;
+		quint64 indexOffset;
+		quint64 materialOffset;
+		quint64 groupOffset;
+		quint64 dependencyOffset;
+		quint64 pathOffset;
+	};
+
+	struct CacheMaterial
+	{
+		char name[MaterialNameLength];
+		float ambient[4];
+		float diffuse[4];
+		float specular[4];
+		float shininess;
+	};
+
+	struct CacheGroup
+	{
+		qint32 material;
+		qint32 first;
+		qint32 count;
+	};
+
+	// The path is stored in UTF-8 at pathOffset + offset, and is not null terminated.
+	struct CacheDependency
+	{
+		qint64 size;
+		qint64 time;
+		quint32 offset;
+		quint32 length;
+	};
+
+	static QString cacheDir()
+	{
+		return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/qshaderedit/meshes";
+	}
+
+	static QString cacheFileName(const QFileInfo & source)
+	{
+		QByteArray key = QCryptographicHash::hash(source.absoluteFilePath().toUtf8(), QCryptographicHash::Sha1);
+		return cacheDir() + "/" + QString::fromLatin1(key.toHex()) + ".mesh";
+	}
+
+	static QByteArray sourceSignature(const QFileInfo & source)
+	{
+		QFile file(source.absoluteFilePath());
+		if (!file.open(QIODevice::ReadOnly)) {
+			return QByteArray();
+		}
+
+		QCryptographicHash hash(QCryptographicHash::Sha1);
+		hash.addData(file.read(s_signatureBlockSize));
+		if (file.size() > s_signatureBlockSize) {
+			file.seek(qMax(s_signatureBlockSize, file.size() - s_signatureBlockSize));
+			hash.addData(file.read(s_signatureBlockSize));
+		}
+		return hash.result();
+	}
+
+	// Missing files get a size of -1, so that the entry is invalidated when they are created.
+	static void fileStamp(const QFileInfo & info, qint64 * size, qint64 * time)
+	{
+		*size = info.exists() ? info.size() : -1;
+		*time = info.exists() ? info.lastModified().toMSecsSinceEpoch() : 0;
+	}
+
+	static quint64 align(quint64 offset)
+	{
+		return (offset + 15) & ~quint64(15);
+	}
+
+	// Whether count elements starting at offset are inside the file, without overflowing.
+	static bool fits(quint64 offset, quint64 count, quint64 elementSize, qint64 size)
+	{
+		return offset <= quint64(size) && count <= (quint64(size) - offset) / elementSize;
+	}
+
+} // namespace
+
+
+// static
+bool MeshCache::load(const QString & fileName, Mesh * mesh, MeshData * data)
+{
+	Q_ASSERT(mesh != NULL);
+	Q_ASSERT(data != NULL);
+
+	QFileInfo source(fileName);
+	QFile file(cacheFileName(source));
+	if (!source.exists() || !file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	const qint64 size = file.size();
+	if (size < qint64(sizeof(CacheHeader))) {
+		return false;
+	}
+
+	const uchar * base = file.map(0, size);
+	if (base == NULL) {
+		return false;
+	}
+
+	CacheHeader header;
+	memcpy(&header, base, sizeof(header));
+
+	if (header.magic != s_fileMagic || header.version != s_fileVersion || header.vertexSize != sizeof(MeshVertex) ||
+		header.sourceSize != source.size() || header.sourceTime != source.lastModified().toMSecsSinceEpoch()) {
+		return false;
+	}
+	if (sourceSignature(source) != QByteArray(header.sourceSignature, sizeof(header.sourceSignature))) {
+		return false;
+	}
+
+	// Don't trust the offsets.
+	if (!fits(header.vertexOffset, header.vertexCount, sizeof(MeshVertex), size) ||
+		!fits(header.indexOffset, header.indexCount, sizeof(quint32), size) ||
+		!fits(header.materialOffset, header.materialCount, sizeof(CacheMaterial), size) ||
+		!fits(header.groupOffset, header.groupCount, sizeof(CacheGroup), size) ||
+		!fits(header.dependencyOffset, header.dependencyCount, sizeof(CacheDependency), size) ||
+		!fits(header.pathOffset, header.pathSize, 1, size)) {
+		return false;
+	}
+	if (header.vertexOffset % sizeof(float) != 0 || header.indexOffset % sizeof(quint32) != 0) {
+		return false;
+	}
+
+	// The materials come from the material libraries, check that none of them changed.
+	QStringList dependencies;
+	for (quint32 i = 0; i < header.dependencyCount; i++) {
+		CacheDependency cd;
+		memcpy(&cd, base + header.dependencyOffset + i * sizeof(CacheDependency), sizeof(cd));
+
+		if (cd.offset > header.pathSize || cd.length > header.pathSize - cd.offset) {
+			return false;
+		}
+
+		QString path = QString::fromUtf8((const char *)base + header.pathOffset + cd.offset, cd.length);
+		qint64 dependencySize, dependencyTime;
+		fileStamp(QFileInfo(path), &dependencySize, &dependencyTime);
+		if (cd.size != dependencySize || cd.time != dependencyTime) {
+			return false;
+		}
+		dependencies.append(path);
+	}
+
+	// Nor the indices, the draws would read outside of the vertex buffer.
+	const quint32 * indices = (const quint32 *)(base + header.indexOffset);
+	for (quint32 i = 0; i < header.indexCount; i++) {
+		if (indices[i] >= header.vertexCount) {
+			return false;
+		}
+	}
+
+	data->vertices.clear();
+	data->indices.clear();
+
+	data->materials.resize(header.materialCount);
+	for (quint32 i = 0; i < header.materialCount; i++) {
+		CacheMaterial cm;
+		memcpy(&cm, base + header.materialOffset + i * sizeof(CacheMaterial), sizeof(cm));
+
+		MeshMaterial & material = data->materials[i];
+		material.name = QString::fromUtf8(cm.name, qstrnlen(cm.name, MaterialNameLength));
+		memcpy(material.ambient, cm.ambient, sizeof(material.ambient));
+		memcpy(material.diffuse, cm.diffuse, sizeof(material.diffuse));
+		memcpy(material.specular, cm.specular, sizeof(material.specular));
+		material.shininess = cm.shininess;
+	}
+
+	data->groups.resize(header.groupCount);
+	for (quint32 i = 0; i < header.groupCount; i++) {
+		CacheGroup cg;
+		memcpy(&cg, base + header.groupOffset + i * sizeof(CacheGroup), sizeof(cg));
+
+		if (cg.material < 0 || quint32(cg.material) >= header.materialCount ||
+			cg.first < 0 || cg.count < 0 || quint32(cg.first) + quint32(cg.count) > header.indexCount) {
+			return false;
+		}
+
+		data->groups[i].material = cg.material;
+		data->groups[i].first = cg.first;
+		data->groups[i].count = cg.count;
+	}
+
+	data->dependencies = dependencies;
+
+	memcpy(data->center, header.center, sizeof(data->center));
+	data->scale = header.scale;
+
+	// Straight from the mapped file to the buffers.
+	mesh->upload((const MeshVertex *)(base + header.vertexOffset), header.vertexCount, indices, header.indexCount);
+
+	return true;
+}
+
+// static
+void MeshCache::store(const QString & fileName, const MeshData & data)
+{
+	QFileInfo source(fileName);
+	if (!source.exists() || !QDir().mkpath(cacheDir())) {
+		return;
+	}
+
+	CacheHeader header;
+	memset(&header, 0, sizeof(header));
+	header.magic = s_fileMagic;
+	header.version = s_fileVersion;
+	header.vertexSize = sizeof(MeshVertex);
+	header.sourceSize = source.size();
+	header.sourceTime = source.lastModified().toMSecsSinceEpoch();
+
+	QByteArray signature = sourceSignature(source);
+	if (signature.size() != sizeof(header.sourceSignature)) {
+		return;
+	}
+	memcpy(header.sourceSignature, signature.constData(), sizeof(header.sourceSignature));
+
+	header.vertexCount = data.vertices.count();
+	header.indexCount = data.indices.count();
+	header.materialCount = data.materials.count();
+	header.groupCount = data.groups.count();
+	memcpy(header.center, data.center, sizeof(header.center));
+	header.scale = data.scale;
+
+	header.vertexOffset = align(sizeof(CacheHeader));
+	header.indexOffset = align(header.vertexOffset + quint64(header.vertexCount) * sizeof(MeshVertex));
+	header.materialOffset = align(header.indexOffset + quint64(header.indexCount) * sizeof(quint32));
+	header.groupOffset = align(header.materialOffset + quint64(header.materialCount) * sizeof(CacheMaterial));
+
+	QVector<CacheDependency> dependencies;
+	QByteArray paths;
+	foreach (const QString & dependency, data.dependencies) {
+		QFileInfo info(dependency);
+		QByteArray path = info.absoluteFilePath().toUtf8();
+
+		CacheDependency cd;
+		fileStamp(info, &cd.size, &cd.time);
+		cd.offset = paths.size();
+		cd.length = path.size();
+		dependencies.append(cd);
+		paths.append(path);
+	}
+
+	header.dependencyCount = dependencies.count();
+	header.pathSize = paths.size();
+	header.dependencyOffset = align(header.groupOffset + quint64(header.groupCount) * sizeof(CacheGroup));
+	header.pathOffset = align(header.dependencyOffset + quint64(header.dependencyCount) * sizeof(CacheDependency));
+
+	// Write to a temporary file, so that a partial entry is never read.
+	QSaveFile file(cacheFileName(source));
+	if (!file.open(QIODevice::WriteOnly)) {
+		return;
+	}
+
+	static const char s_padding[16] = {0};
+
+	file.write((const char *)&header, sizeof(header));
+
+	file.write(s_padding, header.vertexOffset - file.pos());
+	file.write((const char *)data.vertices.constData(), header.vertexCount * sizeof(MeshVertex));
+
+	file.write(s_padding, header.indexOffset - file.pos());
+	file.write((const char *)data.indices.constData(), header.indexCount * sizeof(quint32));
+
+	file.write(s_padding, header.materialOffset - file.pos());
+	foreach (const MeshMaterial & material, data.materials) {
+		CacheMaterial cm;
+		memset(&cm, 0, sizeof(cm));
+		QByteArray name = material.name.toUtf8().left(MaterialNameLength);
+		memcpy(cm.name, name.constData(), name.size());
+		memcpy(cm.ambient, material.ambient, sizeof(cm.ambient));
+		memcpy(cm.diffuse, material.diffuse, sizeof(cm.diffuse));
+		memcpy(cm.specular, material.specular, sizeof(cm.specular));
+		cm.shininess = material.shininess;
+		file.write((const char *)&cm, sizeof(cm));
+	}
+
+	file.write(s_padding, header.groupOffset - file.pos());
+	foreach (const MeshGroup & group, data.groups) {
+		CacheGroup cg;
+		cg.material = group.material;
+		cg.first = group.first;
+		cg.count = group.count;
+		file.write((const char *)&cg, sizeof(cg));
+	}
+
+	file.write(s_padding, header.dependencyOffset - file.pos());
+	file.write((const char *)dependencies.constData(), header.dependencyCount * sizeof(CacheDependency));
+
+	file.write(s_padding, header.pathOffset - file.pos());
+	file.write(paths);
+
+	file.commit();
+}
@@ -0,0 +1,45 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef MESHCACHE_H
+#define MESHCACHE_H
+
+#include "mesh.h"
+
+#include <QString>
+
+
+/// Cache of imported models, in a binary format that is mapped and uploaded as it is.
+/// Entries are keyed by the path of the source file and are invalidated when its size,
+/// modification time or content signature change, or when the size or modification
+/// time of one of its dependencies change.
+class MeshCache
+{
+public:
+	// Upload the cached geometry of the given source file to the mesh, and return the
+	// materials, groups, dependencies and bounds in data. The vertices and indices of data are left empty.
+	// Returns false if there's no valid entry. Needs a current context.
+	static bool load(const QString & fileName, Mesh * mesh, MeshData * data);
+
+	// Store the geometry imported from the given source file.
+	static void store(const QString & fileName, const MeshData & data);
+};
+
+
+#endif // MESHCACHE_H
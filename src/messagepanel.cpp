@@ -18,86 +18,236 @@
 */
 
 #include "messagepanel.h"
-#include "outputparser.h"
 
 #include <Qt>
-#include <QKeyEvent>
-#include <QTextEdit>
-#include <QTextBlock>
-#include <QTextCursor>
+#include <QAbstractListModel>
+#include <QListView>
+#include <QToolButton>
+#include <QVBoxLayout>
+#include <QHBoxLayout>
+#include <QVector>
+#include <QHash>
+#include <QColor>
 
+#include <algorithm>
+#include <climits>
 
-class LogData: public QTextBlockUserData
+
+/// Append only list of messages, filtered by type. Repeated messages are
+/// shown once, with the number of times they were logged.
+class MessageModel : public QAbstractListModel
 {
 public:
-	LogData(int i, int l, int c):
-		inputNumber(i), line(l), column(c)
-	{ }
+	enum Role {
+		InputRole = Qt::UserRole,
+		LineRole,
+		ColumnRole
+	};
+
+	MessageModel(QObject * parent) : QAbstractListModel(parent), m_filter(AllTypes)
+	{
+		m_typeCount[MessagePanel::Info] = 0;
+		m_typeCount[MessagePanel::Warning] = 0;
+		m_typeCount[MessagePanel::Error] = 0;
+	}
+
+	// Queue a message, it shows up with the next commit.
+	void append(const QString & text, MessagePanel::Type type, int inputNumber, int line, int column)
+	{
+		Message message;
+		message.text = text;
+		message.type = type;
+		message.inputNumber = inputNumber;
+		message.line = line;
+		message.column = column;
+		message.count = 1;
+		m_pending.append(message);
+	}
+
+	bool hasPending() const
+	{
+		return !m_pending.isEmpty();
+	}
+
+	// Add the queued messages with a single insertion.
+	void commit()
+	{
+		if (m_pending.isEmpty())
+			return;
+
+		int firstChanged = INT_MAX;
+		int lastChanged = -1;
+		QVector<int> inserted;
+
+		foreach (const Message & message, m_pending)
+		{
+			const QString key = QString("%1:%2:%3:%4:").arg(message.type).arg(message.inputNumber).arg(message.line).arg(message.column) + message.text;
+
+			QHash<QString, int>::const_iterator it = m_index.constFind(key);
+			if (it != m_index.constEnd())
+			{
+				Message & original = m_messages[it.value()];
+				original.count++;
+
+				const int row = visibleRow(it.value());
+				if (row != -1) {
+					firstChanged = qMin(firstChanged, row);
+					lastChanged = qMax(lastChanged, row);
+				}
+				continue;
+			}
+
+			m_index.insert(key, m_messages.count());
+			m_typeCount[message.type]++;
+			if (m_filter & (1 << message.type))
+				inserted.append(m_messages.count());
+			m_messages.append(message);
+		}
+		m_pending.clear();
+
+		if (!inserted.isEmpty())
+		{
+			beginInsertRows(QModelIndex(), m_visible.count(), m_visible.count() + inserted.count() - 1);
+			m_visible += inserted;
+			endInsertRows();
+		}
+		if (lastChanged != -1)
+		{
+			emit dataChanged(index(firstChanged), index(lastChanged));
+		}
+	}
+
+	void clear()
+	{
+		beginResetModel();
+		m_messages.clear();
+		m_visible.clear();
+		m_pending.clear();
+		m_index.clear();
+		m_typeCount[MessagePanel::Info] = 0;
+		m_typeCount[MessagePanel::Warning] = 0;
+		m_typeCount[MessagePanel::Error] = 0;
+		endResetModel();
+	}
+
+	void setTypeVisible(MessagePanel::Type type, bool visible)
+	{
+		const int filter = visible ? (m_filter | (1 << type)) : (m_filter & ~(1 << type));
+		if (filter == m_filter)
+			return;
+
+		beginResetModel();
+		m_filter = filter;
+		m_visible.clear();
+		for (int i = 0; i < m_messages.count(); i++) {
+			if (m_filter & (1 << m_messages.at(i).type))
+				m_visible.append(i);
+		}
+		endResetModel();
+	}
+
+	// Number of different messages of the given type.
+	int typeCount(MessagePanel::Type type) const
+	{
+		return m_typeCount[type];
+	}
+
+	virtual int rowCount(const QModelIndex & parent = QModelIndex()) const
+	{
+		return parent.isValid() ? 0 : m_visible.count();
+	}
 
-	int inputNumber;
-	int line;
-	int column;
+	virtual QVariant data(const QModelIndex & index, int role = Qt::DisplayRole) const
+	{
+		if (!index.isValid() || index.row() >= m_visible.count())
+			return QVariant();
+
+		const Message & message = m_messages.at(m_visible.at(index.row()));
+
+		switch (role) {
+			case Qt::DisplayRole:
+				if (message.count > 1)
+					return QString("%1 (x%2)").arg(message.text).arg(message.count);
+				return message.text;
+			case Qt::ForegroundRole:
+				switch (message.type) {
+					case MessagePanel::Info:
+						return QColor(0, 160, 0);
+					case MessagePanel::Warning:
+						return QColor(160, 160, 0);
+					case MessagePanel::Error:
+						return QColor(160, 0, 0);
+				}
+				break;
+			case InputRole:
+				return message.inputNumber;
+			case LineRole:
+				return message.line;
+			case ColumnRole:
+				return message.column;
+		}
+		return QVariant();
+	}
+
+private:
+	enum { AllTypes = (1 << MessagePanel::Info) | (1 << MessagePanel::Warning) | (1 << MessagePanel::Error) };
+
+	struct Message
+	{
+		QString text;
+		MessagePanel::Type type;
+		int inputNumber;
+		int line;
+		int column;
+		int count;
+	};
+
+	// Row of the message, or -1 if it's filtered out. The rows are sorted by message.
+	int visibleRow(int message) const
+	{
+		QVector<int>::const_iterator it = std::lower_bound(m_visible.constBegin(), m_visible.constEnd(), message);
+		if (it == m_visible.constEnd() || *it != message)
+			return -1;
+		return int(it - m_visible.constBegin());
+	}
+
+	QVector<Message> m_messages;
+	QVector<int> m_visible;		// Indices of the messages that pass the filter.
+	QVector<Message> m_pending;
+	QHash<QString, int> m_index;	// Message key to index, to merge the repeated ones.
+	int m_typeCount[3];
+	int m_filter;
 };
 
 
 MessagePanel::MessagePanel(const QString & title, QWidget * parent /*= 0*/, Qt::WindowFlags flags /*= 0*/) :
-	QDockWidget(title, parent, flags), m_log(NULL)
+	QDockWidget(title, parent, flags), m_view(NULL), m_model(NULL)
 {
 	initWidget();
 }
 
 MessagePanel::MessagePanel(QWidget * parent /*= 0*/, Qt::WindowFlags flags /*= 0*/) :
-	QDockWidget(parent, flags), m_log(NULL)
+	QDockWidget(parent, flags), m_view(NULL), m_model(NULL)
 {
 	initWidget();
 }
 
 MessagePanel::~MessagePanel()
 {
-	delete m_log;
-	m_log = NULL;
 }
 
 void MessagePanel::log(const QString& s, Type type, int inputNumber, int line, int column)
 {
-	if (s.trimmed().isEmpty())
-		return;
-
-	QTextCursor cursor(m_log->textCursor());
-
-	QTextCharFormat format;
-	switch (type) {
-		case Info:
-			format.setForeground(QColor(0, 160, 0));
-			break;
-		case Warning:
-			format.setForeground(QColor(160, 160, 0));
-			break;
-		case Error:
-			format.setForeground(QColor(160, 0, 0));
-			break;
+	// Each line is a row of the list.
+	QStringList lines = s.split('\n', QString::SkipEmptyParts);
+	foreach (const QString & text, lines) {
+		if (!text.trimmed().isEmpty())
+			m_model->append(text, type, inputNumber, line, column);
 	}
 
-	cursor.setCharFormat(format);
-	cursor.insertText(s);
-	cursor.block().setUserData(new LogData(inputNumber, line, column));
-
-	cursor.insertBlock();
-	m_log->setTextCursor(cursor);
-}
-
-void MessagePanel::log(const QString& s, int inputNumber, OutputParser* parser)
-{
-	if (parser == NULL) {
-		log(s, MessagePanel::Error, inputNumber);
-	}
-	else {
-		QStringList lines = s.trimmed().split('\n', QString::SkipEmptyParts);
-		foreach (QString line, lines) {
-			parser->parseLine(line);
-			log(line, parser->type(), inputNumber, parser->line(), parser->column());
-		}
-	}
+	// Everything logged until the event loop runs again goes in one batch.
+	if (m_model->hasPending() && !m_flushTimer.isActive())
+		m_flushTimer.start();
 }
 
 QSize MessagePanel::sizeHint() const
@@ -107,18 +257,57 @@ QSize MessagePanel::sizeHint() const
 
 void MessagePanel::initWidget()
 {
-	m_log = new QTextEdit(this);
-	m_log->setUndoRedoEnabled(false);
-	m_log->setReadOnly(true);
-	m_log->zoomOut();
-	m_log->viewport()->installEventFilter(this);
-	m_log->setFocusPolicy(Qt::NoFocus);
-	setWidget(m_log);
+	m_model = new MessageModel(this);
+
+	m_view = new QListView;
+	m_view->setModel(m_model);
+	m_view->setUniformItemSizes(true);
+	m_view->setEditTriggers(QAbstractItemView::NoEditTriggers);
+	m_view->setFocusPolicy(Qt::NoFocus);
+	QFont font = m_view->font();
+	if (font.pointSize() > 1) {
+		font.setPointSize(font.pointSize() - 1);
+		m_view->setFont(font);
+	}
+	connect(m_view, SIGNAL(clicked(const QModelIndex &)), this, SLOT(onMessageClicked(const QModelIndex &)));
+
+	m_errorButton = new QToolButton;
+	m_warningButton = new QToolButton;
+	m_infoButton = new QToolButton;
+
+	QHBoxLayout * filterLayout = new QHBoxLayout;
+	filterLayout->setMargin(0);
+	foreach (QToolButton * button, QList<QToolButton *>() << m_errorButton << m_warningButton << m_infoButton) {
+		button->setCheckable(true);
+		button->setChecked(true);
+		button->setAutoRaise(true);
+		connect(button, SIGNAL(toggled(bool)), this, SLOT(updateFilter()));
+		filterLayout->addWidget(button);
+	}
+	filterLayout->addStretch();
+
+	QVBoxLayout * layout = new QVBoxLayout;
+	layout->setMargin(0);
+	layout->setSpacing(0);
+	layout->addLayout(filterLayout);
+	layout->addWidget(m_view);
+
+	QWidget * widget = new QWidget(this);
+	widget->setLayout(layout);
+	setWidget(widget);
+
+	m_flushTimer.setSingleShot(true);
+	m_flushTimer.setInterval(0);
+	connect(&m_flushTimer, SIGNAL(timeout()), this, SLOT(flush()));
+
+	updateFilter();
 }
 
 void MessagePanel::clear()
 {
-	m_log->clear();
+	m_flushTimer.stop();
+	m_model->clear();
+	updateFilter();
 }
 
 void MessagePanel::error(QString s, int inputNumber, int line, int column)
@@ -136,20 +325,30 @@ void MessagePanel::info(QString s, int inputNumber, int line, int column)
 	log(s, Info, inputNumber, line, column);
 }
 
-bool MessagePanel::eventFilter(QObject* object, QEvent* event)
+void MessagePanel::flush()
 {
-	if (object == m_log->viewport() && event->type() == QEvent::MouseButtonRelease)
-	{
-		QMouseEvent* mouseEvent = (QMouseEvent*)event;
-		QTextCursor cursor = m_log->cursorForPosition(mouseEvent->pos());
-		if (!cursor.isNull())
-		{
-			LogData* data = (LogData*)cursor.block().userData();
-			if (data && data->inputNumber >= 0 && data->line >= 0)
-				emit(messageClicked(data->inputNumber, data->line, data->column));
-			return true;
-		}
-	}
+	m_model->commit();
+	m_view->scrollToBottom();
+	updateFilter();
+}
+
+void MessagePanel::updateFilter()
+{
+	m_model->setTypeVisible(Error, m_errorButton->isChecked());
+	m_model->setTypeVisible(Warning, m_warningButton->isChecked());
+	m_model->setTypeVisible(Info, m_infoButton->isChecked());
+
+	m_errorButton->setText(tr("Errors (%1)").arg(m_model->typeCount(Error)));
+	m_warningButton->setText(tr("Warnings (%1)").arg(m_model->typeCount(Warning)));
+	m_infoButton->setText(tr("Messages (%1)").arg(m_model->typeCount(Info)));
+}
+
+void MessagePanel::onMessageClicked(const QModelIndex & index)
+{
+	const int inputNumber = index.data(MessageModel::InputRole).toInt();
+	const int line = index.data(MessageModel::LineRole).toInt();
+	const int column = index.data(MessageModel::ColumnRole).toInt();
 
-	return QDockWidget::eventFilter(object, event);
+	if (inputNumber >= 0 && line >= 0)
+		emit(messageClicked(inputNumber, line, column));
 }
@@ -21,11 +21,17 @@
 #define MESSAGEPANEL_H
 
 #include <QDockWidget>
+#include <QTimer>
 
-class QTextEdit;
-class OutputParser;
+class QListView;
+class QModelIndex;
+class QToolButton;
+class MessageModel;
 
 
+/// Build log. The messages are kept in a list model and shown by a list view,
+/// which only lays out the rows in view, so long logs don't slow the editor.
+/// The messages logged in a row are added in a single batch.
 class MessagePanel : public QDockWidget
 {
 	Q_OBJECT
@@ -47,8 +53,7 @@ public:
 public slots:
 	void clear();
 
-	void log(const QString& s, Type type = Info, int inputNumber = -1, int line = -1, int column = -1);
-	void log(const QString& s, int inputNumber, OutputParser* parser);
+	void log(const QString& s, MessagePanel::Type type = Info, int inputNumber = -1, int line = -1, int column = -1);
 	
 	void error(QString s, int inputNumber = -1, int line = -1, int column = -1);
 	void warning(QString s, int inputNumber = -1, int line = -1, int column = -1);
@@ -59,8 +64,10 @@ signals:
 	void messageClicked(int inputNumber, int line, int column);
 
 
-protected:
-	bool eventFilter(QObject* object, QEvent* event);
+private slots:
+	void flush();
+	void updateFilter();
+	void onMessageClicked(const QModelIndex & index);
 
 
 private:
@@ -68,10 +75,19 @@ private:
 
 
 private:
-	QTextEdit * m_log;
+	QListView * m_view;
+	MessageModel * m_model;
+	QTimer m_flushTimer;
+
+	QToolButton * m_errorButton;
+	QToolButton * m_warningButton;
+	QToolButton * m_infoButton;
 
 };
 
 
 
+Q_DECLARE_METATYPE(MessagePanel::Type)
+
+
 #endif // MESSAGEPANEL_H
@@ -0,0 +1,603 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "objloader.h"
+
+#include <QFile>
+#include <QFileInfo>
+#include <QDir>
+#include <QHash>
+#include <QThread>
+#include <QThreadPool>
+#include <QRunnable>
+
+#include <math.h>
+#include <string.h>
+
+namespace {
+
+	// Chunks smaller than this are not worth a thread.
+	static const qint64 s_minChunkSize = 1 << 20;
+
+	// A usemtl or mtllib statement, applied before the given face.
+	struct ObjCommand
+	{
+		int face;
+		bool library;
+		QString name;
+	};
+
+	// One face corner, the attribute indices are -1 when missing.
+	struct ObjCorner
+	{
+		int pos;
+		int texcoord;
+		int normal;
+
+		bool operator==(const ObjCorner & c) const
+		{
+			return pos == c.pos && texcoord == c.texcoord && normal == c.normal;
+		}
+	};
+
+	inline uint qHash(const ObjCorner & c)
+	{
+		return (uint(c.pos) * 73856093u) ^ (uint(c.texcoord) * 19349663u) ^ (uint(c.normal) * 83492791u);
+	}
+
+	// A range of whole lines of the file.
+	struct ObjChunk
+	{
+		const char * begin;
+		const char * end;
+
+		// Number of elements in this chunk, and in the chunks before it.
+		int positionCount, texcoordCount, normalCount;
+		int positionOffset, texcoordOffset, normalOffset;
+
+		QVector<ObjCorner> corners;
+		QVector<int> faceSizes;
+		QVector<ObjCommand> commands;
+	};
+
+	// Where the chunks write the attributes, each one to its own range.
+	struct ObjAttributes
+	{
+		QVector<float> positions;
+		QVector<float> texcoords;
+		QVector<float> normals;
+	};
+
+
+	inline bool isSpace(char c)
+	{
+		return c == ' ' || c == '\t' || c == '\r';
+	}
+
+	inline bool isDigit(char c)
+	{
+		return c >= '0' && c <= '9';
+	}
+
+	inline const char * skipSpaces(const char * p, const char * end)
+	{
+		while (p < end && isSpace(*p)) p++;
+		return p;
+	}
+
+	inline const char * nextLine(const char * p, const char * end)
+	{
+		const char * eol = (const char *)memchr(p, '\n', end - p);
+		return eol != NULL ? eol + 1 : end;
+	}
+
+	// Return true if the line starts with the given keyword followed by a space.
+	inline bool isKeyword(const char * p, const char * end, const char * keyword, int length)
+	{
+		return end - p > length && memcmp(p, keyword, length) == 0 && isSpace(p[length]);
+	}
+
+	static bool parseInt(const char *& p, const char * end, int * value)
+	{
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+		if (p >= end || !isDigit(*p)) {
+			return false;
+		}
+
+		int v = 0;
+		while (p < end && isDigit(*p)) {
+			v = v * 10 + (*p - '0');
+			p++;
+		}
+		*value = negative ? -v : v;
+		return true;
+	}
+
+	// Locale independent float parser, much faster than strtod.
+	static bool parseFloat(const char *& p, const char * end, float * value)
+	{
+		static const double s_powers[] = {
+			1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10,
+			1e11, 1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+		};
+
+		const char * start = p;
+
+		bool negative = false;
+		if (p < end && (*p == '-' || *p == '+')) {
+			negative = (*p == '-');
+			p++;
+		}
+
+		quint64 mantissa = 0;
+		int exponent = 0;
+		int digits = 0;
+
+		while (p < end && isDigit(*p)) {
+			if (mantissa < Q_UINT64_C(100000000000000000)) mantissa = mantissa * 10 + (*p - '0');
+			else exponent++;
+			p++;
+			digits++;
+		}
+		if (p < end && *p == '.') {
+			p++;
+			while (p < end && isDigit(*p)) {
+				if (mantissa < Q_UINT64_C(100000000000000000)) {
+					mantissa = mantissa * 10 + (*p - '0');
+					exponent--;
+				}
+				p++;
+				digits++;
+			}
+		}
+		if (digits == 0) {
+			p = start;
+			return false;
+		}
+
+		if (p < end && (*p == 'e' || *p == 'E')) {
+			const char * e = p + 1;
+			int exp;
+			if (parseInt(e, end, &exp)) {
+				exponent += exp;
+				p = e;
+			}
+		}
+
+		double v = double(mantissa);
+		if (exponent < 0) {
+			v /= (-exponent <= 22) ? s_powers[-exponent] : pow(10.0, -exponent);
+		}
+		else if (exponent > 0) {
+			v *= (exponent <= 22) ? s_powers[exponent] : pow(10.0, exponent);
+		}
+
+		*value = float(negative ? -v : v);
+		return true;
+	}
+
+	// Parse up to count floats, the missing ones are left untouched.
+	static void parseFloats(const char * p, const char * end, float * values, int count)
+	{
+		for (int i = 0; i < count; i++) {
+			p = skipSpaces(p, end);
+			if (!parseFloat(p, end, values + i)) {
+				break;
+			}
+		}
+	}
+
+	// Rest of the line, without comments and surrounding spaces.
+	static QString parseName(const char * p, const char * end)
+	{
+		const char * eol = p;
+		while (eol < end && *eol != '\n' && *eol != '#') eol++;
+		return QString::fromUtf8(p, eol - p).trimmed();
+	}
+
+	// Convert an OBJ index, 1 based or relative to the end, to a 0 based index.
+	inline int resolveIndex(int index, int count)
+	{
+		if (index > 0) return index - 1;
+		if (index < 0) return count + index;
+		return -1;
+	}
+
+
+	// First pass, count the attributes so that the chunks know where to write theirs.
+	class CountTask : public QRunnable
+	{
+	public:
+		CountTask(ObjChunk * chunk) : m_chunk(chunk) { }
+
+		virtual void run()
+		{
+			ObjChunk & c = *m_chunk;
+			c.positionCount = c.texcoordCount = c.normalCount = 0;
+
+			for (const char * p = c.begin; p < c.end; p = nextLine(p, c.end)) {
+				p = skipSpaces(p, c.end);
+				if (p + 1 >= c.end || p[0] != 'v') {
+					continue;
+				}
+				if (isSpace(p[1])) c.positionCount++;
+				else if (p[1] == 't') c.texcoordCount++;
+				else if (p[1] == 'n') c.normalCount++;
+			}
+		}
+
+	private:
+		ObjChunk * m_chunk;
+	};
+
+	// Second pass, parse the attributes and the faces.
+	class ParseTask : public QRunnable
+	{
+	public:
+		ParseTask(ObjChunk * chunk, ObjAttributes * attributes) : m_chunk(chunk), m_attributes(attributes) { }
+
+		virtual void run()
+		{
+			ObjChunk & c = *m_chunk;
+
+			float * positions = m_attributes->positions.data() + 3 * c.positionOffset;
+			float * texcoords = m_attributes->texcoords.data() + 2 * c.texcoordOffset;
+			float * normals = m_attributes->normals.data() + 3 * c.normalOffset;
+
+			int positionCount = c.positionOffset;
+			int texcoordCount = c.texcoordOffset;
+			int normalCount = c.normalOffset;
+
+			for (const char * p = c.begin; p < c.end; p = nextLine(p, c.end)) {
+				p = skipSpaces(p, c.end);
+				if (p >= c.end) {
+					break;
+				}
+
+				if (isKeyword(p, c.end, "v", 1)) {
+					positions[0] = positions[1] = positions[2] = 0.0f;
+					parseFloats(p + 1, c.end, positions, 3);
+					positions += 3;
+					positionCount++;
+				}
+				else if (isKeyword(p, c.end, "vt", 2)) {
+					texcoords[0] = texcoords[1] = 0.0f;
+					parseFloats(p + 2, c.end, texcoords, 2);
+					texcoords += 2;
+					texcoordCount++;
+				}
+				else if (isKeyword(p, c.end, "vn", 2)) {
+					normals[0] = normals[1] = normals[2] = 0.0f;
+					parseFloats(p + 2, c.end, normals, 3);
+					normals += 3;
+					normalCount++;
+				}
+				else if (isKeyword(p, c.end, "f", 1)) {
+					parseFace(p + 1, c.end, positionCount, texcoordCount, normalCount);
+				}
+				else if (isKeyword(p, c.end, "usemtl", 6) || isKeyword(p, c.end, "mtllib", 6)) {
+					ObjCommand command;
+					command.face = c.faceSizes.count();
+					command.library = (p[0] == 'm');
+					command.name = parseName(p + 6, c.end);
+					c.commands.append(command);
+				}
+			}
+		}
+
+	private:
+		void parseFace(const char * p, const char * end, int positionCount, int texcoordCount, int normalCount)
+		{
+			ObjChunk & c = *m_chunk;
+			int size = 0;
+
+			while (true) {
+				p = skipSpaces(p, end);
+
+				int index;
+				if (!parseInt(p, end, &index)) {
+					break;
+				}
+
+				ObjCorner corner;
+				corner.pos = resolveIndex(index, positionCount);
+				corner.texcoord = -1;
+				corner.normal = -1;
+
+				if (p < end && *p == '/') {
+					p++;
+					if (parseInt(p, end, &index)) {
+						corner.texcoord = resolveIndex(index, texcoordCount);
+					}
+					if (p < end && *p == '/') {
+						p++;
+						if (parseInt(p, end, &index)) {
+							corner.normal = resolveIndex(index, normalCount);
+						}
+					}
+				}
+
+				c.corners.append(corner);
+				size++;
+			}
+
+			c.faceSizes.append(size);
+		}
+
+		ObjChunk * m_chunk;
+		ObjAttributes * m_attributes;
+	};
+
+
+	// Load the materials of a mtl file.
+	static bool loadMaterialLib(const QString & fileName, QHash<QString, MeshMaterial> * materials)
+	{
+		QFile file(fileName);
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+
+		const QByteArray text = file.readAll();
+		const char * end = text.constData() + text.size();
+
+		MeshMaterial * current = NULL;
+		for (const char * p = text.constData(); p < end; p = nextLine(p, end)) {
+			p = skipSpaces(p, end);
+
+			if (isKeyword(p, end, "newmtl", 6)) {
+				QString name = parseName(p + 6, end);
+				current = &(*materials)[name];
+				*current = MeshMaterial();
+				current->name = name;
+			}
+			else if (current == NULL) {
+				continue;
+			}
+			else if (isKeyword(p, end, "Ka", 2)) {
+				parseFloats(p + 2, end, current->ambient, 3);
+			}
+			else if (isKeyword(p, end, "Kd", 2)) {
+				parseFloats(p + 2, end, current->diffuse, 3);
+			}
+			else if (isKeyword(p, end, "Ks", 2)) {
+				parseFloats(p + 2, end, current->specular, 3);
+				current->specular[3] = 1.0f;
+			}
+			else if (isKeyword(p, end, "Ns", 2)) {
+				parseFloats(p + 2, end, &current->shininess, 1);
+			}
+		}
+
+		return true;
+	}
+
+	static void computeBounds(const QVector<float> & positions, MeshData * data)
+	{
+		float vmin[3] = {1e10f, 1e10f, 1e10f};
+		float vmax[3] = {-1e10f, -1e10f, -1e10f};
+
+		for (int i = 0; i < positions.count(); i += 3) {
+			for (int c = 0; c < 3; c++) {
+				vmin[c] = qMin(vmin[c], positions[i + c]);
+				vmax[c] = qMax(vmax[c], positions[i + c]);
+			}
+		}
+
+		float extent = 0.0f;
+		for (int c = 0; c < 3; c++) {
+			data->center[c] = (vmax[c] + vmin[c]) * 0.5f;
+			extent = qMax(extent, vmax[c] - data->center[c]);
+		}
+		data->scale = extent > 0.0f ? 1.0f / extent : 1.0f;
+	}
+
+} // namespace
+
+
+// static
+bool ObjLoader::load(const QString & fileName, MeshData * data)
+{
+	Q_ASSERT(data != NULL);
+
+	QFile file(fileName);
+	if (!file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+
+	// Map the file, fall back to reading it when that's not possible.
+	QByteArray buffer;
+	const qint64 size = file.size();
+	const char * text = (const char *)file.map(0, size);
+	if (text == NULL) {
+		buffer = file.readAll();
+		text = buffer.constData();
+	}
+	const char * end = text + size;
+
+	// Split the file in chunks of whole lines.
+	int chunkCount = int(qBound(qint64(1), size / s_minChunkSize, qint64(4 * QThread::idealThreadCount())));
+	QVector<ObjChunk> chunks(chunkCount);
+
+	const char * p = text;
+	for (int i = 0; i < chunkCount; i++) {
+		chunks[i].begin = p;
+		p = (i == chunkCount - 1) ? end : nextLine(qMin(end, text + size * (i + 1) / chunkCount), end);
+		p = qMax(p, chunks[i].begin);
+		chunks[i].end = p;
+	}
+
+	QThreadPool pool;
+
+	for (int i = 0; i < chunkCount; i++) {
+		pool.start(new CountTask(&chunks[i]));
+	}
+	pool.waitForDone();
+
+	int positionCount = 0, texcoordCount = 0, normalCount = 0;
+	for (int i = 0; i < chunkCount; i++) {
+		chunks[i].positionOffset = positionCount;
+		chunks[i].texcoordOffset = texcoordCount;
+		chunks[i].normalOffset = normalCount;
+		positionCount += chunks[i].positionCount;
+		texcoordCount += chunks[i].texcoordCount;
+		normalCount += chunks[i].normalCount;
+	}
+
+	ObjAttributes attributes;
+	attributes.positions.resize(3 * positionCount);
+	attributes.texcoords.resize(2 * texcoordCount);
+	attributes.normals.resize(3 * normalCount);
+
+	for (int i = 0; i < chunkCount; i++) {
+		pool.start(new ParseTask(&chunks[i], &attributes));
+	}
+	pool.waitForDone();
+
+	// Build the mesh, with one index range per material. Material 0 is the default one.
+	data->vertices.clear();
+	data->indices.clear();
+	data->materials.clear();
+	data->groups.clear();
+	data->dependencies.clear();
+	data->materials.append(MeshMaterial());
+
+	QVector< QVector<quint32> > materialIndices(1);
+	QHash<QString, int> materialMap;
+	QHash<QString, QHash<QString, MeshMaterial> > materialLibs;
+	const QHash<QString, MeshMaterial> * currentLib = NULL;
+	int currentMaterial = 0;
+
+	QHash<ObjCorner, quint32> vertexMap;
+	vertexMap.reserve(positionCount);
+	data->vertices.reserve(positionCount);
+
+	bool missingNormals = false;
+	int invalidFaces = 0;
+	QVector<quint32> polygon;
+
+	for (int i = 0; i < chunkCount; i++) {
+		const ObjChunk & chunk = chunks[i];
+		const ObjCorner * corner = chunk.corners.constData();
+		int command = 0;
+
+		for (int face = 0; face < chunk.faceSizes.count(); face++) {
+			for (; command < chunk.commands.count() && chunk.commands[command].face == face; command++) {
+				const ObjCommand & cmd = chunk.commands[command];
+
+				if (cmd.library) {
+					if (!materialLibs.contains(cmd.name)) {
+						QString libFileName = QFileInfo(fileName).dir().filePath(cmd.name);
+						data->dependencies.append(libFileName);
+						if (!loadMaterialLib(libFileName, &materialLibs[cmd.name])) {
+							qWarning("Could not open material file: %s", qPrintable(libFileName));
+						}
+					}
+					currentLib = &materialLibs[cmd.name];
+				}
+				else if (currentLib != NULL && currentLib->contains(cmd.name)) {
+					if (!materialMap.contains(cmd.name)) {
+						materialMap.insert(cmd.name, data->materials.count());
+						data->materials.append(currentLib->value(cmd.name));
+						materialIndices.resize(data->materials.count());
+					}
+					currentMaterial = materialMap.value(cmd.name);
+				}
+				else {
+					currentMaterial = 0;
+				}
+			}
+
+			const int faceSize = chunk.faceSizes[face];
+			polygon.clear();
+
+			bool valid = faceSize >= 3;
+			for (int c = 0; c < faceSize && valid; c++) {
+				const ObjCorner & v = corner[c];
+				valid = v.pos >= 0 && v.pos < positionCount && v.texcoord < texcoordCount && v.normal < normalCount;
+				if (!valid) {
+					break;
+				}
+
+				QHash<ObjCorner, quint32>::const_iterator it = vertexMap.constFind(v);
+				if (it != vertexMap.constEnd()) {
+					polygon.append(it.value());
+					continue;
+				}
+
+				MeshVertex mv;
+				memset(&mv, 0, sizeof(mv));
+				memcpy(mv.position, attributes.positions.constData() + 3 * v.pos, sizeof(mv.position));
+				if (v.texcoord >= 0) {
+					memcpy(mv.texcoord, attributes.texcoords.constData() + 2 * v.texcoord, sizeof(mv.texcoord));
+				}
+				if (v.normal >= 0) {
+					memcpy(mv.normal, attributes.normals.constData() + 3 * v.normal, sizeof(mv.normal));
+				}
+				else {
+					missingNormals = true;
+				}
+
+				vertexMap.insert(v, data->vertices.count());
+				polygon.append(data->vertices.count());
+				data->vertices.append(mv);
+			}
+			corner += faceSize;
+
+			if (!valid) {
+				invalidFaces++;
+				continue;
+			}
+
+			// Triangulate the polygon as a fan.
+			QVector<quint32> & indices = materialIndices[currentMaterial];
+			for (int v = 2; v < polygon.count(); v++) {
+				indices << polygon[0] << polygon[v - 1] << polygon[v];
+			}
+		}
+	}
+
+	if (invalidFaces > 0) {
+		qWarning("%s: skipped %d invalid faces", qPrintable(fileName), invalidFaces);
+	}
+
+	for (int m = 0; m < materialIndices.count(); m++) {
+		if (materialIndices[m].isEmpty()) {
+			continue;
+		}
+		MeshGroup group;
+		group.material = m;
+		group.first = data->indices.count();
+		group.count = materialIndices[m].count();
+		data->groups.append(group);
+		data->indices += materialIndices[m];
+	}
+
+	if (missingNormals && normalCount == 0) {
+		Mesh::computeNormals(data->vertices, data->indices);
+	}
+	Mesh::computeTangents(data->vertices, data->indices);
+
+	computeBounds(attributes.positions, data);
+
+	return true;
+}
@@ -0,0 +1,39 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef OBJLOADER_H
+#define OBJLOADER_H
+
+#include "mesh.h"
+
+#include <QString>
+
+
+/// Wavefront OBJ importer.
+/// The file is memory mapped and parsed in chunks on several threads, faces are
+/// triangulated and vertices that share the same attributes are merged.
+class ObjLoader
+{
+public:
+	// Load the file and its material libraries. Returns false if the file can't be read.
+	static bool load(const QString & fileName, MeshData * data);
+};
+
+
+#endif // OBJLOADER_H
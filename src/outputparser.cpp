@@ -21,13 +21,15 @@
 #include "outputparser.h"
 
 
+// The patterns are not static, the parsers run on several build threads at once.
+
 void AtiGlslOutputParser::parseLine(const QString& line)
 {
-	static QRegExp s_errorPattern("^ERROR: \\d+:(\\d+).*$");
+	QRegExp errorPattern("^ERROR: \\d+:(\\d+).*$");
 
-	if (s_errorPattern.exactMatch(line)) {
+	if (errorPattern.exactMatch(line)) {
 		m_type = MessagePanel::Error;
-		m_line = s_errorPattern.cap(1).toInt();
+		m_line = errorPattern.cap(1).toInt();
 	}
 	else if (line.startsWith("ERROR")) {  // generic error without line number
 		m_type = MessagePanel::Error;
@@ -46,11 +48,11 @@ void AtiGlslOutputParser::parseLine(const QString& line)
 
 void AtiAsmOutputParser::parseLine(const QString& line)
 {
-	static QRegExp s_errorPattern("^(?:Error on )?line (\\d+):.*$");
+	QRegExp errorPattern("^(?:Error on )?line (\\d+):.*$");
 
-	if (s_errorPattern.exactMatch(line)) {
+	if (errorPattern.exactMatch(line)) {
 		m_type = MessagePanel::Error;
-		m_line = s_errorPattern.cap(1).toInt();
+		m_line = errorPattern.cap(1).toInt();
 	}
 	else {
 		m_type = MessagePanel::Info;
@@ -62,16 +64,16 @@ void AtiAsmOutputParser::parseLine(const QString& line)
 
 void NvidiaOutputParser::parseLine(const QString& line)
 {
-	static QRegExp s_errorPattern("^.*\\((\\d+)\\) : error C\\d+:.*$");
-	static QRegExp s_warningPattern("^.*\\((\\d+)\\) : warning C\\d+:.*$");
+	QRegExp errorPattern("^.*\\((\\d+)\\) : error C\\d+:.*$");
+	QRegExp warningPattern("^.*\\((\\d+)\\) : warning C\\d+:.*$");
 
-	if (s_errorPattern.exactMatch(line)) {
+	if (errorPattern.exactMatch(line)) {
 		m_type = MessagePanel::Error;
-		m_line = s_errorPattern.cap(1).toInt();
+		m_line = errorPattern.cap(1).toInt();
 	}
-	else if (s_warningPattern.exactMatch(line)) {
+	else if (warningPattern.exactMatch(line)) {
 		m_type = MessagePanel::Warning;
-		m_line = s_warningPattern.cap(1).toInt();
+		m_line = warningPattern.cap(1).toInt();
 	}
 	else {
 		m_type = MessagePanel::Info;
@@ -82,12 +84,33 @@ void NvidiaOutputParser::parseLine(const QString& line)
 
 void NvidiaAsmOutputParser::parseLine(const QString& line)
 {
-	static QRegExp s_errorPattern("^line (\\d+), column (\\-?\\d+):  error:.*$");
+	QRegExp errorPattern("^line (\\d+), column (\\-?\\d+):  error:.*$");
 
-	if (s_errorPattern.exactMatch(line)) {
+	if (errorPattern.exactMatch(line)) {
 		m_type = MessagePanel::Error;
-		m_line = s_errorPattern.cap(1).toInt();
-		m_column = s_errorPattern.cap(2).toInt();
+		m_line = errorPattern.cap(1).toInt();
+		m_column = errorPattern.cap(2).toInt();
+	}
+	else {
+		m_type = MessagePanel::Info;
+		m_line = -1;
+		m_column = -1;
+	}
+}
+
+void MesaGlslOutputParser::parseLine(const QString& line)
+{
+	QRegExp messagePattern("^\\d+:(\\d+)\\((\\d+)\\): (error|warning):.*$");
+
+	if (messagePattern.exactMatch(line)) {
+		m_type = (messagePattern.cap(3) == "error") ? MessagePanel::Error : MessagePanel::Warning;
+		m_line = messagePattern.cap(1).toInt();
+		m_column = messagePattern.cap(2).toInt();
+	}
+	else if (line.startsWith("error:")) {  // linker errors have no line number
+		m_type = MessagePanel::Error;
+		m_line = -1;
+		m_column = -1;
 	}
 	else {
 		m_type = MessagePanel::Info;
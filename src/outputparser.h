@@ -78,4 +78,11 @@ public:
 	void parseLine(const QString& line);
 };
 
+/// parses glsl output of the mesa drivers
+class MesaGlslOutputParser: public OutputParser
+{
+public:
+	void parseLine(const QString& line);
+};
+
 #endif
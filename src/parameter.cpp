@@ -296,5 +296,7 @@ void Parameter::setComponentValue(int idx, const QVariant & value)
 	
 	QList<QVariant> list = m_value.toList();
 	list.replace(idx, value);
-	m_value = list;
+	
+	// Go through setValue, so that derived classes are notified.
+	setValue(list);
 }
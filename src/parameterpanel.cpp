@@ -22,6 +22,7 @@
 #include "effect.h"
 #include "parametermodel.h"
 #include "parameterdelegate.h"
+#include "texmanager.h"
 
 #include <QHeaderView>
 
@@ -76,6 +77,9 @@ void ParameterPanel::initWidget()
 
 	//	m_view->setIndentation(0);	// @@ This would be nice if it didn't affect the roots.
 
+	// Refresh the icons of the textures loaded in the background.
+	connect(TextureLoader::instance(), SIGNAL(textureLoaded()), m_view->viewport(), SLOT(update()));
+
 	setWidget(m_view);
 }
 
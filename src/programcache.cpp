@@ -0,0 +1,291 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#include "programcache.h"
+
+#include <QCryptographicHash>
+#include <QDataStream>
+#include <QDir>
+#include <QFile>
+#include <QFileInfo>
+#include <QHash>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+namespace {
+
+	static const quint32 s_fileMagic = 0x51534250;	// 'QSBP'
+	static const quint32 s_fileVersion = 2;
+
+	// Binaries kept in memory, and on disk, before the least recently used are dropped.
+	static const qint64 s_memoryBudget = 32 << 20;
+	static const qint64 s_diskBudget = 256 << 20;
+
+	struct ProgramBinary
+	{
+		GLenum format;
+		QByteArray data;
+		QList<QByteArray> infoLogs;
+		quint64 lastUse;
+	};
+
+	/// Protects s_binaryMap, s_binaryBytes and s_useCounter; never held during file I/O.
+	static QMutex s_mutex;
+	static QHash<QByteArray, ProgramBinary> s_binaryMap;
+	static qint64 s_binaryBytes = 0;
+	static quint64 s_useCounter = 0;
+
+	// Program objects are handles on some platforms.
+	static GLuint programName(GLhandleARB program)
+	{
+		return (GLuint)(size_t)program;
+	}
+
+	static QString cacheDir()
+	{
+		return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/qshaderedit/programs";
+	}
+
+	static QString cacheFileName(const QByteArray & key)
+	{
+		return cacheDir() + "/" + QString::fromLatin1(key.toHex()) + ".bin";
+	}
+
+	static qint64 binaryBytes(const ProgramBinary & binary)
+	{
+		qint64 bytes = binary.data.size();
+		foreach (const QByteArray & infoLog, binary.infoLogs) {
+			bytes += infoLog.size();
+		}
+		return bytes;
+	}
+
+	/// Must be called with s_mutex held.
+	static void removeBinary(const QByteArray & key)
+	{
+		QHash<QByteArray, ProgramBinary>::iterator it = s_binaryMap.find(key);
+		if (it != s_binaryMap.end()) {
+			s_binaryBytes -= binaryBytes(it.value());
+			s_binaryMap.erase(it);
+		}
+	}
+
+	/// Must be called with s_mutex held.
+	static void insertBinary(const QByteArray & key, ProgramBinary binary)
+	{
+		removeBinary(key);
+		binary.lastUse = ++s_useCounter;
+		s_binaryMap.insert(key, binary);
+		s_binaryBytes += binaryBytes(binary);
+
+		// Evict the least recently used binaries, but always keep the new one.
+		while (s_binaryBytes > s_memoryBudget && s_binaryMap.count() > 1) {
+			QHash<QByteArray, ProgramBinary>::const_iterator oldest = s_binaryMap.constEnd();
+			for (QHash<QByteArray, ProgramBinary>::const_iterator it = s_binaryMap.constBegin(); it != s_binaryMap.constEnd(); ++it) {
+				if (oldest == s_binaryMap.constEnd() || it.value().lastUse < oldest.value().lastUse) {
+					oldest = it;
+				}
+			}
+			removeBinary(oldest.key());
+		}
+	}
+
+	static bool readBinary(const QByteArray & key, ProgramBinary * binary)
+	{
+		QFile file(cacheFileName(key));
+		if (!file.open(QIODevice::ReadOnly)) {
+			return false;
+		}
+
+		QDataStream stream(&file);
+		quint32 magic, version, format;
+		stream >> magic >> version;
+		if (stream.status() != QDataStream::Ok || magic != s_fileMagic || version != s_fileVersion) {
+			return false;
+		}
+		stream >> format >> binary->data >> binary->infoLogs;
+
+		if (stream.status() != QDataStream::Ok) {
+			return false;
+		}
+		binary->format = format;
+		return true;
+	}
+
+	static void writeBinary(const QByteArray & key, const ProgramBinary & binary)
+	{
+		if (!QDir().mkpath(cacheDir())) {
+			return;
+		}
+
+		// Write to a temporary file, so that a partial binary is never read,
+		// even when the editor and the batch compiler store the same key.
+		QSaveFile file(cacheFileName(key));
+		if (!file.open(QIODevice::WriteOnly)) {
+			return;
+		}
+
+		QDataStream stream(&file);
+		stream << s_fileMagic << s_fileVersion << quint32(binary.format) << binary.data << binary.infoLogs;
+		if (stream.status() == QDataStream::Ok) {
+			file.commit();
+		}
+	}
+
+	/// Deletes the oldest binaries until the cache directory fits in s_diskBudget.
+	static void pruneCacheDir()
+	{
+		QDir dir(cacheDir());
+		QFileInfoList files = dir.entryInfoList(QStringList() << "*.bin", QDir::Files, QDir::Time);
+
+		// Newest first, so everything past the budget is older than what is kept.
+		qint64 bytes = 0;
+		foreach (const QFileInfo & info, files) {
+			bytes += info.size();
+			if (bytes > s_diskBudget) {
+				QFile::remove(info.filePath());
+			}
+		}
+	}
+
+} // namespace
+
+
+// static
+bool ProgramCache::isSupported()
+{
+	return GLEW_ARB_get_program_binary;
+}
+
+// static
+QByteArray ProgramCache::key(const QList<QByteArray> & sources)
+{
+	QCryptographicHash hash(QCryptographicHash::Sha1);
+
+	// Binaries are only valid for the driver that produced them.
+	hash.addData((const char *)glGetString(GL_VENDOR));
+	hash.addData("\n");
+	hash.addData((const char *)glGetString(GL_RENDERER));
+	hash.addData("\n");
+	hash.addData((const char *)glGetString(GL_VERSION));
+
+	foreach (const QByteArray & source, sources) {
+		// Prefix the length so that moving text between inputs changes the key.
+		hash.addData(QByteArray::number(source.length()));
+		hash.addData("\n");
+		hash.addData(source);
+	}
+
+	return hash.result();
+}
+
+// static
+GLhandleARB ProgramCache::load(const QByteArray & key, QList<QByteArray> * infoLogs /*= NULL*/)
+{
+	if (!isSupported()) {
+		return 0;
+	}
+
+	ProgramBinary binary;
+	bool found = false;
+	{
+		QMutexLocker locker(&s_mutex);
+
+		QHash<QByteArray, ProgramBinary>::iterator it = s_binaryMap.find(key);
+		if (it != s_binaryMap.end()) {
+			it.value().lastUse = ++s_useCounter;
+			binary = it.value();
+			found = true;
+		}
+	}
+
+	if (!found) {
+		if (!readBinary(key, &binary)) {
+			return 0;
+		}
+
+		QMutexLocker locker(&s_mutex);
+		insertBinary(key, binary);
+	}
+
+	GLhandleARB program = glCreateProgramObjectARB();
+	glProgramBinary(programName(program), binary.format, binary.data.constData(), binary.data.size());
+
+	// The driver is free to reject binaries, for example after an update.
+	GLint linkSucceed = GL_FALSE;
+	glGetObjectParameterivARB(program, GL_OBJECT_LINK_STATUS_ARB, &linkSucceed);
+	if (linkSucceed == GL_FALSE) {
+		glDeleteObjectARB(program);
+		remove(key);
+		return 0;
+	}
+
+	if (infoLogs != NULL) {
+		*infoLogs = binary.infoLogs;
+	}
+	return program;
+}
+
+// static
+void ProgramCache::store(const QByteArray & key, GLhandleARB program, const QList<QByteArray> & infoLogs /*= QList<QByteArray>()*/)
+{
+	if (!isSupported()) {
+		return;
+	}
+
+	GLint length = 0;
+	glGetProgramiv(programName(program), GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) {
+		return;
+	}
+
+	ProgramBinary binary;
+	binary.data.resize(length);
+	glGetProgramBinary(programName(program), length, NULL, &binary.format, binary.data.data());
+	binary.infoLogs = infoLogs;
+
+	{
+		QMutexLocker locker(&s_mutex);
+		insertBinary(key, binary);
+	}
+
+	// QSaveFile makes concurrent writers safe, so the disk is touched without the lock.
+	writeBinary(key, binary);
+	pruneCacheDir();
+}
+
+// static
+void ProgramCache::prepare(GLhandleARB program)
+{
+	if (isSupported()) {
+		glProgramParameteri(programName(program), GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+	}
+}
+
+// static
+void ProgramCache::remove(const QByteArray & key)
+{
+	{
+		QMutexLocker locker(&s_mutex);
+		removeBinary(key);
+	}
+	QFile::remove(cacheFileName(key));
+}
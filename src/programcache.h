@@ -0,0 +1,56 @@
+/*
+    QShaderEdit - Simple multiplatform shader editor
+    Copyright (C) 2007 Ignacio Castao <castano@gmail.com>
+
+    This program is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 2 of the License, or
+    (at your option) any later version.
+
+    This program is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program; if not, write to the Free Software
+    Foundation, Inc., 59 Temple Place, Suite 330, Boston, MA  02111-1307  USA
+*/
+
+#ifndef PROGRAMCACHE_H
+#define PROGRAMCACHE_H
+
+#include <GL/glew.h>
+
+#include <QByteArray>
+#include <QList>
+
+
+/// Cache of linked program binaries, kept in memory and on disk. Both are
+/// bounded in size, the least recently used binaries are dropped first.
+/// Requires ARB_get_program_binary, all methods are no-ops otherwise.
+class ProgramCache
+{
+public:
+	static bool isSupported();
+
+	// Compute the cache key of the given sources for the current context.
+	static QByteArray key(const QList<QByteArray> & sources);
+
+	// Create a program from the binary stored under the given key, and get the
+	// info logs stored with it. Returns 0 if there's no binary or if the driver rejected it.
+	static GLhandleARB load(const QByteArray & key, QList<QByteArray> * infoLogs = NULL);
+
+	// Store the binary of the given linked program, with the info logs of its
+	// build so that the warnings can be shown again when it's loaded.
+	static void store(const QByteArray & key, GLhandleARB program, const QList<QByteArray> & infoLogs = QList<QByteArray>());
+
+	// Call before linking so that the binary can be retrieved afterwards.
+	static void prepare(GLhandleARB program);
+
+private:
+	static void remove(const QByteArray & key);
+};
+
+
+#endif // PROGRAMCACHE_H
@@ -28,20 +28,34 @@
 #include <QUrl>
 #include <QMouseEvent>
 #include <QWheelEvent>
+#include <QFileDialog>
+#include <QMessageBox>
 
 
+namespace {
+	
+	// Texture bytes uploaded per frame, to keep the view responsive while loading.
+	static const int s_textureUploadBudget = 4 * 1024 * 1024;
+	
+} // namespace
+
 SceneView::SceneView(QWidget * parent, QGLWidget * shareWidget) : QGLWidget(parent, shareWidget),
 	m_effect(NULL), 
 	m_scene(NULL), 
 	m_wireframe(false), 
-	m_ortho(false)
+	m_ortho(false),
+	m_showStatistics(false)
 {
 	setAutoBufferSwap(false);
+	
+	connect(TextureLoader::instance(), SIGNAL(textureDecoded()), this, SLOT(update()));
 }
 
 
 SceneView::~SceneView()
 {
+	makeCurrent();
+	m_profiler.cleanup();
 }
 
 
@@ -125,6 +139,8 @@ void SceneView::initializeGL()
 
 	m_scene = SceneFactory::defaultScene();
 	
+	m_profiler.init();
+	
 	/*
 	// Set special settings for mesa.
 	const char * vendor = (const char *)glGetString(GL_VENDOR);
@@ -155,10 +171,19 @@ void SceneView::paintGL()
 		return;
 	}
 	
+	// Keep painting until the decoded textures are uploaded.
+	if( TextureLoader::instance()->upload(s_textureUploadBudget) ) {
+		update();
+	}
+	
+	m_profiler.beginFrame();
+	
 	glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT | GL_STENCIL_BUFFER_BIT);
 	
 	if( m_scene != NULL )
 	{
+		m_scene->update();
+		
 		if (m_effect != NULL && !m_effect->isBuilding() && m_effect->isValid())
 		{
 			// Setup ligh parameters @@ Move this to scene->setup() or begin()
@@ -176,11 +201,13 @@ void SceneView::paintGL()
 			
 			for(int i = 0; i < m_effect->getPassNum(); i++)
 			{
+				m_profiler.beginPass(i);
 				m_effect->beginPass(i);
 				
 				m_scene->draw(m_effect);
 				
 				m_effect->endPass();
+				m_profiler.endPass();
 			}
 			
 			m_effect->end();
@@ -192,6 +219,13 @@ void SceneView::paintGL()
 		}
 	}
 	
+	m_profiler.endFrame();
+	
+	if( m_showStatistics )
+	{
+		drawStatistics();
+	}
+	
  	swapBuffers();
 	
 	//qDebug("paint!");
@@ -307,3 +341,57 @@ void SceneView::setOrtho(bool b)
 	updateMatrices();
 	emit updateGL();
 }
+
+bool SceneView::isShowingStatistics() const
+{
+	return m_showStatistics;
+}
+
+void SceneView::setShowStatistics(bool b)
+{
+	m_showStatistics = b;
+	emit updateGL();
+}
+
+void SceneView::exportStatistics()
+{
+	QString fileName = QFileDialog::getSaveFileName(this, tr("Export Statistics"), tr("statistics.csv"), tr("CSV Files (*.csv)"));
+	if( fileName.isEmpty() ) {
+		return;
+	}
+	
+	if( !m_profiler.exportCsv(fileName) ) {
+		QMessageBox::critical(this, tr("Error"), tr("Could not write '%1'").arg(fileName), QMessageBox::Ok, QMessageBox::NoButton, QMessageBox::NoButton);
+	}
+}
+
+void SceneView::drawStatistics()
+{
+	if( !m_profiler.hasSample() ) {
+		return;
+	}
+	
+	const FrameProfiler::Sample & sample = m_profiler.lastSample();
+	
+	QStringList lines;
+	lines << tr("CPU: %1 ms").arg(sample.cpuTime, 0, 'f', 2);
+	for(int p = 0; p < sample.passCount; p++) {
+		if( sample.gpuTime[p] >= 0.0f ) {
+			lines << tr("GPU pass %1: %2 ms").arg(p).arg(sample.gpuTime[p], 0, 'f', 2);
+		}
+	}
+	lines << tr("Draw calls: %1").arg(sample.drawCalls);
+	lines << tr("Uniform uploads: %1").arg(sample.uniformUploads);
+	
+	const GLTexture::CacheStatistics textures = GLTexture::cacheStatistics();
+	lines << tr("Textures: %1, %2 of %3 MB").arg(textures.textureCount).arg(textures.bytes / (1024 * 1024)).arg(textures.budget / (1024 * 1024));
+	lines << tr("Texture cache: %1 hits, %2 misses, %3 evictions").arg(textures.hits).arg(textures.misses).arg(textures.evictions);
+	
+	glPolygonMode(GL_FRONT_AND_BACK, GL_FILL);
+	glColor3f(1.0f, 1.0f, 1.0f);
+	
+	const int lineHeight = fontMetrics().height();
+	for(int i = 0; i < lines.count(); i++) {
+		renderText(8, 8 + lineHeight * (i + 1), lines.at(i));
+	}
+}
@@ -26,6 +26,8 @@
 
 #include <QGLWidget>
 
+#include "frameprofiler.h"
+
 
 class QRectF;
 class QWheelEvent;
@@ -50,11 +52,14 @@ public:
 
 	bool isWireframe() const;
 	bool isOrtho() const;
+	bool isShowingStatistics() const;
 	
 public slots:
 	
 	void setWireframe(bool b);	
 	void setOrtho(bool b);
+	void setShowStatistics(bool b);
+	void exportStatistics();
 	
 
 protected:
@@ -74,6 +79,8 @@ protected:
 
 	void resetTransform();
 	
+	void drawStatistics();
+	
 private:
 	
 	float m_alpha;
@@ -89,6 +96,9 @@ private:
 	
 	bool m_wireframe;
 	bool m_ortho;
+	
+	FrameProfiler m_profiler;
+	bool m_showStatistics;
 };
 
 #endif // QGLVIEW_H
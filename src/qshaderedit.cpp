@@ -31,6 +31,7 @@
 #include "scene.h"
 #include "document.h"
 #include "glutils.h"
+#include "texmanager.h"
 
 #include <QFile>
 #include <QTimer>
@@ -42,7 +43,7 @@
 #include <QToolBar>
 #include <QAction>
 #include <QMenuBar>
-#include <QTextEdit>
+#include <QPlainTextEdit>
 #include <QTabWidget>
 #include <QStatusBar>
 #include <QDockWidget>
@@ -220,7 +221,7 @@ void QShaderEdit::onEffectCreated()
 	// Connect effect signals.
 	connect(effect, SIGNAL(infoMessage(QString)), m_messagePanel, SLOT(info(QString)));
 	connect(effect, SIGNAL(errorMessage(QString)), m_messagePanel, SLOT(error(QString)));
-	connect(effect, SIGNAL(buildMessage(QString,int,OutputParser*)), m_messagePanel, SLOT(log(QString,int,OutputParser*)));
+	connect(effect, SIGNAL(buildMessage(QString,MessagePanel::Type,int,int,int)), m_messagePanel, SLOT(log(QString,MessagePanel::Type,int,int,int)));
 	
 	updateActions();
 	updateTechniques();
@@ -315,7 +316,7 @@ void QShaderEdit::updateEffectInputs()
 	const int inputNum = effect->getInputNum();
 	for (int i = 0; i < inputNum; i++)
 	{
-		const QTextEdit * textEdit = qobject_cast<const QTextEdit *>(m_editor->widget(i));
+		const QPlainTextEdit * textEdit = qobject_cast<const QPlainTextEdit *>(m_editor->widget(i));
 		
 		if (textEdit != NULL)
 		{
@@ -840,6 +841,7 @@ void QShaderEdit::loadSettings()
 	Document::setLastEffect(pref.value("lastEffect", ".").toString());
 	SceneFactory::setLastFile(pref.value("lastScene", ".").toString());
 	ParameterPanel::setLastPath(pref.value("lastParameterPath", ".").toString());
+	GLTexture::setCacheBudget(qint64(pref.value("textureCacheMegabytes", 256).toInt()) * 1024 * 1024);
 
 	if (maximize) {
 		setWindowState(windowState() | Qt::WindowMaximized);
@@ -865,5 +867,6 @@ void QShaderEdit::saveSettings()
 	pref.setValue("lastEffect", Document::lastEffect());
 	pref.setValue("lastScene", SceneFactory::lastFile());
 	pref.setValue("lastParameterPath", ParameterPanel::lastPath());
+	pref.setValue("textureCacheMegabytes", int(GLTexture::cacheBudget() / (1024 * 1024)));
 }
 
@@ -24,6 +24,10 @@
 // Include GLEW before anything else.
 #include <GL/glew.h>
 
+#include "mesh.h"
+#include "objloader.h"
+#include "meshcache.h"
+
 #include <QString>
 #include <QFile>
 #include <QFileDialog>
@@ -31,24 +35,37 @@
 #include <QMenu>
 
 #include <math.h>
+#include <string.h>
 
 
-extern void drawTeapot();
+extern void buildTeapot(QVector<MeshVertex> & vertices, QVector<quint32> & indices);
 
-class DisplayListScene : public Scene
-{
-public:
-	DisplayListScene() : m_dlist(0)
+namespace {
+
+	static void addVertex(QVector<MeshVertex> & vertices, float nx, float ny, float nz, float s, float t, float x, float y, float z)
 	{
+		MeshVertex v;
+		memset(&v, 0, sizeof(v));
+		v.normal[0] = nx; v.normal[1] = ny; v.normal[2] = nz;
+		v.texcoord[0] = s; v.texcoord[1] = t;
+		v.position[0] = x; v.position[1] = y; v.position[2] = z;
+		vertices.append(v);
 	}
 
-	virtual ~DisplayListScene()
+	// Split the quad made of the last four vertices in two triangles.
+	static void addQuad(const QVector<MeshVertex> & vertices, QVector<quint32> & indices)
 	{
-		if( m_dlist != 0 ) {
-			glDeleteLists(m_dlist, 1);
-		}
+		const quint32 first = vertices.count() - 4;
+		indices << first + 0 << first + 1 << first + 2;
+		indices << first + 0 << first + 2 << first + 3;
 	}
-	
+
+} // namespace
+
+
+class MeshScene : public Scene
+{
+public:
 
 	virtual void draw(Effect* effect) const
 	{
@@ -63,7 +80,7 @@ public:
 		glMaterialfv(GL_FRONT, GL_SPECULAR, ks);
 		glMaterialf(GL_FRONT, GL_SHININESS, 8);
 		
-		glCallList(m_dlist);
+		m_mesh.draw();
 	}
 	
 	virtual void transform() const
@@ -77,20 +94,20 @@ public:
 	}
 
 protected:
-	GLuint m_dlist;
+	Mesh m_mesh;
 	
 };
 
 
-class TeapotScene : public DisplayListScene
+class TeapotScene : public MeshScene
 {
 public:
 	TeapotScene()
 	{
-		m_dlist = glGenLists(1);
-		glNewList(m_dlist, GL_COMPILE);
-		drawTeapot();
-		glEndList();
+		QVector<MeshVertex> vertices;
+		QVector<quint32> indices;
+		buildTeapot(vertices, indices);
+		m_mesh.upload(vertices, indices);
 	}
 	
 	virtual void transform() const
@@ -128,39 +145,23 @@ REGISTER_SCENE_FACTORY(TeapotSceneFactory);
 
 
 
-class QuadScene : public DisplayListScene
+class QuadScene : public MeshScene
 {
 public:
 	QuadScene()
 	{
-		const bool hasMultiTexture = GLEW_ARB_multitexture || GLEW_VERSION_1_3;
+		QVector<MeshVertex> vertices;
+		QVector<quint32> indices;
 		
-		m_dlist = glGenLists(1);
-		glNewList(m_dlist, GL_COMPILE);
-		glBegin(GL_QUADS);
-			glNormal3f(0, 0, 1);
-	
-			if( hasMultiTexture ) {
-				glMultiTexCoord3f(GL_TEXTURE6, 1, 0, 0);
-				glMultiTexCoord3f(GL_TEXTURE7, 0, -1, 0);
-			}
+		addVertex(vertices, 0, 0, 1, 0, 1, -1, -1, 0);
+		addVertex(vertices, 0, 0, 1, 1, 1,  1, -1, 0);
+		addVertex(vertices, 0, 0, 1, 1, 0,  1,  1, 0);
+		addVertex(vertices, 0, 0, 1, 0, 0, -1,  1, 0);
+		addQuad(vertices, indices);
 		
-			glTexCoord2f(0, 1);
-			glVertex2f(-1, -1);
-
-			glNormal3f(0, 0, 1);
-			glTexCoord2f(1, 1);
-			glVertex2f(1, -1);
-
-			glNormal3f(0, 0, 1);
-			glTexCoord2f(1, 0);
-			glVertex2f(1, 1);
-
-			glNormal3f(0, 0, 1);
-			glTexCoord2f(0, 0);
-			glVertex2f(-1, 1);
-		glEnd();
-		glEndList();
+		// Tangent is (1, 0, 0) and bitangent (0, -1, 0).
+		Mesh::computeTangents(vertices, indices);
+		m_mesh.upload(vertices, indices);
 	}
 };
 
@@ -458,57 +459,57 @@ REGISTER_SCENE_FACTORY(TriangleSceneFactory);
 #endif
 
 
-class CubeScene : public DisplayListScene
+class CubeScene : public MeshScene
 {
 public:
 	CubeScene()
 	{
-		m_dlist = glGenLists(1);
-		glNewList(m_dlist, GL_COMPILE);
-		glBegin(GL_QUADS);
+		QVector<MeshVertex> vertices;
+		QVector<quint32> indices;
 		
 		// Front Face
-		glNormal3f(0, 0, 1);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f,  1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f( 1.0f, -1.0f,  1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f( 1.0f,  1.0f,  1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f,  1.0f,  1.0f);
+		addVertex(vertices, 0, 0, 1, 0.0f, 0.0f, -1.0f, -1.0f, 1.0f);
+		addVertex(vertices, 0, 0, 1, 1.0f, 0.0f, 1.0f, -1.0f, 1.0f);
+		addVertex(vertices, 0, 0, 1, 1.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+		addVertex(vertices, 0, 0, 1, 0.0f, 1.0f, -1.0f, 1.0f, 1.0f);
+		addQuad(vertices, indices);
 		// Back Face
-		glNormal3f(0, 0, -1);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f(-1.0f, -1.0f, -1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f(-1.0f,  1.0f, -1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f( 1.0f,  1.0f, -1.0f);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f( 1.0f, -1.0f, -1.0f);
+		addVertex(vertices, 0, 0, -1, 1.0f, 0.0f, -1.0f, -1.0f, -1.0f);
+		addVertex(vertices, 0, 0, -1, 1.0f, 1.0f, -1.0f, 1.0f, -1.0f);
+		addVertex(vertices, 0, 0, -1, 0.0f, 1.0f, 1.0f, 1.0f, -1.0f);
+		addVertex(vertices, 0, 0, -1, 0.0f, 0.0f, 1.0f, -1.0f, -1.0f);
+		addQuad(vertices, indices);
 		// Top Face
-		glNormal3f(0, 1, 0);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f,  1.0f, -1.0f);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f,  1.0f,  1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f( 1.0f,  1.0f,  1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f( 1.0f,  1.0f, -1.0f);
+		addVertex(vertices, 0, 1, 0, 0.0f, 1.0f, -1.0f, 1.0f, -1.0f);
+		addVertex(vertices, 0, 1, 0, 0.0f, 0.0f, -1.0f, 1.0f, 1.0f);
+		addVertex(vertices, 0, 1, 0, 1.0f, 0.0f, 1.0f, 1.0f, 1.0f);
+		addVertex(vertices, 0, 1, 0, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f);
+		addQuad(vertices, indices);
 		// Bottom Face
-		glNormal3f(0, -1, 0);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f(-1.0f, -1.0f, -1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f( 1.0f, -1.0f, -1.0f);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f( 1.0f, -1.0f,  1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f(-1.0f, -1.0f,  1.0f);
+		addVertex(vertices, 0, -1, 0, 1.0f, 1.0f, -1.0f, -1.0f, -1.0f);
+		addVertex(vertices, 0, -1, 0, 0.0f, 1.0f, 1.0f, -1.0f, -1.0f);
+		addVertex(vertices, 0, -1, 0, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f);
+		addVertex(vertices, 0, -1, 0, 1.0f, 0.0f, -1.0f, -1.0f, 1.0f);
+		addQuad(vertices, indices);
 		// Right face
-		glNormal3f(1, 0, 0);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f( 1.0f, -1.0f, -1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f( 1.0f,  1.0f, -1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f( 1.0f,  1.0f,  1.0f);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f( 1.0f, -1.0f,  1.0f);
+		addVertex(vertices, 1, 0, 0, 1.0f, 0.0f, 1.0f, -1.0f, -1.0f);
+		addVertex(vertices, 1, 0, 0, 1.0f, 1.0f, 1.0f, 1.0f, -1.0f);
+		addVertex(vertices, 1, 0, 0, 0.0f, 1.0f, 1.0f, 1.0f, 1.0f);
+		addVertex(vertices, 1, 0, 0, 0.0f, 0.0f, 1.0f, -1.0f, 1.0f);
+		addQuad(vertices, indices);
 		// Left Face
-		glNormal3f(-1, 0, 0);
-		glTexCoord2f(0.0f, 0.0f); glVertex3f(-1.0f, -1.0f, -1.0f);
-		glTexCoord2f(1.0f, 0.0f); glVertex3f(-1.0f, -1.0f,  1.0f);
-		glTexCoord2f(1.0f, 1.0f); glVertex3f(-1.0f,  1.0f,  1.0f);
-		glTexCoord2f(0.0f, 1.0f); glVertex3f(-1.0f,  1.0f, -1.0f);
+		addVertex(vertices, -1, 0, 0, 0.0f, 0.0f, -1.0f, -1.0f, -1.0f);
+		addVertex(vertices, -1, 0, 0, 1.0f, 0.0f, -1.0f, -1.0f, 1.0f);
+		addVertex(vertices, -1, 0, 0, 1.0f, 1.0f, -1.0f, 1.0f, 1.0f);
+		addVertex(vertices, -1, 0, 0, 0.0f, 1.0f, -1.0f, 1.0f, -1.0f);
+		addQuad(vertices, indices);
 		
-		glEnd();
-		glEndList();
+		Mesh::computeTangents(vertices, indices);
+		m_mesh.upload(vertices, indices);
 	}
 };
 
+
 // Cube scene factory.
 class CubeSceneFactory : public SceneFactory
 {
@@ -538,8 +539,10 @@ REGISTER_SCENE_FACTORY(CubeSceneFactory);
 class ObjScene : public Scene
 {
 public:
-	ObjScene(): m_dlistBase(0), m_dlistCount(0)
+	ObjScene() : m_scale(1.0f)
 	{
+		m_center[0] = m_center[1] = m_center[2] = 0.0f;
+		
 		QString fileName = QFileDialog::getOpenFileName(NULL, QObject::tr("Open File"),
 			SceneFactory::lastFile(), QString(QObject::tr("OBJ Files (%1)")).arg("*.obj"));
 
@@ -549,24 +552,18 @@ public:
 		}		
 	}
 	
-	~ObjScene()
-	{
-		if (m_dlistBase)
-			glDeleteLists(m_dlistBase, m_dlistCount);
-	}
-	
 	virtual void transform() const
 	{
 		glScalef(m_scale, m_scale, m_scale);
-		glTranslatef(-m_center.x, -m_center.y, -m_center.z);
+		glTranslatef(-m_center[0], -m_center[1], -m_center[2]);
 	}
 	
 	virtual void draw(Effect* effect) const
 	{
-		GLuint lastList = m_dlistBase + m_dlistCount;  
-		for (GLuint n = m_dlistBase; n < lastList; n++) {
+		foreach (const MeshGroup & group, m_groups) {
 			if(effect) effect->beginMaterialGroup();
-			glCallList(n);
+			m_materials[group.material].bind();
+			m_mesh.draw(group.first, group.count);
 		}
 	}
 	
@@ -576,337 +573,32 @@ public:
 	}
 	
 private:
-	struct vec4 {
-		vec4() { }
-		vec4(float _x, float _y, float _z, float _w = 1.0f): x(_x), y(_y), z(_z), w(_w) { }
-		
-		float x, y, z, w;
-	};
-	
-	struct vec3 {
-		vec3() { }
-		vec3(float _x, float _y, float _z): x(_x), y(_y), z(_z) { }
-		
-		float x, y, z;
-	};
-	
-	struct vec2 {
-		vec2() { }
-		vec2(float _s, float _t): s(_s), t(_t) { }
-		
-		float s, t;
-	};
-	
-	struct Material 
-	{
-		QString name;
-		vec4 ka, kd, ks;
-		float ns;
-		
-		Material(): ka(0.1f, 0.1f, 0.1f, 1.0f), kd(1.0f, 1.0f, 1.0f, 1.0f), ks(0.0f, 0.0f, 0.0f, 0.0f), ns(20.0f)		 
-		{ }
-		
-		void bind() 
-		{
-			glMaterialfv(GL_FRONT, GL_AMBIENT, (GLfloat*)&ka);
-			glMaterialfv(GL_FRONT, GL_DIFFUSE, (GLfloat*)&kd);
-			glMaterialfv(GL_FRONT, GL_SPECULAR, (GLfloat*)&ks);
-			glMaterialf(GL_FRONT, GL_SHININESS, (GLfloat)ns);
-		}
-	};
-	
-	class MaterialLib
-	{
-		public:
-			~MaterialLib()
-			{
-				qDeleteAll(m_materials);
-			}
-			
-			QString name() const 
-			{
-				return m_name;
-			}
-			
-			bool load(const QString& name, const QString& fileName)
-			{
-				QFile file(fileName);
-				
-				if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-					return false;
-				
-				m_name = name;
-				
-				QRegExp newmtlPattern("^newmtl\\s(.*)(\\#.*)?");
-				QRegExp kaPattern("^Ka\\s(.*)\\s(.*)\\s(.*)");
-				QRegExp kdPattern("^Kd\\s(.*)\\s(.*)\\s(.*)");
-				QRegExp ksPattern("^Ks\\s(.*)\\s(.*)\\s(.*)");
-				QRegExp nsPattern("^Ns\\s(.*)");
-				
-				if (!m_materials.isEmpty()) {
-					qDeleteAll(m_materials);
-					m_materials.clear();
-				}
-				
-				Material* current = NULL;
-				while (!file.atEnd()) {
-					QString line = file.readLine().simplified();
-					
-					if (line.contains(newmtlPattern)) {
-						current = new Material;
-						m_materials.append(current);
-						current->name = newmtlPattern.cap(1);
-					}
-					else if (line.contains(kaPattern)) {
-						Q_ASSERT(current);
-						current->ka = vec4(kaPattern.cap(1).toFloat(), kaPattern.cap(2).toFloat(), kaPattern.cap(3).toFloat());
-					}
-					else if (line.contains(kdPattern)) {
-						Q_ASSERT(current);
-						current->kd = vec4(kdPattern.cap(1).toFloat(), kdPattern.cap(2).toFloat(), kdPattern.cap(3).toFloat());
-					}
-					else if (line.contains(ksPattern)) {
-						Q_ASSERT(current);
-						current->ks = vec4(ksPattern.cap(1).toFloat(), ksPattern.cap(2).toFloat(), ksPattern.cap(3).toFloat());
-					}
-					else if (line.contains(nsPattern)) {
-						Q_ASSERT(current);
-						current->ns = nsPattern.cap(1).toFloat();
-					}	
-				}
-				
-				return true;
-			}
-			
-			Material* material(const QString& name)
-			{
-				foreach (Material* mat, m_materials) {
-					if (mat->name == name)
-						return mat;
-				}
-				return NULL;
-			}
-			
-		private:
-			QString m_name;
-			QVector<Material*> m_materials;		
-	};
-	
-	struct Vertex
-	{
-		int pos;
-		int normal;
-		int texcoord;
-	};
-	
-	struct Surface 
-	{
-		Material* material;
-		QVector< QVector<Vertex> > faces;
-	};
-	
-	static float min(float a, float b) 
-	{
-		return a < b ? a : b;
-	}
-	
-	static float max(float a, float b) 
-	{
-		return a > b ? a : b;
-	}
-	
 	void load(const QString & fileName)
 	{
-		QFile file(fileName);
-		if (!file.open(QIODevice::ReadOnly | QIODevice::Text))
-			return;
-		
-		if (m_dlistBase)
-			glDeleteLists(m_dlistBase, m_dlistCount);
-		
-		QRegExp vertexPattern("^v\\s+(.*)\\s+(.*)\\s+(.*)");
-		QRegExp normalPattern("^vn\\s+(.*)\\s+(.*)\\s+(.*)");
-		QRegExp texcoordPattern("^vt\\s+(.*)\\s+(.*)(\\s+.*)?");
-		QRegExp mtllibPattern("^mtllib\\s+(.*\\.mtl)");
-		QRegExp usemtlPattern("^usemtl\\s+(.*)(\\#.*)?");
-		
-		QVector<vec3> vertices, normals;
-		QVector<vec2> texcoords;
-		QVector<MaterialLib*> materialLibs;
-		QVector<Surface*> surfaces;
-		
-		vec3 vmin(1e10, 1e10, 1e10), vmax(-1e10, -1e10, -1e10);
-		
-		Material * defaultMaterial = new Material; 
-		MaterialLib * currentMaterialLib = NULL;
-		Surface * currentSurface = new Surface;
-		currentSurface->material = defaultMaterial;
-		surfaces.append(currentSurface);
-		
-		while (!file.atEnd()) {
-			QString line = file.readLine().simplified();
-			
-			if (line.isEmpty() || line.startsWith('#'))
-				continue;
-			
-			if (line.contains(vertexPattern)) {
-				vec3 v(vertexPattern.cap(1).toFloat(), vertexPattern.cap(2).toFloat(), vertexPattern.cap(3).toFloat());
-				vertices.append(v);
-				vmin.x = min(v.x, vmin.x);
-				vmin.y = min(v.y, vmin.y);
-				vmin.z = min(v.z, vmin.z);
-				
-				vmax.x = max(v.x, vmax.x);
-				vmax.y = max(v.y, vmax.y);
-				vmax.z = max(v.z, vmax.z);				
-			}
-			
-			else if (line.contains(normalPattern))
-				normals.append(vec3(normalPattern.cap(1).toFloat(), normalPattern.cap(2).toFloat(), normalPattern.cap(3).toFloat()));
-			
-			else if (line.contains(texcoordPattern))
-				texcoords.append(vec2(texcoordPattern.cap(1).toFloat(), texcoordPattern.cap(2).toFloat()));
-			
-			else if (line.startsWith("f ")) {
-				QStringList faces = line.split(' ');
-				
-				QVector<Vertex> face;
-				
-				for (int i = 1; i < faces.size(); i++) {
-					QStringList indices = faces[i].split('/');
-					
-					Vertex v;
-					
-					v.pos = indices[0].toInt() -1;
-					if (v.pos < 0) v.pos += vertices.size() +1;
-					Q_ASSERT(v.pos >= 0 && v.pos < vertices.size());
-					
-					if (indices.size() > 1 && !indices[1].isEmpty()) {
-						v.texcoord = indices[1].toInt() -1;
-						if (v.texcoord < 0) v.texcoord += texcoords.size() +1;
-						Q_ASSERT(v.texcoord >= 0 && v.texcoord < texcoords.size());
-					}
-					else
-						v.texcoord = -1;
-					
-					if (indices.size() > 2) {
-						v.normal = indices[2].toInt() -1;
-						if (v.normal < 0) v.normal += normals.size() +1;
-						Q_ASSERT(v.normal >= 0 && v.normal < normals.size()); 
-					}
-					else
-						v.normal = -1;
-					
-					face.append(v);
-				}
-				
-				currentSurface->faces.append(face);
-			}
-			
-			else if (line.contains(usemtlPattern)) {
-				QString name = usemtlPattern.cap(1);
-				
-				Material* material = NULL;
-				if (currentMaterialLib)
-					material = currentMaterialLib->material(name);
-				
-				if (!material) {
-					currentSurface = surfaces[0]; // default material
-				}
-				else {
-					currentSurface = NULL;
-					foreach (Surface* surf, surfaces) {
-						Q_ASSERT(surf != NULL);
-						Q_ASSERT(surf->material != NULL);
-					
-						if (surf->material->name == name) {
-							currentSurface = surf;
-							break;
-						}
-					}
-					
-					if (!currentSurface) {
-						currentSurface = new Surface;
-						currentSurface->material = material;
-						surfaces.append(currentSurface);
-					}
-				}
-			}
+		MeshData data;
+		if (!MeshCache::load(fileName, &m_mesh, &data)) {
+			if (!ObjLoader::load(fileName, &data))
+				return;
 			
-			else if (line.contains(mtllibPattern)) {				
-				QString name = mtllibPattern.cap(1);
-				currentMaterialLib = NULL;
-				foreach (MaterialLib* mtlLib, materialLibs) {
-					if (mtlLib->name() == name) {
-						currentMaterialLib = mtlLib;
-						break; 
-					}
-				}
-				
-				if (!currentMaterialLib) {
-					QFileInfo info(fileName);
-					QString mtlLibFileName = info.dir().filePath(name); 
-					
-					MaterialLib* mtlLib = new MaterialLib;
-					if (!mtlLib->load(name, mtlLibFileName)) {
-						qWarning("Could not open material file: %s", qPrintable(mtlLibFileName));
-						delete mtlLib;
-						continue;
-					}
-					materialLibs.append(mtlLib);
-					currentMaterialLib = mtlLib;
-				}
-			}
+			MeshCache::store(fileName, data);
+			m_mesh.upload(data.vertices, data.indices);
 		}
 		
+		m_materials = data.materials;
+		m_groups = data.groups;
 		
-		m_center.x = (vmax.x + vmin.x) * 0.5;
-		m_center.y = (vmax.y + vmin.y) * 0.5;
-		m_center.z = (vmax.z + vmin.z) * 0.5;
-		
-		m_scale = 1.0f / max(vmax.x - m_center.x, max(vmax.y - m_center.y, vmax.z - m_center.z));
-		
-		
-		// create display lists
-		if (surfaces[0]->faces.isEmpty())
-			surfaces.remove(0);
-		m_dlistCount = surfaces.size();
-		m_dlistBase = glGenLists(m_dlistCount);
-		
-		for (GLuint n = 0; n < m_dlistCount; n++) {
-			glNewList(m_dlistBase + n, GL_COMPILE);			
-			Surface* surf = surfaces[n];			
-			surf->material->bind();
-			
-			for (int face = 0; face < surf->faces.count(); face++) {
-				QVector<Vertex> verts = surf->faces[face];
-				
-				glBegin(GL_POLYGON);
-				for (int vert = 0; vert < verts.count(); vert++) {
-					
-					if (verts[vert].texcoord >= 0)
-						glTexCoord2fv((GLfloat*)&texcoords[verts[vert].texcoord]);
-					
-					if (verts[vert].normal >= 0)
-						glNormal3fv((GLfloat*)&normals[verts[vert].normal]);
-					
-					glVertex3fv((GLfloat*)&vertices[verts[vert].pos]);
-				}
-				glEnd();
-			}
-			
-			glEndList();
-		}		
-		
-		delete defaultMaterial;
-		qDeleteAll(materialLibs);
-		qDeleteAll(surfaces);
+		m_center[0] = data.center[0];
+		m_center[1] = data.center[1];
+		m_center[2] = data.center[2];
+		m_scale = data.scale;
 	}
 	
-	vec3 m_center;
+	float m_center[3];
 	float m_scale;
 	
-	GLuint m_dlistBase, m_dlistCount;
+	QVector<MeshMaterial> m_materials;
+	QVector<MeshGroup> m_groups;
+	Mesh m_mesh;
 };
 
 // Obj scene factory.
@@ -929,6 +621,10 @@ public:
 	{
 		return new ObjScene();
 	}
+	virtual bool isInteractive() const
+	{
+		return true;
+	}
 };
 
 REGISTER_SCENE_FACTORY(ObjSceneFactory);
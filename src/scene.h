@@ -48,6 +48,12 @@ public:
 	
 	virtual void transform() const = 0;
 	virtual void setupMenu(QMenu * menu) const = 0;
+	
+	// Animated scenes are redrawn continuously.
+	virtual bool isAnimated() const { return false; }
+	
+	// Advance the animation, once per frame before the passes are drawn.
+	virtual void update() {}
 };
 
 
@@ -59,6 +65,9 @@ public:
 	virtual QIcon icon() const = 0;
 	virtual Scene * createScene() const = 0;
 	
+	// Interactive scenes ask the user for input when they are created.
+	virtual bool isInteractive() const { return false; }
+	
 	static const SceneFactory * findFactory(const QString & name);
 	static const QList<const SceneFactory *> & factoryList();
 	static void addFactory(const SceneFactory * factory);
@@ -28,7 +28,7 @@
 
 
 ScenePanel::ScenePanel(const QString & title, QWidget * parent /*= 0*/, QGLWidget * shareWidget /*= 0*/, Qt::WindowFlags flags /*= 0*/) :
-	QDockWidget(title, parent, flags), m_view(NULL)
+	QDockWidget(title, parent, flags), m_view(NULL), m_effectAnimated(false), m_sceneAnimated(false)
 {
 	m_view = new SceneView(this, shareWidget);
 	setWidget(m_view);
@@ -65,8 +65,19 @@ ScenePanel::ScenePanel(const QString & title, QWidget * parent /*= 0*/, QGLWidge
 	m_orthoAction->setChecked(false);
 	connect(m_orthoAction, SIGNAL(toggled(bool)), m_view, SLOT(setOrtho(bool)));
 	
+	m_statisticsAction = new QAction(tr("Show Statistics"), this);
+	m_statisticsAction->setCheckable(true);
+	m_statisticsAction->setChecked(false);
+	connect(m_statisticsAction, SIGNAL(toggled(bool)), m_view, SLOT(setShowStatistics(bool)));
+	
+	m_exportStatisticsAction = new QAction(tr("Export Statistics..."), this);
+	connect(m_exportStatisticsAction, SIGNAL(triggered()), m_view, SLOT(exportStatistics()));
+	
 	m_renderMenu->addAction(m_wireframeAction);
 	m_renderMenu->addAction(m_orthoAction);
+	m_renderMenu->addSeparator();
+	m_renderMenu->addAction(m_statisticsAction);
+	m_renderMenu->addAction(m_exportStatisticsAction);
 }
 
 ScenePanel::~ScenePanel()
@@ -91,12 +102,27 @@ void ScenePanel::setViewUpdatesEnabled(bool enable)
 
 void ScenePanel::startAnimation()
 {
-	m_animationTimer->start(30);
+	m_effectAnimated = true;
+	updateAnimationTimer();
 }
 
 void ScenePanel::stopAnimation()
 {
-	m_animationTimer->stop();
+	m_effectAnimated = false;
+	updateAnimationTimer();
+}
+
+// Keep redrawing while either the effect or the scene is animated.
+void ScenePanel::updateAnimationTimer()
+{
+	if (m_effectAnimated || m_sceneAnimated) {
+		if (!m_animationTimer->isActive()) {
+			m_animationTimer->start(30);
+		}
+	}
+	else {
+		m_animationTimer->stop();
+	}
 }
 
 void ScenePanel::refresh()
@@ -111,7 +137,10 @@ void ScenePanel::selectScene()
 	{
 		const SceneFactory * factory = SceneFactory::findFactory(action->data().toString());
 		Q_ASSERT(factory != NULL);
-		m_view->setScene(factory->createScene());
+		Scene * scene = factory->createScene();
+		m_sceneAnimated = scene->isAnimated();
+		m_view->setScene(scene);
+		updateAnimationTimer();
 	}
 }
 
@@ -54,13 +54,19 @@ public slots:
 	
 private:
 
+	void updateAnimationTimer();
+
 	SceneView * m_view;
 	QTimer * m_animationTimer;
+	bool m_effectAnimated;
+	bool m_sceneAnimated;
 	
 	QMenu * m_sceneMenu;
 	QMenu * m_renderMenu;
 	QAction * m_wireframeAction;
 	QAction * m_orthoAction;
+	QAction * m_statisticsAction;
+	QAction * m_exportStatisticsAction;
 	
 };
 
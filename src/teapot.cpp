@@ -71,7 +71,10 @@
  * OpenGL(TM) is a trademark of Silicon Graphics, Inc.
  */
 
-#include <GL/glew.h>
+#include "mesh.h"
+
+#include <math.h>
+#include <string.h>
 
 
 /* -- PRIVATE FUNCTIONS ---------------------------------------------------- */
@@ -172,28 +175,118 @@ static double cpdata[][3] =
 	{ 0.84,   -1.5,    0.075  }
 };
 
-static double tex[2][2][2] =
+/* Evaluate the cubic Bernstein polynomials and their derivatives at t */
+static void bernstein( double t, double b[4], double d[4] )
 {
-	{ {0.0, 0.0}, {1.0, 0.0} },
-	{ {0.0, 1.0}, {1.0, 1.0} }
-};
+	double s = 1.0 - t;
+
+	b[0] = s * s * s;
+	b[1] = 3.0 * t * s * s;
+	b[2] = 3.0 * t * t * s;
+	b[3] = t * t * t;
+
+	d[0] = -3.0 * s * s;
+	d[1] = 3.0 * s * s - 6.0 * t * s;
+	d[2] = 6.0 * t * s - 3.0 * t * t;
+	d[3] = 3.0 * t * t;
+}
 
-static void teapot( GLint grid, GLdouble scale, GLenum type )
+/*
+ * Evaluate the patch at (u, v) with the same conventions as glMap2d with
+ * u stride 3 and v stride 12, and the normal the way GL_AUTO_NORMAL does.
+ */
+static void evalPatch( double p[4][4][3], double u, double v, MeshVertex * vertex )
 {
-	double p[4][4][3], q[4][4][3], r[4][4][3], s[4][4][3];
-	long i, j, k, l;
+	double bu[4], du[4], bv[4], dv[4];
+	double pos[3] = { 0, 0, 0 }, dpdu[3] = { 0, 0, 0 }, dpdv[3] = { 0, 0, 0 };
+	int j, k, l;
+
+	bernstein( u, bu, du );
+	bernstein( v, bv, dv );
 
-	glPushAttrib( GL_ENABLE_BIT | GL_EVAL_BIT );
-	glEnable( GL_AUTO_NORMAL );
-	glEnable( GL_NORMALIZE );
-	glEnable( GL_MAP2_VERTEX_3 );
-	glEnable( GL_MAP2_TEXTURE_COORD_2 );
+	for( j = 0; j < 4; j++ )
+		for( k = 0; k < 4; k++ )
+			for( l = 0; l < 3; l++ )
+	{
+		pos[l] += bv[j] * bu[k] * p[j][k][l];
+		dpdu[l] += bv[j] * du[k] * p[j][k][l];
+		dpdv[l] += dv[j] * bu[k] * p[j][k][l];
+	}
+
+	double n[3] = {
+		dpdu[1] * dpdv[2] - dpdu[2] * dpdv[1],
+		dpdu[2] * dpdv[0] - dpdu[0] * dpdv[2],
+		dpdu[0] * dpdv[1] - dpdu[1] * dpdv[0]
+	};
+	double nl = sqrt( n[0] * n[0] + n[1] * n[1] + n[2] * n[2] );
+	double ul = sqrt( dpdu[0] * dpdu[0] + dpdu[1] * dpdu[1] + dpdu[2] * dpdu[2] );
+	double vl = sqrt( dpdv[0] * dpdv[0] + dpdv[1] * dpdv[1] + dpdv[2] * dpdv[2] );
+
+	for( l = 0; l < 3; l++ )
+	{
+		vertex->position[l] = (float) pos[l];
+		vertex->normal[l] = nl > 0.0 ? (float) ( n[l] / nl ) : 0.0f;
+		vertex->tangent[l] = ul > 0.0 ? (float) ( dpdu[l] / ul ) : 0.0f;
+		vertex->bitangent[l] = vl > 0.0 ? (float) ( dpdv[l] / vl ) : 0.0f;
+	}
 
-//	glPushMatrix();
-	/* Need this to put top of the teapot towards +Z */
-//	glRotated(270.0, 1.0, 0.0, 0.0);
-//	glScaled(0.5 * scale, 0.5 * scale, 0.5 * scale);
-//	glTranslated(0.0, 0.0, -1.5);
+	vertex->texcoord[0] = (float) u;
+	vertex->texcoord[1] = (float) v;
+}
+
+/*
+ * Tessellate the patch the way glMapGrid2d( grid, 1.0, 0.0, grid, 0.0, 1.0 )
+ * followed by glEvalMesh2( GL_FILL, 0, grid, 0, grid ) does.
+ */
+static void tessellatePatch( double p[4][4][3], int grid, QVector<MeshVertex> & vertices, QVector<quint32> & indices )
+{
+	const quint32 base = vertices.count();
+	int i, j;
+
+	for( j = 0; j <= grid; j++ )
+		for( i = 0; i <= grid; i++ )
+	{
+		MeshVertex vertex;
+		double u = 1.0 - double( i ) / grid;
+		double v = double( j ) / grid;
+
+		evalPatch( p, u, v, &vertex );
+
+		/* The patches collapse to a point at the poles, take the normal next to it */
+		if( vertex.normal[0] == 0.0f && vertex.normal[1] == 0.0f && vertex.normal[2] == 0.0f )
+		{
+			MeshVertex inner;
+			evalPatch( p, qBound( 1e-3, u, 1.0 - 1e-3 ), qBound( 1e-3, v, 1.0 - 1e-3 ), &inner );
+			memcpy( vertex.normal, inner.normal, sizeof( vertex.normal ) );
+			memcpy( vertex.tangent, inner.tangent, sizeof( vertex.tangent ) );
+			memcpy( vertex.bitangent, inner.bitangent, sizeof( vertex.bitangent ) );
+		}
+
+		vertices.append( vertex );
+	}
+
+	for( j = 0; j < grid; j++ )
+		for( i = 0; i < grid; i++ )
+	{
+		quint32 a0 = base + j * ( grid + 1 ) + i;
+		quint32 a1 = a0 + 1;
+		quint32 b0 = a0 + grid + 1;
+		quint32 b1 = b0 + 1;
+
+		/* Same winding as the quad strips of glEvalMesh2 */
+		indices.append( a0 );
+		indices.append( b0 );
+		indices.append( b1 );
+		indices.append( a0 );
+		indices.append( b1 );
+		indices.append( a1 );
+	}
+}
+
+static void teapot( int grid, QVector<MeshVertex> & vertices, QVector<quint32> & indices )
+{
+	double p[4][4][3], q[4][4][3], r[4][4][3], s[4][4][3];
+	long i, j, k, l;
 
 	for( i = 0; i < 10; i++ )
 	{
@@ -219,34 +312,20 @@ static void teapot( GLint grid, GLdouble scale, GLenum type )
 			}
 		}
 
-		glMap2d(GL_MAP2_TEXTURE_COORD_2, 0.0, 1.0, 2, 2, 0.0, 1.0, 4, 2,
-				&tex[0][0][0]);
-		glMap2d(GL_MAP2_VERTEX_3, 0.0, 1.0, 3, 4, 0.0, 1.0, 12, 4,
-				&p[0][0][0]);
-		glMapGrid2d(grid, 1.0, 0.0, grid, 0.0, 1.0);
-		glEvalMesh2(type, 0, grid, 0, grid);
-		glMap2d(GL_MAP2_VERTEX_3, 0.0, 1.0, 3, 4, 0.0, 1.0, 12, 4,
-				&q[0][0][0]);
-		glEvalMesh2(type, 0, grid, 0, grid);
+		tessellatePatch( p, grid, vertices, indices );
+		tessellatePatch( q, grid, vertices, indices );
 		if( i < 6 )
 		{
-			glMap2d(GL_MAP2_VERTEX_3, 0.0, 1.0, 3, 4, 0.0, 1.0, 12, 4,
-					&r[0][0][0]);
-			glEvalMesh2(type, 0, grid, 0, grid);
-			glMap2d(GL_MAP2_VERTEX_3, 0.0, 1.0, 3, 4, 0.0, 1.0, 12, 4,
-					&s[0][0][0]);
-			glEvalMesh2(type, 0, grid, 0, grid);
+			tessellatePatch( r, grid, vertices, indices );
+			tessellatePatch( s, grid, vertices, indices );
 		}
 	}
-
-//	glPopMatrix();
-	glPopAttrib();
 }
 
 
 /* -- INTERFACE FUNCTIONS -------------------------------------------------- */
 
-void drawTeapot()
+void buildTeapot( QVector<MeshVertex> & vertices, QVector<quint32> & indices )
 {
-	teapot( 14, 1.0f, GL_FILL );
+	teapot( 14, vertices, indices );
 }
@@ -25,12 +25,21 @@
 #include <QSharedData>
 #include <QDebug>
 #include <QImage>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QCoreApplication>
+#include <QRunnable>
+#include <QThread>
+#include <QFile>
+
+#include <string.h>
+#include <limits.h>
 
 
 class GLTexture::Private : public QSharedData
 {
 public:
-	Private()
+	Private() : m_loaded(true), m_bytes(0), m_lastUse(0)
 	{
 		glGenTextures(1, &m_object);
 		
@@ -38,45 +47,158 @@ public:
 		m_image = ImagePluginManager::load(":images/default.png", m_object, &m_target);
 		m_icon = m_image.scaled(16, 16, Qt::KeepAspectRatio, Qt::FastTransformation);
 	}
-	Private(const QString & name) : m_name(name)
+	Private(const QString & name) : m_name(name), m_object(0), m_target(GL_TEXTURE_2D), m_loaded(false), m_bytes(0), m_lastUse(0)
 	{
-		glGenTextures(1, &m_object);
+		// Show the default texture until the loader is done.
+		const Private * placeholder = defaultTexture().m_data.constData();
+		m_image = placeholder->image();
+		m_icon = placeholder->icon();
 		
-		m_image = ImagePluginManager::load(m_name, m_object, &m_target);
-		m_icon = m_image.scaled(16, 16, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+		TextureLoader::instance()->load(this);
 	}
 	~Private()
 	{
+		qDebug() << "eliminate:" << m_name;
+		
+		if (!m_name.isEmpty()) {
+			TextureLoader::unwatch(m_name);
+		}
+		
 		if(m_object != 0) {
-			qDebug() << "eliminate:" << m_name;
-			
-			// Remove from the cache.
-			s_textureMap.remove(m_name);
-			
 			glDeleteTextures(1, &m_object);
 			m_object = 0;
 		}
 	}
 
 	const QString & name() const { return m_name; }
-	GLuint object() const { return m_object; }
+	GLuint object() const { return m_loaded ? m_object : defaultTexture().object(); }
 	GLuint target() const { return m_target; }
 	QImage icon() const { return m_icon; }
 	QImage image() const { return m_image; }
+	bool isLoaded() const { return m_loaded; }
+	
+	// Called by the loader once the object is complete.
+	void setLoaded(GLuint object, const QImage & image, const QImage & icon, qint64 videoBytes)
+	{
+		// Reloads that couldn't update the object in place replace it.
+		if (m_object != 0 && m_object != object) {
+			glDeleteTextures(1, &m_object);
+		}
+		m_object = object;
+		m_loaded = true;
+		
+		// Compressed textures are not decoded, so they keep the default preview.
+		if (!image.isNull()) {
+			m_image = image;
+			m_icon = icon;
+		}
+		
+		QMutexLocker locker(&s_textureMapMutex);
+		m_bytes = videoBytes + m_image.byteCount() + m_icon.byteCount();
+	}
+	
+	// Drop a reference taken by hand, outside of a GLTexture.
+	static void release(Private * p)
+	{
+		if (!p->ref.deref()) {
+			delete p;
+		}
+	}
+	
+	// Decode the texture again, if it's cached. Textures that failed to load get another try.
+	static void reload(const QString & name)
+	{
+		QMutexLocker locker(&s_textureMapMutex);
+		
+		Private * p = s_textureMap.value(name);
+		if (p != NULL) {
+			TextureLoader::instance()->load(p, true);
+		}
+	}
+	
+	// Evict the least recently used textures that only the cache references,
+	// until the cache fits in its budget. Needs a current context.
+	static void trim()
+	{
+		QList<Private *> evicted;
+		
+		{
+			QMutexLocker locker(&s_textureMapMutex);
+			
+			qint64 bytes = 0;
+			foreach (const Private * p, s_textureMap) {
+				bytes += p->m_bytes;
+			}
+			
+			while (bytes > s_cacheBudget) {
+				Private * victim = NULL;
+				foreach (Private * p, s_textureMap) {
+					if (p->ref.load() == 1 && (victim == NULL || p->m_lastUse < victim->m_lastUse)) {
+						victim = p;
+					}
+				}
+				if (victim == NULL) {
+					break;
+				}
+				
+				s_textureMap.remove(victim->m_name);
+				bytes -= victim->m_bytes;
+				s_evictions++;
+				evicted.append(victim);
+			}
+		}
+		
+		foreach (Private * p, evicted) {
+			release(p);
+		}
+	}
 
+	// The cache holds a reference to each of its textures, so that unused textures
+	// stay around until they are evicted. Textures are loaded from the batch compiler
+	// threads too, the mutex protects all the static members.
 	static QMap<QString, GLTexture::Private *> s_textureMap;
+	static QMutex s_textureMapMutex;
+	static qint64 s_cacheBudget;
+	static quint64 s_useCount;
+	static int s_hits;
+	static int s_misses;
+	static int s_evictions;
+	
+	qint64 m_bytes;		// Estimated video and main memory.
+	quint64 m_lastUse;
 
 private:
+	// Shared by all the textures that are still loading.
+	static const GLTexture & defaultTexture()
+	{
+		static GLTexture * texture = new GLTexture();
+		return *texture;
+	}
+	
 	QString m_name;
 	GLuint m_object;
 	GLuint m_target;
 
 	QImage m_icon;
 	QImage m_image;
+	
+	bool m_loaded;
 };
 
 //static
 QMap<QString, GLTexture::Private *> GLTexture::Private::s_textureMap;
+//static
+QMutex GLTexture::Private::s_textureMapMutex;
+//static
+qint64 GLTexture::Private::s_cacheBudget = 256 * 1024 * 1024;
+//static
+quint64 GLTexture::Private::s_useCount = 0;
+//static
+int GLTexture::Private::s_hits = 0;
+//static
+int GLTexture::Private::s_misses = 0;
+//static
+int GLTexture::Private::s_evictions = 0;
 
 
 GLTexture::GLTexture() : m_data(new Private)
@@ -101,17 +223,65 @@ GLTexture GLTexture::open(const QString & name)
 {
 	qDebug() << "open:" << name;
 	
+	// Make room first, the loader trims again once the texture is uploaded.
+	Private::trim();
+	
+	QMutexLocker locker(&Private::s_textureMapMutex);
+	
 	Private * p;
 	if( Private::s_textureMap.contains(name) ) {
 		p = Private::s_textureMap[name];
+		Private::s_hits++;
 	}
 	else {
 		p = new GLTexture::Private(name);
+		p->ref.ref();
 		Private::s_textureMap[name] = p;
+		Private::s_misses++;
 	}
+	p->m_lastUse = ++Private::s_useCount;
+	
 	return GLTexture(p);
 }
 
+// static
+void GLTexture::setCacheBudget(qint64 bytes)
+{
+	QMutexLocker locker(&Private::s_textureMapMutex);
+	Private::s_cacheBudget = bytes;
+}
+
+// static
+qint64 GLTexture::cacheBudget()
+{
+	QMutexLocker locker(&Private::s_textureMapMutex);
+	return Private::s_cacheBudget;
+}
+
+// static
+GLTexture::CacheStatistics GLTexture::cacheStatistics()
+{
+	QMutexLocker locker(&Private::s_textureMapMutex);
+	
+	CacheStatistics statistics;
+	statistics.textureCount = Private::s_textureMap.count();
+	statistics.bytes = 0;
+	foreach (const Private * p, Private::s_textureMap) {
+		statistics.bytes += p->m_bytes;
+	}
+	statistics.budget = Private::s_cacheBudget;
+	statistics.hits = Private::s_hits;
+	statistics.misses = Private::s_misses;
+	statistics.evictions = Private::s_evictions;
+	return statistics;
+}
+
+// static
+void GLTexture::trimCache()
+{
+	Private::trim();
+}
+
 const QString& GLTexture::name() const
 {
 	return m_data->name();
@@ -139,6 +309,11 @@ QImage GLTexture::image() const
 	return m_data->image();
 }
 
+bool GLTexture::isLoaded() const
+{
+	return m_data->isLoaded();
+}
+
 GLint GLTexture::wrapS() const
 {
 	glBindTexture(m_data->target(), m_data->object());
@@ -184,3 +359,427 @@ void GLTexture::setFilteringMode(GLint min, GLint mag) const
  	glTexParameteri(m_data->target(), GL_TEXTURE_MIN_FILTER, min);
  	glTexParameteri(m_data->target(), GL_TEXTURE_MAG_FILTER, mag);
 }
+
+
+namespace {
+	
+	static const GLvoid * bufferOffset(size_t offset)
+	{
+		return (const GLvoid *)offset;
+	}
+	
+	// Estimated size of the texture object, with the mipmaps.
+	static qint64 videoMemory(const TextureImage & image)
+	{
+		if (!image.levels.isEmpty()) {
+			qint64 size = 0;
+			foreach (const TextureLevel & level, image.levels) {
+				size += level.size;
+			}
+			// Single uncompressed levels get their mipmaps generated.
+			if (image.levels.count() == 1 && !image.compressed) {
+				size += size / 3;
+			}
+			return size;
+		}
+		
+		const qint64 size = qint64(image.pixels.width()) * image.pixels.height() * 4;
+		return size + size / 3;
+	}
+	
+} // namespace
+
+
+/// Texture waiting to be decoded or uploaded.
+class TextureLoader::Job
+{
+public:
+	Job(GLTexture::Private * texture, bool reload) : texture(texture), name(texture->name()), reload(reload), decoded(false), object(0), row(0) { }
+	
+	GLTexture::Private * texture;	// Referenced until the job is done.
+	QString name;
+	bool reload;	// The texture shows the previous image meanwhile.
+	
+	bool decoded;
+	TextureImage image;
+	QImage icon;
+	
+	GLuint object;	// Not visible until all the rows are uploaded.
+	int row;
+};
+
+
+class TextureLoader::DecodeTask : public QRunnable
+{
+public:
+	DecodeTask(TextureLoader * loader, Job * job, int maxTextureSize) : m_loader(loader), m_job(job), m_maxTextureSize(maxTextureSize) { }
+	
+	virtual void run()
+	{
+		TextureImage image = ImagePluginManager::decode(m_job->name, m_maxTextureSize);
+		QImage icon = image.image.scaled(16, 16, Qt::KeepAspectRatio, Qt::SmoothTransformation);
+		
+		{
+			QMutexLocker locker(&m_loader->m_mutex);
+			m_job->image = image;
+			m_job->icon = icon;
+			m_job->decoded = true;
+		}
+		
+		emit m_loader->textureDecoded();
+	}
+	
+private:
+	TextureLoader * m_loader;
+	Job * m_job;
+	int m_maxTextureSize;
+};
+
+
+// static
+TextureLoader * TextureLoader::s_instance = NULL;
+
+// static
+TextureLoader * TextureLoader::instance()
+{
+	static QMutex mutex;
+	QMutexLocker locker(&mutex);
+	
+	if (s_instance == NULL) {
+		s_instance = new TextureLoader();
+		qAddPostRoutine(cleanup);
+	}
+	return s_instance;
+}
+
+// static
+void TextureLoader::cleanup()
+{
+	delete s_instance;
+	s_instance = NULL;
+}
+
+TextureLoader::TextureLoader() : m_pixelBuffer(0), m_maxTextureSize(0)
+{
+	// Editors write in several steps, wait for them to settle.
+	m_reloadTimer.setSingleShot(true);
+	m_reloadTimer.setInterval(100);
+	
+	connect(&m_watcher, SIGNAL(fileChanged(const QString &)), this, SLOT(fileChanged(const QString &)));
+	connect(&m_reloadTimer, SIGNAL(timeout()), this, SLOT(reloadChangedFiles()));
+}
+
+TextureLoader::~TextureLoader()
+{
+	m_pool.waitForDone();
+	
+	// The contexts may be gone already, so the GL objects are left to them.
+	qDeleteAll(m_jobList);
+}
+
+void TextureLoader::load(GLTexture::Private * texture, bool reload)
+{
+	Q_ASSERT(texture != NULL);
+	
+	QMutexLocker locker(&m_mutex);
+	
+	// The textures are opened with a context current.
+	if (m_maxTextureSize == 0) {
+		m_maxTextureSize = 256;
+		glGetIntegerv(GL_MAX_TEXTURE_SIZE, &m_maxTextureSize);
+	}
+	
+	// Keep the texture alive until it's loaded.
+	texture->ref.ref();
+	
+	Job * job = new Job(texture, reload);
+	m_jobList.append(job);
+	m_pool.start(new DecodeTask(this, job, m_maxTextureSize));
+	
+	// The batch compiler threads don't run an event loop to watch the files.
+	if (!reload && QThread::currentThread() == thread() && QFile::exists(texture->name())) {
+		m_watcher.addPath(texture->name());
+	}
+}
+
+// static
+void TextureLoader::unwatch(const QString & name)
+{
+	// The textures may outlive the loader.
+	if (s_instance != NULL && QThread::currentThread() == s_instance->thread()) {
+		s_instance->m_watcher.removePath(name);
+		s_instance->m_changedFiles.remove(name);
+	}
+}
+
+void TextureLoader::fileChanged(const QString & name)
+{
+	m_changedFiles.insert(name);
+	m_reloadTimer.start();
+}
+
+void TextureLoader::reloadChangedFiles()
+{
+	foreach (const QString & name, m_changedFiles) {
+		// Saving by replacing the file makes the watcher drop it.
+		if (!m_watcher.files().contains(name) && QFile::exists(name)) {
+			m_watcher.addPath(name);
+		}
+		
+		GLTexture::Private::reload(name);
+	}
+	m_changedFiles.clear();
+}
+
+bool TextureLoader::upload(int budget)
+{
+	int uploaded = 0;
+	bool pending = false;
+	QList<Job *> completed;
+	
+	{
+		QMutexLocker locker(&m_mutex);
+		
+		// Reloads of a texture have to complete in order.
+		QSet<GLTexture::Private *> waiting;
+		
+		for (int i = 0; i < m_jobList.count(); ) {
+			Job * job = m_jobList.at(i);
+			
+			if (!job->decoded || waiting.contains(job->texture)) {
+				waiting.insert(job->texture);
+				i++;
+				continue;
+			}
+			if (uploaded >= budget) {
+				pending = true;
+				break;
+			}
+			if (uploadSlice(job, budget - uploaded, &uploaded)) {
+				m_jobList.removeAt(i);
+				completed.append(job);
+			}
+		}
+	}
+	
+	if (completed.isEmpty()) {
+		return pending;
+	}
+	
+	foreach (Job * job, completed) {
+		// Swap the complete texture in. A failed decode keeps the default image.
+		if (!job->image.isNull()) {
+			job->texture->setLoaded(job->object, job->image.image, job->icon, videoMemory(job->image));
+		}
+		GLTexture::Private::release(job->texture);
+		delete job;
+	}
+	
+	// The loaded textures may push the cache over its budget.
+	GLTexture::trimCache();
+	
+	emit textureLoaded();
+	
+	return pending;
+}
+
+void TextureLoader::finish()
+{
+	// The first thread uploads the jobs of everyone, the others wait until
+	// those textures are swapped in instead of finding an empty job list.
+	QMutexLocker locker(&m_finishMutex);
+	
+	m_pool.waitForDone();
+	upload(INT_MAX);
+	
+	// Other contexts only see the texture data once it's done.
+	glFinish();
+}
+
+/// Copy data to the pixel buffer, if there's one, and return the pointer to pass to GL.
+const GLvoid * TextureLoader::stage(const void * data, int size)
+{
+	if (!GLEW_ARB_pixel_buffer_object) {
+		return data;
+	}
+	
+	if (m_pixelBuffer == 0) {
+		glGenBuffers(1, &m_pixelBuffer);
+	}
+	glBindBuffer(GL_PIXEL_UNPACK_BUFFER, m_pixelBuffer);
+	
+	// Orphan the previous slice, the driver may still be reading from it.
+	glBufferData(GL_PIXEL_UNPACK_BUFFER, size, NULL, GL_STREAM_DRAW);
+	void * buffer = glMapBuffer(GL_PIXEL_UNPACK_BUFFER, GL_WRITE_ONLY);
+	if (buffer != NULL) {
+		memcpy(buffer, data, size);
+		glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+	}
+	else {
+		glBufferSubData(GL_PIXEL_UNPACK_BUFFER, 0, size, data);
+	}
+	
+	return bufferOffset(0);
+}
+
+void TextureLoader::unstage()
+{
+	if (GLEW_ARB_pixel_buffer_object) {
+		glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+	}
+}
+
+/// Upload the next slice of the job's image. Returns true when the texture is complete.
+bool TextureLoader::uploadSlice(Job * job, int budget, int * uploaded)
+{
+	const TextureImage & image = job->image;
+	if (image.isNull()) {
+		return true;
+	}
+	
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 4);
+	
+	if (job->object == 0) {
+		// Reloaded images with the same layout are updated in place, all at
+		// once so that no frame shows half of each image.
+		const GLuint object = job->texture->object();
+		if (job->reload && job->texture->isLoaded() && canUpdate(object, image)) {
+			job->object = object;
+			update(job, uploaded);
+			return true;
+		}
+		
+		glGenTextures(1, &job->object);
+	}
+	glBindTexture(GL_TEXTURE_2D, job->object);
+	
+	if (!image.levels.isEmpty()) {
+		// Precomputed levels go a whole level at a time, job->row counts them.
+		const TextureLevel & level = image.levels.at(job->row);
+		ImagePluginManager::uploadLevel(image, job->row, stage(image.data.constData() + level.offset, level.size));
+		unstage();
+		
+		job->row++;
+		*uploaded += level.size;
+		
+		if (job->row < image.levels.count()) {
+			return false;
+		}
+		
+		ImagePluginManager::setupLevels(image);
+		ReportGLErrors();
+		return true;
+	}
+	
+	const QImage & pixels = image.pixels;
+	const int w = pixels.width();
+	const int h = pixels.height();
+	const int pitch = pixels.bytesPerLine();
+	
+	const bool generateMipmap = GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object;
+	
+	if (job->row == 0) {
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, w, h, 0, image.format, image.type, NULL);
+	}
+	
+	const int rows = qBound(1, budget / pitch, h - job->row);
+	const bool last = job->row + rows == h;
+	
+	// Without glGenerateMipmap, have the driver build the mipmaps with the last slice.
+	const bool autoMipmap = !generateMipmap && (GLEW_SGIS_generate_mipmap || GLEW_VERSION_1_4);
+	if (last && autoMipmap) {
+		glTexParameteri(GL_TEXTURE_2D, GL_GENERATE_MIPMAP, GL_TRUE);
+	}
+	
+	const int size = rows * pitch;
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, job->row, w, rows, image.format, image.type, stage(pixels.constScanLine(job->row), size));
+	unstage();
+	
+	job->row += rows;
+	*uploaded += size;
+	
+	if (!last) {
+		return false;
+	}
+	
+	if (generateMipmap) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	
+	const bool mipmapped = generateMipmap || autoMipmap;
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, mipmapped ? GL_LINEAR_MIPMAP_LINEAR : GL_LINEAR);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+	
+	ReportGLErrors();
+	
+	return true;
+}
+
+/// Check that the levels of the image fit the storage of the object.
+bool TextureLoader::canUpdate(GLuint object, const TextureImage & image) const
+{
+	glBindTexture(GL_TEXTURE_2D, object);
+	
+	GLint internalFormat = 0;
+	glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+	
+	if (image.levels.isEmpty()) {
+		GLint width = 0, height = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, 0, GL_TEXTURE_HEIGHT, &height);
+		return internalFormat == GL_RGBA8 && width == image.pixels.width() && height == image.pixels.height();
+	}
+	
+	if (GLenum(internalFormat) != image.internalFormat) {
+		return false;
+	}
+	for (int i = 0; i < image.levels.count(); i++) {
+		GLint width = 0, height = 0;
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_WIDTH, &width);
+		glGetTexLevelParameteriv(GL_TEXTURE_2D, i, GL_TEXTURE_HEIGHT, &height);
+		if (width != image.levels.at(i).width || height != image.levels.at(i).height) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/// Replace the contents of the job's object, which canUpdate() accepted.
+void TextureLoader::update(Job * job, int * uploaded)
+{
+	const TextureImage & image = job->image;
+	glBindTexture(GL_TEXTURE_2D, job->object);
+	
+	if (!image.levels.isEmpty()) {
+		for (int i = 0; i < image.levels.count(); i++) {
+			const TextureLevel & level = image.levels.at(i);
+			const GLvoid * data = stage(image.data.constData() + level.offset, level.size);
+			if (image.compressed) {
+				glCompressedTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, image.internalFormat, level.size, data);
+			}
+			else {
+				glTexSubImage2D(GL_TEXTURE_2D, i, 0, 0, level.width, level.height, image.format, image.type, data);
+			}
+			unstage();
+			*uploaded += level.size;
+		}
+		
+		ImagePluginManager::setupLevels(image);
+		ReportGLErrors();
+		return;
+	}
+	
+	const QImage & pixels = image.pixels;
+	const int size = pixels.height() * pixels.bytesPerLine();
+	
+	// Textures loaded without glGenerateMipmap still have GL_GENERATE_MIPMAP set.
+	glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, pixels.width(), pixels.height(), image.format, image.type, stage(pixels.constBits(), size));
+	unstage();
+	*uploaded += size;
+	
+	if (GLEW_VERSION_3_0 || GLEW_ARB_framebuffer_object) {
+		glGenerateMipmap(GL_TEXTURE_2D);
+	}
+	
+	ReportGLErrors();
+}
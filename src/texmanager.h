@@ -23,10 +23,17 @@
 
 #include <GL/glew.h>
 
+#include <QObject>
 #include <QString>
+#include <QList>
+#include <QMutex>
 #include <QSharedDataPointer>
 #include <QMetaType>
 #include <QPixmap>
+#include <QThreadPool>
+#include <QFileSystemWatcher>
+#include <QTimer>
+#include <QSet>
 
 
 // Implicitly shared texture class.
@@ -39,12 +46,34 @@ public:
 	~GLTexture();
 	
 	static GLTexture open(const QString & name);
+	
+	/// Textures opened by name stay cached after their last use, until the estimated
+	/// memory of the cache goes over its budget and they are least recently used.
+	struct CacheStatistics
+	{
+		int textureCount;
+		qint64 bytes;
+		qint64 budget;
+		int hits;
+		int misses;
+		int evictions;
+	};
+	
+	static void setCacheBudget(qint64 bytes);
+	static qint64 cacheBudget();
+	static CacheStatistics cacheStatistics();
+	
+	// Evict textures until the cache fits in its budget. Needs a current context.
+	static void trimCache();
 
 	const QString& name() const;
 	GLuint object() const;
 	GLuint target() const;
 	QImage icon() const;
 	QImage image() const;
+	
+	// Textures show the default image until they are loaded in the background.
+	bool isLoaded() const;
 
 	
 	GLint wrapS() const;
@@ -59,6 +88,7 @@ public:
 	
 private:
 	class Private;
+	friend class TextureLoader;
 	GLTexture(Private * p);
 	QSharedDataPointer<Private> m_data;
 };
@@ -66,4 +96,71 @@ private:
 Q_DECLARE_METATYPE(GLTexture)
 
 
+struct TextureImage;
+
+/// Decodes the textures on a thread pool and uploads them a slice at a time
+/// through a pixel buffer object, so that opening an effect with many large
+/// textures doesn't freeze the editor. The source files are watched, and the
+/// textures are reloaded when they change on disk.
+class TextureLoader : public QObject
+{
+	Q_OBJECT
+public:
+	static TextureLoader * instance();
+	
+	// Upload decoded textures until budget bytes have been sent. Needs a current context.
+	// Returns true if there's still something to upload.
+	bool upload(int budget);
+	
+	// Wait for all the textures to decode and upload them. Needs a current context.
+	// Safe to call from several threads, it returns once all the textures
+	// requested before the call are complete and visible to the shared contexts.
+	void finish();
+	
+signals:
+	// A texture has been decoded and is waiting for upload().
+	void textureDecoded();
+	// A texture has been swapped in, its icon and image changed.
+	void textureLoaded();
+	
+private slots:
+	void fileChanged(const QString & name);
+	void reloadChangedFiles();
+	
+private:
+	TextureLoader();
+	~TextureLoader();
+	
+	static void cleanup();
+	
+	friend class GLTexture::Private;
+	void load(GLTexture::Private * texture, bool reload = false);
+	static void unwatch(const QString & name);
+	
+	class Job;
+	class DecodeTask;
+	friend class DecodeTask;
+	
+	bool uploadSlice(Job * job, int budget, int * uploaded);
+	bool canUpdate(GLuint object, const TextureImage & image) const;
+	void update(Job * job, int * uploaded);
+	const GLvoid * stage(const void * data, int size);
+	void unstage();
+	
+	QThreadPool m_pool;
+	QList<Job *> m_jobList;
+	QMutex m_mutex;
+	QMutex m_finishMutex;
+	GLuint m_pixelBuffer;
+	GLint m_maxTextureSize;
+	
+	// Only used from the thread that owns the loader.
+	QFileSystemWatcher m_watcher;
+	QSet<QString> m_changedFiles;
+	QTimer m_reloadTimer;
+	
+	static TextureLoader * s_instance;
+};
+
+
 #endif // TEXMANAGER_H